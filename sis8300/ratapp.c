@@ -2,16 +2,14 @@
 
 #ifdef TEST_RATAPP
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
 #endif
 
 #include <ratapp.h>
 
 
-/* Hopefully the compiler optimizes this away... */
-
-#define GR ((sqrt(5.0)+1.0)/2.0)
-
-
 /* The "worst" continued fraction's convergents exhibit 'slowest'
  * growth of their numerators and denominators. I.e., for a denominator
  * of a give size more terms are required.
@@ -32,34 +30,180 @@
  *
  * By solving for 'k' and assuming worst cases for signs we can
  * estimate the index of the next Fj > M where M is an integer.
- */                 
+ *
+ * Assuming the sign for even j, i.e., solving
+ *
+ *    { GR^j - GR^(-j) } / sqrt(5) >= M
+ *
+ * for the smallest integer j gives Fj >= M for even j. For odd j
+ * the left hand side is slightly less than Fj (by less than one)
+ * and hence Fj > M is required. Rather than evaluating logarithms
+ * (which rounds the wrong way close to big Fibonacci numbers) we
+ * look this up in a table holding all Fj which fit in 64 bits
+ * (128 bits if RatNum is a 128-bit number).
+ */
+
+#ifdef RATAPP_INT128
+typedef RatNum   FibNum;
+/* literals are limited to 64 bits */
+#define FIB128(hi,lo) ((((FibNum)(hi##ULL))<<64) | (FibNum)(lo##ULL))
+#else
+typedef uint64_t FibNum;
+#endif
+
+static const FibNum fib_tbl[] = {
+	                   0ULL,                    1ULL,                    1ULL,
+	                   2ULL,                    3ULL,                    5ULL,
+	                   8ULL,                   13ULL,                   21ULL,
+	                  34ULL,                   55ULL,                   89ULL,
+	                 144ULL,                  233ULL,                  377ULL,
+	                 610ULL,                  987ULL,                 1597ULL,
+	                2584ULL,                 4181ULL,                 6765ULL,
+	               10946ULL,                17711ULL,                28657ULL,
+	               46368ULL,                75025ULL,               121393ULL,
+	              196418ULL,               317811ULL,               514229ULL,
+	              832040ULL,              1346269ULL,              2178309ULL,
+	             3524578ULL,              5702887ULL,              9227465ULL,
+	            14930352ULL,             24157817ULL,             39088169ULL,
+	            63245986ULL,            102334155ULL,            165580141ULL,
+	           267914296ULL,            433494437ULL,            701408733ULL,
+	          1134903170ULL,           1836311903ULL,           2971215073ULL,
+	          4807526976ULL,           7778742049ULL,          12586269025ULL,
+	         20365011074ULL,          32951280099ULL,          53316291173ULL,
+	         86267571272ULL,         139583862445ULL,         225851433717ULL,
+	        365435296162ULL,         591286729879ULL,         956722026041ULL,
+	       1548008755920ULL,        2504730781961ULL,        4052739537881ULL,
+	       6557470319842ULL,       10610209857723ULL,       17167680177565ULL,
+	      27777890035288ULL,       44945570212853ULL,       72723460248141ULL,
+	     117669030460994ULL,      190392490709135ULL,      308061521170129ULL,
+	     498454011879264ULL,      806515533049393ULL,     1304969544928657ULL,
+	    2111485077978050ULL,     3416454622906707ULL,     5527939700884757ULL,
+	    8944394323791464ULL,    14472334024676221ULL,    23416728348467685ULL,
+	   37889062373143906ULL,    61305790721611591ULL,    99194853094755497ULL,
+	  160500643816367088ULL,   259695496911122585ULL,   420196140727489673ULL,
+	  679891637638612258ULL,  1100087778366101931ULL,  1779979416004714189ULL,
+	 2880067194370816120ULL,  4660046610375530309ULL,  7540113804746346429ULL,
+	12200160415121876738ULL,
+#ifdef RATAPP_INT128
+	FIB128(                   1,  1293530146158671551),
+	FIB128(                   1, 13493690561280548289),
+	FIB128(                   2, 14787220707439219840),
+	FIB128(                   4,  9834167195010216513),
+	FIB128(                   7,  6174643828739884737),
+	FIB128(                  11, 16008811023750101250),
+	FIB128(                  19,  3736710778780434371),
+	FIB128(                  31,  1298777728820984005),
+	FIB128(                  50,  5035488507601418376),
+	FIB128(                  81,  6334266236422402381),
+	FIB128(                 131, 11369754744023820757),
+	FIB128(                 212, 17704020980446223138),
+	FIB128(                 344, 10627031650760492279),
+	FIB128(                 557,  9884308557497163801),
+	FIB128(                 902,  2064596134548104464),
+	FIB128(                1459, 11948904692045268265),
+	FIB128(                2361, 14013500826593372729),
+	FIB128(                3821,  7515661444929089378),
+	FIB128(                6183,  3082418197812910491),
+	FIB128(               10004, 10598079642741999869),
+	FIB128(               16187, 13680497840554910360),
+	FIB128(               26192,  5831833409587358613),
+	FIB128(               42380,  1065587176432717357),
+	FIB128(               68572,  6897420586020075970),
+	FIB128(              110952,  7963007762452793327),
+	FIB128(              179524, 14860428348472869297),
+	FIB128(              290477,  4376692037216111008),
+	FIB128(              470002,   790376311979428689),
+	FIB128(              760479,  5167068349195539697),
+	FIB128(             1230481,  5957444661174968386),
+	FIB128(             1990960, 11124513010370508083),
+	FIB128(             3221441, 17081957671545476469),
+	FIB128(             5212402,  9759726608206432936),
+	FIB128(             8433844,  8394940206042357789),
+	FIB128(            13646246, 18154666814248790725),
+	FIB128(            22080091,  8102862946581596898),
+	FIB128(            35726338,  7810785687120836007),
+	FIB128(            57806429, 15913648633702432905),
+	FIB128(            93532768,  5277690247113717296),
+	FIB128(           151339198,  2744594807106598585),
+	FIB128(           244871966,  8022285054220315881),
+	FIB128(           396211164, 10766879861326914466),
+	FIB128(           641083131,   342420841837678731),
+	FIB128(          1037294295, 11109300703164593197),
+	FIB128(          1678377426, 11451721545002271928),
+	FIB128(          2715671722,  4114278174457313509),
+	FIB128(          4394049148, 15565999719459585437),
+	FIB128(          7109720871,  1233533820207347330),
+	FIB128(         11503770019, 16799533539666932767),
+	FIB128(         18613490890, 18033067359874280097),
+	FIB128(         30117260910, 16385856825831661248),
+	FIB128(         48730751801, 15972180111996389729),
+	FIB128(         78848012712, 13911292864118499361),
+	FIB128(        127578764514, 11436728902405337474),
+	FIB128(        206426777227,  6901277692814285219),
+	FIB128(        334005541741, 18338006595219622693),
+	FIB128(        540432318969,  6792540214324356296),
+	FIB128(        874437860711,  6683802735834427373),
+	FIB128(       1414870179680, 13476342950158783669),
+	FIB128(       2289308040392,  1713401612283659426),
+	FIB128(       3704178220072, 15189744562442443095),
+	FIB128(       5993486260464, 16903146174726102521),
+	FIB128(       9697664480537, 13646146663458994000),
+	FIB128(      15691150741002, 12102548764475544905),
+	FIB128(      25388815221540,  7301951354224987289),
+	FIB128(      41079965962543,   957756044990980578),
+	FIB128(      66468781184083,  8259707399215967867),
+	FIB128(     107548747146626,  9217463444206948445),
+	FIB128(     174017528330709, 17477170843422916312),
+	FIB128(     281566275477336,  8247890213920313141),
+	FIB128(     455583803808046,  7278316983633677837),
+	FIB128(     737150079285382, 15526207197553990978),
+	FIB128(    1192733883093429,  4357780107478117199),
+	FIB128(    1929883962378812,  1437243231322556561),
+	FIB128(    3122617845472241,  5795023338800673760),
+	FIB128(    5052501807851053,  7232266570123230321),
+	FIB128(    8175119653323294, 13027289908923904081),
+	FIB128(   13227621461174348,  1812812405337582786),
+	FIB128(   21402741114497642, 14840102314261486867),
+	FIB128(   34630362575671990, 16652914719599069653),
+	FIB128(   56033103690169633, 13046272960151004904),
+	FIB128(   90663466265841624, 11252443606040522941),
+	FIB128(  146696569956011258,  5851972492481976229),
+	FIB128(  237360036221852882, 17104416098522499170),
+	FIB128(  384056606177864141,  4509644517294923783),
+	FIB128(  621416642399717024,  3167316542107871337),
+	FIB128( 1005473248577581165,  7676961059402795120),
+	FIB128( 1626889890977298189, 10844277601510666457),
+	FIB128( 2632363139554879355,    74494587203909961),
+	FIB128( 4259253030532177544, 10918772188714576418),
+	FIB128( 6891616170087056899, 10993266775918486379),
+	FIB128(11150869200619234444,  3465294890923511181),
+	FIB128(18042485370706291343, 14458561666841997560),
+#endif
+};
+
+#define FIB_TBL_LEN ((int)(sizeof(fib_tbl)/sizeof(fib_tbl[0])))
 
 static int
-fib_idx(int M)
+fib_idx(RatNum M)
 {
-double m = (double)M * sqrt(5.0);
-	/* if j even - but we don't know which one it is */
-double pl = log( (m + sqrt( m*m + 4.0))/2.0 ) / log( GR );
-	/* if j odd  - but we don't know which one it is */
-#ifdef TEST_RATAPP
-double mi = round( log( (m + sqrt( m*m - 4.0))/2.0 ) / log( GR ) );
-	/* If we're close to a Fj then pl, pm differ slightly from an integer (j)
-	 * and we can round. If we are somewhere in the middle and the rounded
-	 * values differ then take the ceiling.
-	 * All of this is probably overkill but we just want to verify the theory ;-)
-	 * (at least for the first few numbers by means of a brute-force test; see below).
-	 *
-	 * Just ceil(pl) should be enough - but ceil( log( sqrt(5) * M ) / log( GR ) )
-	 * is not! A number with log(m)/log(GR) just below an integer could still
-	 * be slightly bigger than an Fn. The ceiling would then yield Fn where
-	 * in reality F(n+1) would be needed.
+int lo = 0, hi = FIB_TBL_LEN, mid;
+
+	/* Binary search for the smallest j with Fj >= M */
+	while ( lo < hi ) {
+		mid = (lo + hi) >> 1;
+		if ( fib_tbl[mid] < M )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* For odd j we need Fj > M. If no Fj >= M is found in the table
+	 * then the next one (not in the table) is certainly > M.
 	 */
-#endif
-	return (int) (
-#ifdef TEST_RATAPP
-		(round(pl) == mi) ? mi :
-#endif
-		ceil( pl ) );
+	if ( lo < FIB_TBL_LEN && fib_tbl[lo] == M && (lo & 1) )
+		lo++;
+
+	return lo;
 }
 
 int
@@ -169,8 +313,9 @@ RatNum d_max = r_max->d;
 		den = num - a*den;
 		num = w;
 
-		u = a * u + c[kl].conv.n;
-		t = a * t + c[kl].conv.d;
+		if (    ratapp_mac( &u, a, u, c[kl].conv.n )
+		     || ratapp_mac( &t, a, t, c[kl].conv.d ) )
+			return RATAPP_OVERFLOW;
 	}
 
 	return rval;
@@ -220,8 +365,8 @@ int    k,j;
 		}
 	    a   = d/n;
 
-		u = a*n2 + n1;
-		t = a*d2 + d1;
+		if ( ratapp_mac( &u, a, n2, n1 ) || ratapp_mac( &t, a, d2, d1 ) )
+			return RATAPP_OVERFLOW;
 
 		if ( t > d_max || u > n_max ) {
 			break;
@@ -239,8 +384,8 @@ int    k,j;
 		}
 		a   = n/d;
 
-		u   = a*n1+n2;
-		t   = a*d1+d2;
+		if ( ratapp_mac( &u, a, n1, n2 ) || ratapp_mac( &t, a, d1, d2 ) )
+			return RATAPP_OVERFLOW;
 	}
 	j = k&1;
 	c[j^1].conv.n   = n2;
@@ -252,6 +397,11 @@ int    k,j;
 	return k;
 }
 
+#ifdef TEST_RATAPP
+/* randomized tests and benchmark switch tracing off */
+static int test_trace = 1;
+#endif
+
 RatNum
 ratapp_intermediate(Rational *r, RatNum l, Convergent *c1, Convergent *c2, Rational *r_in)
 {
@@ -271,16 +421,19 @@ double     v;
 		r->n = c1->conv.n;
 		l    = 0;
 	} else {
+		/* l < c1->a; hence no overflow since the next convergent didn't */
 		r->d = l*c1->conv.d+c2->conv.d;
 		r->n = l*c1->conv.n+c2->conv.n;
 		if ( l == c1->a/2 ) {
 			v = (double)r_in->n/(double)r_in->d;
 #ifdef TEST_RATAPP
-			printf("testing special\n");
+			if ( test_trace )
+				printf("testing special\n");
 #endif
 			if ( fabs(v - (double)r->n/(double)r->d) > fabs(v - (double)c1->conv.n/(double)c1->conv.d) ) {
 #ifdef TEST_RATAPP
-				printf("testing special negative\n");
+				if ( test_trace )
+					printf("testing special negative\n");
 #endif
 				r->d = c1->conv.d;
 				r->n = c1->conv.n;
@@ -291,39 +444,145 @@ double     v;
 	return l;
 }
 
-/* Find best rational approximation with denominator smaller or equal to d_max */
-void
-ratapp_find_rational(Rational *r, Rational *r_in, Rational *r_max)
+/* Largest semiconvergent coefficient l for which l*c(k) + c(k-1)
+ * still meets the (normalized) limits; this only matters for the
+ * last pair (those of earlier pairs are smaller than the convergent
+ * following them).
+ */
+static RatNum
+ratapp_semi_max(Convergent c[2], RatNum n_max, RatNum d_max)
+{
+RatNum l,m;
+
+	if ( (l = c[CONV_N1].a) > 0 ) {
+		l--;
+		m = (d_max - c[CONV_N2].conv.d)/c[CONV_N1].conv.d;
+		if ( m < l )
+			l = m;
+		if ( c[CONV_N1].conv.n > 0 ) {
+			m = (n_max - c[CONV_N2].conv.n)/c[CONV_N1].conv.n;
+			if ( m < l )
+				l = m;
+		}
+	}
+	return l;
+}
+
+int
+ratapp_iter_init(RatappIter *it, Rational *r_in, Rational *r_max)
+{
+RatNum d_max = r_max->d;
+RatNum n_max = r_max->n;
+
+	it->r_in = *r_in;
+	it->l    = 0;
+	it->k    = ratapp_find_last_convergents( it->c, r_in, r_max );
+
+	if ( it->k < 0 )
+		return it->k;
+
+	if ( 0 == d_max )
+		d_max = RATNUM_MAX;
+	if ( 0 == n_max )
+		n_max = RATNUM_MAX;
+
+	/* Semiconvergents of the last pair must still meet r_max */
+	it->l = ratapp_semi_max( it->c, n_max, d_max );
+
+	return it->k;
+}
+
+/* Step from c(k), c(k-1) back to c(k-1), c(k-2) */
+static void
+ratapp_iter_back(RatappIter *it)
 {
-Convergent c[2];
-RatNum     l,k;
-int        n_conv;
-	/* Find convergents first */
-	n_conv = ratapp_find_last_convergents( c, r_in, r_max );
+Convergent *c1 = &it->c[CONV_N1];
+Convergent *c2 = &it->c[CONV_N2];
+RatNum      a, n, d;
 
-	if ( n_conv < 0 ) {
-		/* error in input operands */
+	if ( it->k <= 0 ) {
+		it->k = -1;
 		return;
 	}
 
-	if ( c[CONV_N1].a == 0 ) {
-		/* finite fraction; terminated with denominator or numerator less than d_max or n_max */
-		r->d = c[CONV_N1].conv.d;
-		r->n = c[CONV_N1].conv.n;
-		return;
+	a = c1->conv.d / c2->conv.d;
+	d = c1->conv.d - a*c2->conv.d;
+	/* d(k-2) may only be zero for k-2 == -1; we got here if d0 == d1 == 1 */
+	if ( 0 == d && it->k >= 2 ) {
+		a--;
+		d = c2->conv.d;
 	}
+	n = c1->conv.n - a*c2->conv.n;
 
-	/* Estimate max allowable coefficient for semiconvergent */
-	l = (r_max->d - c[CONV_N2].conv.d)/c[CONV_N1].conv.d;
-	k = (r_max->n - c[CONV_N2].conv.n)/c[CONV_N1].conv.n;
+	*c1        = *c2;
+	c1->a      = a;
+	c2->conv.n = n;
+	c2->conv.d = d;
+	c2->a      = 0; /* Undefined */
 
-	if ( k < l )
-		l = k;
+	it->l      = a - 1;
+	it->k--;
+}
 
-	ratapp_intermediate(r, l, &c[CONV_N1], &c[CONV_N2], r_in);
+int
+ratapp_iter_next(RatappIter *it, Rational *r)
+{
+	if ( it->k < 0 )
+		return -1;
+
+	if ( ratapp_intermediate( r, it->l, &it->c[CONV_N1], &it->c[CONV_N2], &it->r_in ) > 0 ) {
+		it->l--;
+		return 1;
+	}
+
+	/* got the convergent; next time try the previous pair */
+	ratapp_iter_back( it );
+	return 0;
+}
+
+int
+ratapp_iter_next_convergent(RatappIter *it, Convergent *c)
+{
+int k = it->k;
+
+	if ( k < 0 )
+		return -1;
+
+	*c = it->c[CONV_N1];
+	ratapp_iter_back( it );
+	return k;
+}
+
+/* Find best rational approximation with denominator smaller or equal to d_max */
+void
+ratapp_find_rational(Rational *r, Rational *r_in, Rational *r_max)
+{
+RatappIter it;
+
+	/* The iterator produces the best approximation first */
+	if ( ratapp_iter_init( &it, r_in, r_max ) < 0 ) {
+		/* error in input operands or overflow */
+		r->n = r->d = 0;
+		return;
+	}
+
+	ratapp_iter_next( &it, r );
 }
 
 #ifdef TEST_RATAPP
+/* Previous (floating-point) implementation of fib_idx(); used
+ * as a reference for testing.
+ */
+#define GR ((sqrt(5.0)+1.0)/2.0)
+
+static int
+fib_idx_fp(RatNum M)
+{
+double m = (double)M * sqrt(5.0);
+double pl = log( (m + sqrt( m*m + 4.0))/2.0 ) / log( GR );
+	return (int) ceil( pl );
+}
+
 static int
 ratapp_find_convergent_1(Convergent c[2], RatNum n, RatNum d, RatNum n_max, RatNum d_max)
 {
@@ -358,17 +617,17 @@ static void
 pr_conv(Convergent c[2], FILE *f)
 {
 	fprintf(f,"Cn-1: %"RATu"/%"RATu", Cn-2: %"RATu"/%"RATu", An: %"RATu"\n",
-		c[CONV_N1].conv.n,
-		c[CONV_N1].conv.d,
-		c[CONV_N2].conv.n,
-		c[CONV_N2].conv.d,
-		c[CONV_N1].a);
+		RATP(c[CONV_N1].conv.n),
+		RATP(c[CONV_N1].conv.d),
+		RATP(c[CONV_N2].conv.n),
+		RATP(c[CONV_N2].conv.d),
+		RATP(c[CONV_N1].a));
 }
 
 static void
 pr_rat(Rational *r_p, FILE *f)
 {
-	fprintf(f,"R: %"RATu"/%"RATu"\n", r_p->n, r_p->d);
+	fprintf(f,"R: %"RATu"/%"RATu"\n", RATP(r_p->n), RATP(r_p->d));
 }
 
 static int
@@ -376,7 +635,7 @@ cmp_conv(Convergent c1[2], Convergent c2[2])
 {
 int i;
 	for ( i=0; i<2; i++ ) {
-		if ( c1[i].conv.n != c2[i].conv.n || c2[i].conv.d != c2[i].conv.d )
+		if ( c1[i].conv.n != c2[i].conv.n || c1[i].conv.d != c2[i].conv.d )
 			return -1;
 	}
 	return c1[CONV_N1].a != c2[CONV_N1].a;
@@ -415,6 +674,9 @@ prcmp_rat(const char *pre, Rational *r1_p, Rational *r2_p)
 	return prcmp(pre, r1_p, r2_p, cmp_rat, pr_rat);
 }
 
+#define M1 100
+#define M2 100
+
 static int
 cf_test(void)
 {
@@ -423,6 +685,9 @@ unsigned pi_d = 1360120;
 Convergent c[2], c_i[2];
 Rational   r, r_i, r_max;
 Rational   r_i_m, r_max_m;
+Rational   r_it;
+Convergent c_a[64], c_it;
+RatappIter it;
 int      i,j,k,l,t,md,got;
 
 	/* Test a few cases; for even and odd number of iterations */
@@ -587,11 +852,122 @@ int      i,j,k,l,t,md,got;
 	if ( prcmp_rat( "39/94 (accept semiconvergent) test", &r, &r_i ) )
 		return 1;
 
+	/* Brute-force test of the iterator; it must reproduce the convergents
+	 * computed by ratapp_find_convergents() (in reverse order) and must
+	 * start out with what ratapp_find_rational() finds.
+	 */
+	fprintf(stderr,"Brute-force testing ratapp_iter_next() -- hang in there");
+	for ( i=0; i<M1; i++ ) {
+		r_i.n = i;
+		if ( ! (i & 63) )
+			fprintf(stderr,"\n");
+		fprintf(stderr,".");
+		for ( j=1; j<M1; j++ ) {
+			r_i.d = j;
+			for ( k=1; k<M2; k++ ) {
+				r_max.n = k;
+				for ( l=0; l<M2; l++ ) {
+					r_max.d = l;
+					got = ratapp_find_convergents( c_a, sizeof(c_a)/sizeof(c_a[0]), &r_i, &r_max );
+					if ( (t = ratapp_iter_init( &it, &r_i, &r_max )) != got - 1 ) {
+						fprintf(stderr,"\nITERATOR MISMATCH %i %i %i %i -> k = %i, expected %i\n", i,j,k,l,t,got - 1);
+						return 1;
+					}
+					if ( t < 0 )
+						continue;
+					ratapp_find_rational( &r, &r_i, &r_max );
+					ratapp_iter_next( &it, &r_it );
+					if ( cmp_rat( &r_it, &r ) ) {
+						fprintf(stderr,"\nITERATOR MISMATCH %i %i %i %i (first approximation)\n", i,j,k,l);
+						return 1;
+					}
+					ratapp_iter_init( &it, &r_i, &r_max );
+					while ( got > 0 ) {
+						if (    ratapp_iter_next_convergent( &it, &c_it ) != got - 1
+						     || c_it.conv.n != c_a[got].conv.n
+						     || c_it.conv.d != c_a[got].conv.d
+						     || c_it.a      != c_a[got].a ) {
+							fprintf(stderr,"\nITERATOR MISMATCH %i %i %i %i (convergent %i)\n", i,j,k,l,got - 1);
+							return 1;
+						}
+						got--;
+					}
+					if ( ratapp_iter_next_convergent( &it, &c_it ) >= 0 ) {
+						fprintf(stderr,"\nITERATOR MISMATCH %i %i %i %i (not exhausted)\n", i,j,k,l);
+						return 1;
+					}
+				}
+			}
+		}
+	}
+	fprintf(stderr,"\nDone: passed\n");
+
+	/* The Fibonacci table must be correct and complete */
+	fprintf(stderr,"Testing Fibonacci table: ");
+	for ( i=2; i < FIB_TBL_LEN; i++ ) {
+		if ( fib_tbl[i] != fib_tbl[i-1] + fib_tbl[i-2] ) {
+			fprintf(stderr,"BAD ENTRY %i\n", i);
+			return 1;
+		}
+	}
+	if ( sizeof(FibNum) == sizeof(RatNum) && fib_tbl[FIB_TBL_LEN-1] <= RATNUM_MAX - fib_tbl[FIB_TBL_LEN-2] ) {
+		fprintf(stderr,"INCOMPLETE\n");
+		return 1;
+	}
+	fprintf(stderr,"passed\n");
+
+	/* Overflow must be detected */
+	{
+	RatNum x;
+	if (    ratapp_mac( &x, RATNUM_MAX/2, 2, 1 ) || x != RATNUM_MAX
+	     || RATAPP_OVERFLOW != ratapp_mac( &x, RATNUM_MAX/2 + 1, 2, 0 )
+	     || RATAPP_OVERFLOW != ratapp_mac( &x, RATNUM_MAX/2, 2, 2 ) ) {
+		fprintf(stderr,"ratapp_mac() overflow test failed\n");
+		return 1;
+	}
+	fprintf(stderr,"ratapp_mac() overflow test passed\n");
+	}
+
+	/* Big numbers (golden ratio approximated by last two table entries) */
+	r_i.n = fib_tbl[FIB_TBL_LEN-1];
+	r_i.d = fib_tbl[FIB_TBL_LEN-2];
+	if ( r_i.n == fib_tbl[FIB_TBL_LEN-1] ) {
+		r_max.n = 0;
+		r_max.d = fib_tbl[FIB_TBL_LEN-3];
+		ratapp_find_rational( &r, &r_i, &r_max );
+		r_it.n = fib_tbl[FIB_TBL_LEN-2];
+		r_it.d = fib_tbl[FIB_TBL_LEN-3];
+		if ( prcmp_rat( "Big golden ratio test", &r, &r_it ) )
+			return 1;
+	}
+
+	/* The table-based fib_idx() must agree with the floating-point version
+	 * (as long as the latter has enough resolution to tell Fj from Fj+-1, i.e.,
+	 * Fj < 2^24).
+	 */
+	fprintf(stderr,"Testing fib_idx() against floating-point reference: ");
+	for ( i=0; i < (1<<20); i++ ) {
+		if ( fib_idx( i ) != fib_idx_fp( i ) ) {
+			fprintf(stderr,"MISMATCH FOUND fib_idx(%i) = %i, reference %i\n", i, fib_idx( i ), fib_idx_fp( i ));
+			return 1;
+		}
+	}
+	for ( i=1; i < FIB_TBL_LEN && fib_tbl[i] < (1<<24); i++ ) {
+		for ( j = -1; j <= 1; j++ ) {
+			t = fib_tbl[i] + j;
+			if ( fib_idx( t ) != fib_idx_fp( t ) ) {
+				fprintf(stderr,"MISMATCH FOUND fib_idx(%i) = %i, reference %i\n", t, fib_idx( t ), fib_idx_fp( t ));
+				return 1;
+			}
+		}
+	}
+	fprintf(stderr,"passed\n");
+
 	/* Brute-force test of ratap_estimate_terms() */
-#define M1 100
-#define M2 100
 	fprintf(stderr,"Brute-force testing ratapp_estimate_terms() -- hang in there");
 	md = 0;
+	/* only printed if md was set */
+	r_i_m.n = r_i_m.d = r_max_m.n = r_max_m.d = 0;
 	for ( i=0; i<M1; i++ ) {
 		r_i.n = i;
 		if ( ! (i & 63) )
@@ -632,7 +1008,7 @@ int      i,j,k,l,t,md,got;
 	fprintf(stderr,"\nDone: ");
 	if ( md ) {
 		fprintf(stderr,"MAX MISMATCH: %i\n", md);
-		fprintf(stderr,"r = %"RATu"/%"RATu", r_max = %"RATu"/%"RATu"\n", r_i_m.n, r_i_m.d, r_max_m.n, r_max_m.d);
+		fprintf(stderr,"r = %"RATu"/%"RATu", r_max = %"RATu"/%"RATu"\n", RATP(r_i_m.n), RATP(r_i_m.d), RATP(r_max_m.n), RATP(r_max_m.d));
 		return 1;
 	} else {
 		fprintf(stderr,"passed\n");
@@ -642,22 +1018,328 @@ int      i,j,k,l,t,md,got;
 }
 
 
+/* Randomized tests against brute-force references */
+
+static uint64_t rnd_state = 0x2545f4914f6cdd1dULL;
+
+/* xorshift64* */
+static uint64_t
+rnd64(void)
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return rnd_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* random number with a random number of significant bits (<= nbits) */
+static RatNum
+rnd_rat(int nbits)
+{
+RatNum x;
+int    b;
+	x = rnd64();
+#ifdef RATAPP_INT128
+	if ( nbits > 64 )
+		x = (x << 64) | rnd64();
+#endif
+	b = rnd64() % nbits + 1;
+	if ( b < (int)(8*sizeof(x)) )
+		x &= (((RatNum)1) << b) - 1;
+	return x;
+}
+
+/* Reference: all convergents of n/d by plain Euclid (no limits).
+ * RETURNS number of convergents stored in p[], q[], a[] with a[i] being
+ * the term following convergent i (0 if none).
+ */
+#define REF_MAX_TERMS 100
+
+static int
+ref_convergents(uint64_t *p, uint64_t *q, uint64_t *a, uint64_t n, uint64_t d)
+{
+uint64_t p1 = 1, q1 = 0, p2 = 0, q2 = 1, t, x;
+int      i;
+	for ( i = 0; i < REF_MAX_TERMS; i++ ) {
+		x    = n/d;
+		p[i] = x*p1 + p2; p2 = p1; p1 = p[i];
+		q[i] = x*q1 + q2; q2 = q1; q1 = q[i];
+		t    = n - x*d;
+		n    = d;
+		d    = t;
+		if ( 0 == d ) {
+			a[i] = 0;
+			return i+1;
+		}
+		a[i] = n/d;
+	}
+	return -1;
+}
+
+/* Reference: best approximation of n/d with denominator <= d_max and
+ * numerator <= n_max by checking every denominator. Returns the 'distance'
+ * |n/d - p/q| * d as a fraction dist_n/dist_q.
+ */
+static void
+ref_rational(uint64_t *dist_n, uint64_t *dist_q, uint64_t n, uint64_t d, uint64_t n_max, uint64_t d_max)
+{
+uint64_t q, p, p0, e, bn = ~0ULL, bq = 1;
+int      j;
+	for ( q = 1; q <= d_max; q++ ) {
+		p0 = (n*q)/d;
+		for ( j = 0; j < 2; j++ ) {
+			p = p0 + j;
+			if ( p > n_max )
+				p = n_max;
+			e = n*q > p*d ? n*q - p*d : p*d - n*q;
+			if ( e*bq < bn*q ) {
+				bn = e;
+				bq = q;
+			}
+		}
+	}
+	*dist_n = bn;
+	*dist_q = bq;
+}
+
+static int
+rnd_test(long n_tests)
+{
+long       i;
+int        k, m, got, nc, l;
+uint64_t   n, d, n_max, d_max, e, bn, bq;
+uint64_t   p[REF_MAX_TERMS], q[REF_MAX_TERMS], a[REF_MAX_TERMS];
+Rational   r_i, r_max, r;
+Convergent c[2], c_a[8];
+
+	test_trace = 0;
+	for ( i = 0; i < n_tests; i++ ) {
+		/* keep brute-force affordable */
+		n     = rnd_rat( 16 );
+		d     = rnd_rat( 16 ) | 1;
+		d_max = rnd_rat( 12 ) | 1;
+		n_max = (rnd64() & 1) ? 0 : rnd_rat( 16 );
+
+		r_i.n   = n;
+		r_i.d   = d;
+		r_max.n = n_max;
+		r_max.d = d_max;
+
+		nc = ref_convergents( p, q, a, n, d );
+		/* convergents which meet the limits */
+		for ( m = 0; m < nc && q[m] <= d_max && ( 0 == n_max || p[m] <= n_max ); m++ )
+			;
+
+		/* ratapp_find_last_convergents() */
+		k = ratapp_find_last_convergents( c, &r_i, &r_max );
+		if ( k != m - 1 ) {
+			fprintf(stderr,"find_last_convergents(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64"): k = %i, expected %i\n", n, d, n_max, d_max, k, m - 1);
+			return 1;
+		}
+		if (    k >= 0
+		     && (   c[CONV_N1].conv.n != p[k] || c[CONV_N1].conv.d != q[k] || c[CONV_N1].a != a[k]
+		         || ( k > 0 && ( c[CONV_N2].conv.n != p[k-1] || c[CONV_N2].conv.d != q[k-1] ) ) ) ) {
+			fprintf(stderr,"find_last_convergents(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64"): wrong convergents\n", n, d, n_max, d_max);
+			return 1;
+		}
+
+		/* ratapp_find_convergents() (with wrap-around) */
+		l   = sizeof(c_a)/sizeof(c_a[0]);
+		got = ratapp_find_convergents( c_a, l, &r_i, &r_max );
+		if ( got != m ) {
+			fprintf(stderr,"find_convergents(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64"): got %i, expected %i\n", n, d, n_max, d_max, got, m);
+			return 1;
+		}
+		for ( k = m - 1; k >= 0 && k >= m - (l - 1); k-- ) {
+			Convergent *cp = &c_a[ (k+1) % l ];
+			if ( cp->conv.n != p[k] || cp->conv.d != q[k] || cp->a != a[k] ) {
+				fprintf(stderr,"find_convergents(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64"): wrong convergent %i\n", n, d, n_max, d_max, k);
+				return 1;
+			}
+		}
+
+		/* ratapp_find_rational() */
+		ratapp_find_rational( &r, &r_i, &r_max );
+		if ( 0 == r.d ) {
+			/* Only legal failure: even the first convergent (integer part) exceeds n_max */
+			if ( m > 0 ) {
+				fprintf(stderr,"find_rational(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64"): no result\n", n, d, n_max, d_max);
+				return 1;
+			}
+		} else {
+			ref_rational( &bn, &bq, n, d, 0 == n_max ? ~0ULL : n_max, d_max );
+			e = n*r.d > r.n*d ? n*r.d - r.n*d : r.n*d - n*r.d;
+			if (    r.d > d_max || ( n_max && r.n > n_max ) || e*bq != bn*r.d ) {
+				fprintf(stderr,"find_rational(%"PRIu64"/%"PRIu64", n_max %"PRIu64", d_max %"PRIu64") = %"RATu"/%"RATu" -- not the best approximation\n", n, d, n_max, d_max, RATP(r.n), RATP(r.d));
+				return 1;
+			}
+		}
+	}
+	fprintf(stderr,"Randomized test (%ld inputs, %i-bit RatNum): passed\n", n_tests, (int)(8*sizeof(RatNum)));
+	return 0;
+}
+
+/* Micro-benchmark */
+
+#define BENCH_N 1024
+
+static double
+bench_now(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec * 1.0E9 + (double)t.tv_nsec;
+}
+
+static void
+bench_report(const char *nm, double t0, long calls)
+{
+	printf("%-36s %8.1f ns/call (%i-bit RatNum)\n", nm, (bench_now() - t0)/(double)calls, (int)(8*sizeof(RatNum)));
+}
+
+static int
+bench(long n_calls)
+{
+static Rational   r_i[BENCH_N], r_max[BENCH_N], r[BENCH_N];
+Convergent        c[2], c_a[20];
+RatappIter        it;
+long              i, rep;
+int               j;
+volatile RatNum   sink = 0;
+double            t0;
+int               nbits = 8*sizeof(RatNum);
+
+	test_trace = 0;
+
+	/* Inputs use the full width of RatNum; limits about half of it (typical
+	 * for divider planning).
+	 */
+	for ( j = 0; j < BENCH_N; j++ ) {
+		r_i[j].n   = rnd_rat( nbits );
+		r_i[j].d   = rnd_rat( nbits ) | 1;
+		r_max[j].n = 0;
+		r_max[j].d = rnd_rat( nbits/2 ) | 1;
+	}
+	rep = (n_calls + BENCH_N - 1)/BENCH_N;
+	n_calls = rep * BENCH_N;
+
+	t0 = bench_now();
+	for ( i = 0; i < rep; i++ )
+		for ( j = 0; j < BENCH_N; j++ ) {
+			ratapp_find_rational( &r[j], &r_i[j], &r_max[j] );
+		}
+	bench_report( "ratapp_find_rational", t0, n_calls );
+	sink += r[0].n;
+
+	t0 = bench_now();
+	for ( i = 0; i < rep; i++ )
+		for ( j = 0; j < BENCH_N; j++ ) {
+			ratapp_find_last_convergents( c, &r_i[j], &r_max[j] );
+			sink += c[CONV_N1].conv.n;
+		}
+	bench_report( "ratapp_find_last_convergents", t0, n_calls );
+
+	t0 = bench_now();
+	for ( i = 0; i < rep; i++ )
+		for ( j = 0; j < BENCH_N; j++ ) {
+			ratapp_find_convergents( c_a, sizeof(c_a)/sizeof(c_a[0]), &r_i[j], &r_max[j] );
+			sink += c_a[0].conv.n;
+		}
+	bench_report( "ratapp_find_convergents", t0, n_calls );
+
+	t0 = bench_now();
+	for ( i = 0; i < rep; i++ )
+		for ( j = 0; j < BENCH_N; j++ ) {
+			sink += ratapp_estimate_terms( &r_i[j], &r_max[j] );
+		}
+	bench_report( "ratapp_estimate_terms", t0, n_calls );
+
+	t0 = bench_now();
+	for ( i = 0; i < rep; i++ )
+		for ( j = 0; j < BENCH_N; j++ ) {
+			/* semiconvergents are not bounded (terms of random numbers may be huge) */
+			ratapp_iter_init( &it, &r_i[j], &r_max[j] );
+			while ( ratapp_iter_next_convergent( &it, &c[0] ) >= 0 )
+				sink += c[0].conv.n;
+		}
+	bench_report( "ratapp_iter (all convergents)", t0, n_calls );
+
+	return 0;
+}
+
+static void
+usage(const char *nm)
+{
+	fprintf(stderr,"Usage: %s [-h] [-r <n_inputs>] [-b <n_calls>] [-s <seed>]\n", nm);
+	fprintf(stderr,"       %s N D D_max [N_max]\n", nm);
+	fprintf(stderr,"  Without arguments: run built-in (exhaustive) tests\n");
+	fprintf(stderr,"  -r <n_inputs>: randomized test against brute-force reference\n");
+	fprintf(stderr,"  -b <n_calls> : benchmark (ns per call)\n");
+	fprintf(stderr,"  -s <seed>    : seed for random number generator\n");
+	fprintf(stderr,"  N D D_max [N_max]: compute best approximation of N/D\n");
+}
+
 int
 main(int argc, char **argv)
 {
-int i,m;
+int   i,m,opt;
 unsigned a[4];
 Rational r;
+long  n_rnd   = -1;
+long  n_bench = -1;
+long  seed;
+int   rval    = 0;
+
+	while ( (opt = getopt(argc, argv, "hr:b:s:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'r':
+				if ( 1 != sscanf(optarg,"%li",&n_rnd) || n_rnd < 0 ) {
+					fprintf(stderr,"Invalid -r argument\n");
+					return 1;
+				}
+				break;
+			case 'b':
+				if ( 1 != sscanf(optarg,"%li",&n_bench) || n_bench < 0 ) {
+					fprintf(stderr,"Invalid -b argument\n");
+					return 1;
+				}
+				break;
+			case 's':
+				if ( 1 != sscanf(optarg,"%li",&seed) ) {
+					fprintf(stderr,"Invalid -s argument\n");
+					return 1;
+				}
+				/* state must not be zero */
+				rnd_state = (uint64_t)seed ^ 0x2545f4914f6cdd1dULL;
+				if ( 0 == rnd_state )
+					rnd_state = 1;
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	if ( n_rnd >= 0 || n_bench >= 0 ) {
+		if ( n_rnd >= 0 && (rval = rnd_test( n_rnd )) )
+			return rval;
+		if ( n_bench >= 0 )
+			rval = bench( n_bench );
+		return rval;
+	}
 
 	m = sizeof(a)/sizeof(a[0]);
 	for ( i=0; i<m; i++ )
 		a[i] = 0;
 
-	if ( 1 == argc ) {
+	if ( optind == argc ) {
 		return cf_test();
 	} else {
-		for ( i=1; i<argc && i < m+1; i++ ) {
-			if ( 1 != sscanf(argv[i],"%u",a+i-1) ) {
+		for ( i=optind; i<argc && i < m+optind; i++ ) {
+			if ( 1 != sscanf(argv[i],"%u",a+i-optind) ) {
 				break;
 			}
 		}
@@ -670,7 +1352,7 @@ Rational r;
 
 	ratapp_find_rational_1( &r, a[0], a[1], 0 == a[3] ? RATNUM_MAX : a[3], 0 == a[2] ? RATNUM_MAX : a[2]);
 
-	printf("Best rational approximation (max. denominator %u, max. numerator %u) of %u/%u == %"RATu"/%"RATu"\n", a[2], a[3], a[0], a[1], r.n, r.d);
+	printf("Best rational approximation (max. denominator %u, max. numerator %u) of %u/%u == %"RATu"/%"RATu"\n", a[2], a[3], a[0], a[1], RATP(r.n), RATP(r.d));
 	return 0;
 }
 #endif
@@ -6,18 +6,32 @@
 /* Approximation of rational numbers with others that have a smaller
  * denominator.
  */
-#ifndef TEST_SMALL
+#if defined(TEST_SMALL)
+typedef uint32_t RatNum;
+
+#define RATNUM_MAX ((uint32_t)(-1LL))
+#define RATu PRIu32
+#define RATx PRIx32
+#elif defined(RATAPP_INT128)
+typedef unsigned __int128 RatNum;
+
+#define RATNUM_MAX (~(RatNum)0)
+/* printf() cannot handle 128-bit numbers; only the lower
+ * 64 bits are printed (use RATP() on the argument).
+ */
+#define RATu PRIu64
+#define RATx PRIx64
+#define RATP(x) ((uint64_t)(x))
+#else
 typedef uint64_t RatNum;
 
 #define RATNUM_MAX ((uint64_t)(-1LL))
 #define RATu PRIu64
 #define RATx PRIx64
-#else
-typedef uint32_t RatNum;
+#endif
 
-#define RATNUM_MAX ((uint32_t)(-1LL))
-#define RATu PRIu32
-#define RATx PRIx32
+#ifndef RATP
+#define RATP(x) (x)
 #endif
 
 typedef struct Rational_ {
@@ -32,20 +46,47 @@ typedef struct Convergent_ {
 	Rational    conv;
 } Convergent;
 
+/* Value returned by routines which detected overflow of RatNum */
+#define RATAPP_OVERFLOW (-2)
+
 /* NOTES:
- *  - routines dont' handle overflow gracefully
+ *  - Convergents (and semiconvergents) of n/d never exceed n and d.
+ *    However, if RatNum overflows while computing (or while a caller
+ *    builds the input) then results would silently be wrong; the
+ *    routines detect this and return RATAPP_OVERFLOW. Callers should
+ *    use ratapp_mac() when computing n or d.
  *  - must not supply denominator or zero.
  *  - r_max specifies max. acceptable numerator and denominator. 
  *    Values of zero mean 'infinite' - but not both may be set
  *    to zero or RATNUM_MAX.
  */
 
+/* Compute a*x + y.
+ *
+ * RETURNS: 0 on success, RATAPP_OVERFLOW if the result does not
+ *          fit in a RatNum (*r is undefined in this case).
+ */
+static __inline__ int
+ratapp_mac(RatNum *r, RatNum a, RatNum x, RatNum y)
+{
+#if defined(__GNUC__) && __GNUC__ >= 5
+	if ( __builtin_mul_overflow( a, x, r ) || __builtin_add_overflow( *r, y, r ) )
+		return RATAPP_OVERFLOW;
+#else
+	if ( x && a > (RATNUM_MAX - y)/x )
+		return RATAPP_OVERFLOW;
+	*r = a*x + y;
+#endif
+	return 0;
+}
+
 /* find (up to) the last 'n' convergents of n/d with denominator smaller or equal
  * to r_max.d and numerator smaller or equal to r_max.n.
  * 
  * The user must pass an array of 'n' Convergent structs. If the continued
  * fraction terminates then the 'a' member of the last convergent is zero.
  * RETURNS: The index of the last convergent. The last convergent is c[k].
+ *          -1 on error, RATAPP_OVERFLOW on overflow.
  * NOTES:   Storage wraps around, i.e., if k >= n then the index of
  *          c[j] with j associated with k, k-1, k-(n-1) is computed as j = k MOD n;
  * 
@@ -55,7 +96,8 @@ int
 ratapp_find_convergents(Convergent *c, int n, Rational *r_in, Rational *r_max);
 
 /* like ratapp_find_convergents() but store only the last two convergents
- * RETURNS: index/order of last convergent.
+ * RETURNS: index/order of last convergent; -1 if there is none
+ *          (or both limits are infinite), RATAPP_OVERFLOW on overflow.
  * NOTES:   c[0] = c(n-1)
  *          c[1] = c(n-1)
  *
@@ -70,7 +112,9 @@ ratapp_find_last_convergents(Convergent c[2], Rational *r_in, Rational *r_max);
 int
 ratapp_estimate_terms(Rational *r_in, Rational *r_max);
 
-/* Find best rational approximation with denominator smaller or equal to d_max */
+/* Find best rational approximation with denominator smaller or equal to d_max
+ * If no approximation can be found (error, overflow) then *r is set to 0/0.
+ */
 void
 ratapp_find_rational(Rational *r, Rational *r_in, Rational *r_max);
 
@@ -106,4 +150,61 @@ ratapp_find_rational(Rational *r, Rational *r_in, Rational *r_max);
 RatNum
 ratapp_intermediate(Rational *r, RatNum l, Convergent *c1, Convergent *c2, Rational *r_in);
 
+/* Iterator over the approximations of r_in which meet r_max; the
+ * approximations are produced lazily, best ones first. The state
+ * is small and may live on the stack; no memory is allocated.
+ *
+ * Only the last two convergents are kept; earlier ones are recovered
+ * by running the recurrence backwards
+ *
+ *    c[k-2] = c[k] - a[k] * c[k-1]
+ *
+ * (with a[k] = floor( d[k] / d[k-1] ) which is exact because
+ * d[k-2] < d[k-1] -- except for d[0] == d[1] == 1 which is taken
+ * care of).
+ *
+ * NOTE: The iterator does not reference r_in/r_max after
+ *       ratapp_iter_init() returns.
+ */
+typedef struct RatappIter_ {
+	Convergent c[2];  /* c[CONV_N1] = c(k), c[CONV_N2] = c(k-1); c[CONV_N1].a = a(k+1) */
+	Rational   r_in;
+	RatNum     l;     /* next semiconvergent coefficient to try                       */
+	int        k;     /* index of c[CONV_N1]; negative when exhausted                 */
+} RatappIter;
+
+/* Initialize the iterator.
+ *
+ * RETURNS: index of the last convergent which meets r_max or
+ *          a negative value if there is none (or on error).
+ */
+int
+ratapp_iter_init(RatappIter *it, Rational *r_in, Rational *r_max);
+
+/* Retrieve the next approximation into *r. Starting with the best
+ * semiconvergent (if any) the semiconvergents l*c(k) + c(k-1)
+ * (l = a(k+1)-1 ... down to the last one which is still better than
+ * c(k), see ratapp_intermediate()) are produced followed by c(k)
+ * itself. Then the same is repeated for c(k-1), c(k-2), ..., c(0).
+ *
+ * This is the order in which a caller looking for the best approximation
+ * which meets some additional criteria wants to inspect candidates; it
+ * may just stop as soon as an acceptable one is found.
+ *
+ * RETURNS: 1 if *r is a semiconvergent, 0 if it is a convergent and
+ *          -1 if the iterator is exhausted (*r not modified).
+ */
+int
+ratapp_iter_next(RatappIter *it, Rational *r);
+
+/* Like ratapp_iter_next() but skip the semiconvergents, i.e., produce
+ * the convergents c(k), c(k-1), ..., c(0). The 'a' member of *c holds
+ * the term following the convergent (zero if the continued fraction
+ * terminated).
+ *
+ * RETURNS: index of the convergent or -1 if the iterator is exhausted.
+ */
+int
+ratapp_iter_next_convergent(RatappIter *it, Convergent *c);
+
 #endif
@@ -0,0 +1,3 @@
+/* Test and benchmark program for ratapp.c (run with -h for options) */
+#define TEST_RATAPP
+#include "ratapp.c"
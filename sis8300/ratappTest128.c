@@ -0,0 +1,6 @@
+/* Like ratappTest.c but with 128-bit RatNum */
+#ifndef RATAPP_INT128
+#define RATAPP_INT128
+#endif
+#define TEST_RATAPP
+#include "ratapp.c"
@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <saio.h>
+
+int
+saio_setup(unsigned nr_events, aio_context_t *ctx_p)
+{
+	*ctx_p = 0;
+	return syscall( __NR_io_setup, nr_events, ctx_p );
+}
+
+int
+saio_destroy(aio_context_t ctx)
+{
+	return syscall( __NR_io_destroy, ctx );
+}
+
+int
+saio_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall( __NR_io_submit, ctx, nr, iocbpp );
+}
+
+int
+saio_cancel(aio_context_t ctx, struct iocb *iocb, struct io_event *result)
+{
+	return syscall( __NR_io_cancel, ctx, iocb, result );
+}
+
+int
+saio_getevents(aio_context_t ctx, long min_nr, long nr, struct io_event *events, struct timespec *timeout)
+{
+	return syscall( __NR_io_getevents, ctx, min_nr, nr, events, timeout );
+}
+
+void
+saio_prep_pread(struct iocb *iocb, int fd, void *buf, size_t count, long long offset, uint64_t data)
+{
+	memset( iocb, 0, sizeof(*iocb) );
+	iocb->aio_fildes     = fd;
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_buf        = (uintptr_t)buf;
+	iocb->aio_nbytes     = count;
+	iocb->aio_offset     = offset;
+	iocb->aio_data       = data;
+}
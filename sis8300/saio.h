@@ -0,0 +1,39 @@
+#ifndef SAIO_H
+#define SAIO_H
+
+/* Simple wrappers for linux' native AIO syscalls (glibc does not
+ * provide them and we don't want to depend on libaio).
+ *
+ * All routines return the (non-negative) result of the syscall
+ * or -1 with errno set on error.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <linux/aio_abi.h>
+
+int
+saio_setup(unsigned nr_events, aio_context_t *ctx_p);
+
+int
+saio_destroy(aio_context_t ctx);
+
+/* RETURNS: number of iocbs submitted */
+int
+saio_submit(aio_context_t ctx, long nr, struct iocb **iocbpp);
+
+int
+saio_cancel(aio_context_t ctx, struct iocb *iocb, struct io_event *result);
+
+/* RETURNS: number of events harvested (0 on timeout) */
+int
+saio_getevents(aio_context_t ctx, long min_nr, long nr, struct io_event *events, struct timespec *timeout);
+
+/* Prepare 'iocb' for reading 'count' bytes at 'offset' into 'buf';
+ * 'data' is passed back in the 'data' member of the io_event.
+ */
+void
+saio_prep_pread(struct iocb *iocb, int fd, void *buf, size_t count, long long offset, uint64_t data);
+
+#endif
@@ -0,0 +1,904 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sis8300Digi.h>
+#include <sis8300Acq.h>
+#include <saio.h>
+
+/* Acquisition engine (see sis8300Acq.h)
+ *
+ * Frame buffers ('slots') carry a reference count:
+ *   -1: claimed by the reader thread (being filled)
+ *    0: free (may hold a published frame which nobody looks at)
+ *   >0: held by that many readers
+ * The reader thread claims a slot with CAS 0 -> -1, readers take a
+ * reference with CAS n -> n+1 (n >= 0). Thus, a slot can never be
+ * refilled while a reader holds it.
+ *
+ * Published frames are recorded in a ring ('pub') of (seq << 8 | slot)
+ * words. A reader looks up the frame it wants next, takes a reference
+ * on the slot and then verifies that the slot still holds the frame
+ * with the expected sequence number (it could have been recycled in
+ * the meantime in which case the frame is lost -- an overrun).
+ *
+ * The reader thread numbers acquisitions; acquisition #n is armed for
+ * kinds[n % plen] using the precomputed read mode modes[n % plen]. Only
+ * one acquisition is armed at a time, thus the frame completed next is
+ * always that of the acquisition armed last.
+ */
+
+#define SEQ_INVALID ((uint64_t)-1)
+
+/* How long sis8300AcqStop() waits for AIO reads still in flight (ms) */
+#define STOP_AIO_TMO_MS   1000
+/* ...and, once disarmed, for reads the driver fails or completes (ms) */
+#define STOP_DISARM_TMO_MS 100
+
+typedef struct Sis8300AcqSlotRec_ {
+	Sis8300FrameRec    frame;   /* must be first (see sis8300AcqReaderRelease()) */
+	void              *buf;
+	int                refs;
+	int                leaked;  /* target of an abandoned AIO read        */
+	Sis8300DspStatsRec stats;   /* if parms.stats is set                  */
+} Sis8300AcqSlotRec, *Sis8300AcqSlot;
+
+typedef struct Sis8300AcqRec_ {
+	Sis8300AcqParmsRec parms;
+	Sis8300LayoutRec   lay;
+	size_t             sz;      /* buffer size                           */
+	size_t             dsz;     /* bytes read (no trailing padding)      */
+	Sis8300AcqSlot     slots;
+	void              *scratch; /* read into this when all slots are busy
+	                             * (one per AIO read in flight)          */
+	uint64_t          *pub;
+	unsigned           qmsk;
+	uint64_t           head;    /* sequence number of the next frame     */
+	unsigned           last;    /* slot claimed last                     */
+	int                waiters;
+	int                stopped;
+	int                running;
+	int                nrdrs;
+	int                quit;    /* AIO thread is asked to terminate      */
+	aio_context_t      aio;     /* zero if synchronous                   */
+	struct iocb        aio_iocb[SIS8300_ACQ_MAX_AIO]; /* reads (AIO)      */
+	Sis8300AcqSlot     aio_slot[SIS8300_ACQ_MAX_AIO]; /* NULL: scratch    */
+	int                aio_pend[SIS8300_ACQ_MAX_AIO]; /* read in flight   */
+	unsigned           aio_leak; /* reads abandoned by sis8300AcqStop() */
+	pthread_t          tid;
+	pthread_mutex_t    mtx;
+	pthread_cond_t     cond;
+	Sis8300AcqStatsRec stats;
+	unsigned           trig;    /* pretrigger (AIO; read at start)       */
+	unsigned           plen;    /* pattern period (1 without a pattern)  */
+	int               *kinds;   /* kind of each acquisition in a period  */
+	int               *modes;   /* corresponding driver read modes       */
+} Sis8300AcqRec;
+
+typedef struct Sis8300AcqReaderRec_ {
+	Sis8300Acq         acq;
+	uint64_t           cursor;  /* sequence number of the next frame wanted */
+	uint64_t           overruns;
+} Sis8300AcqReaderRec;
+
+/* Buffers are page aligned (or as strictly as the channel blocks) */
+static void *
+buf_alloc(size_t sz, size_t align)
+{
+void *p;
+	if ( posix_memalign( &p, align > 4096 ? align : 4096, sz ) )
+		return 0;
+	return p;
+}
+
+/* Frame buffers come from the pool if there is one */
+static void *
+slot_buf_get(Sis8300Acq acq)
+{
+	if ( acq->parms.pool )
+		return sis8300PoolGet( acq->parms.pool );
+	return buf_alloc( acq->sz, acq->parms.align );
+}
+
+static void
+slot_buf_put(Sis8300Acq acq, void *p)
+{
+	if ( ! p )
+		return;
+	if ( acq->parms.pool )
+		sis8300PoolPut( acq->parms.pool, p );
+	else
+		free( p );
+}
+
+Sis8300Acq
+sis8300AcqCreate(Sis8300AcqParms parms)
+{
+Sis8300Acq         acq;
+unsigned           i, j, n, plen;
+int                k;
+pthread_condattr_t ca;
+Sis8300PoolInfoRec pinf;
+
+	if ( parms->nbufs < 2 || parms->nbufs > SIS8300_ACQ_MAX_BUFS ) {
+		fprintf(stderr,"sis8300AcqCreate: invalid number of buffers (2..%u)\n", SIS8300_ACQ_MAX_BUFS);
+		return 0;
+	}
+
+	if ( parms->aio_depth > SIS8300_ACQ_MAX_AIO ) {
+		fprintf(stderr,"sis8300AcqCreate: invalid AIO depth (0..%u)\n", SIS8300_ACQ_MAX_AIO);
+		return 0;
+	}
+
+	plen = 1;
+	if ( parms->pattern ) {
+		for ( i = plen = 0; i < parms->npattern; i++ ) {
+			k = parms->pattern[i].kind;
+			if ( k < SIS8300_KIND_BEAM || k >= SIS8300_ACQ_NKINDS ) {
+				fprintf(stderr,"sis8300AcqCreate: invalid kind in pattern entry %u\n", i);
+				return 0;
+			}
+			if ( parms->pattern[i].count > SIS8300_ACQ_MAX_PATTERN - plen ) {
+				plen = 0;
+				break;
+			}
+			plen += parms->pattern[i].count;
+		}
+		if ( 0 == plen ) {
+			fprintf(stderr,"sis8300AcqCreate: pattern period empty or too long (max. %u)\n", SIS8300_ACQ_MAX_PATTERN);
+			return 0;
+		}
+	}
+
+	if ( ! (acq = calloc( 1, sizeof(*acq) )) ) {
+		fprintf(stderr,"sis8300AcqCreate: no memory\n");
+		return 0;
+	}
+
+	acq->parms = *parms;
+	acq->plen  = plen;
+	/* the engine keeps no reference to the caller's pattern */
+	acq->parms.pattern = 0;
+
+	for ( acq->qmsk = 1; acq->qmsk < parms->nbufs; acq->qmsk <<= 1 )
+		;
+	acq->qmsk--;
+
+	/* validates the selector */
+	if (    sis8300DigiLayoutInit( &acq->lay, parms->fd, parms->sel, parms->nsmpl )
+	     || sis8300DigiLayoutAlign( &acq->lay, parms->align ) )
+		goto bail;
+	acq->sz  = acq->lay.sz;
+	acq->dsz = acq->lay.dsz;
+
+	if (    0 == acq->sz
+	     || ! (acq->slots   = calloc( parms->nbufs, sizeof(*acq->slots) ))
+	     || ! (acq->pub     = malloc( (acq->qmsk + 1) * sizeof(*acq->pub) ))
+	     || ! (acq->scratch = buf_alloc( acq->sz * (parms->aio_depth ? parms->aio_depth : 1), parms->align ))
+	     || ! (acq->kinds   = malloc( plen * sizeof(*acq->kinds) ))
+	     || ! (acq->modes   = malloc( plen * sizeof(*acq->modes) )) ) {
+		fprintf(stderr,"sis8300AcqCreate: no memory (or empty frame)\n");
+		goto bail;
+	}
+
+	if ( parms->pattern ) {
+		for ( i = n = 0; i < parms->npattern; i++ ) {
+			for ( j = 0; j < parms->pattern[i].count; j++ )
+				acq->kinds[n++] = parms->pattern[i].kind;
+		}
+	} else {
+		acq->kinds[0] = parms->kind;
+	}
+	for ( i = 0; i < plen; i++ )
+		acq->modes[i] = sis8300DigiReadMode( acq->kinds[i] );
+
+	for ( i = 0; i <= acq->qmsk; i++ )
+		acq->pub[i] = SEQ_INVALID;
+
+	if ( parms->pool ) {
+		sis8300PoolGetInfo( parms->pool, &pinf );
+		if ( pinf.bufsz < acq->sz || pinf.align < parms->align ) {
+			fprintf(stderr,"sis8300AcqCreate: pool buffers too small or not aligned\n");
+			goto bail;
+		}
+	}
+
+	for ( i = 0; i < parms->nbufs; i++ ) {
+		if ( ! (acq->slots[i].buf = slot_buf_get( acq )) ) {
+			fprintf(stderr,"sis8300AcqCreate: no memory (or pool exhausted)\n");
+			goto bail;
+		}
+		sis8300DigiFrameSetupLayout( &acq->slots[i].frame, acq->kinds[0], &acq->lay, acq->slots[i].buf );
+		acq->slots[i].frame.seq = SEQ_INVALID;
+	}
+
+	/* readers may wait for frames before the engine is started */
+	acq->last    = parms->nbufs - 1;
+	acq->stopped = 0;
+
+	pthread_mutex_init( &acq->mtx, 0 );
+	pthread_condattr_init( &ca );
+	pthread_condattr_setclock( &ca, CLOCK_MONOTONIC );
+	pthread_cond_init( &acq->cond, &ca );
+	pthread_condattr_destroy( &ca );
+
+	return acq;
+
+bail:
+	if ( acq->slots ) {
+		for ( i = 0; i < parms->nbufs; i++ )
+			slot_buf_put( acq, acq->slots[i].buf );
+	}
+	free( acq->slots );
+	free( acq->pub );
+	free( acq->scratch );
+	free( acq->kinds );
+	free( acq->modes );
+	free( acq );
+	return 0;
+}
+
+/* Claim the least recently filled free slot */
+static Sis8300AcqSlot
+acq_claim(Sis8300Acq acq)
+{
+unsigned       i, idx;
+Sis8300AcqSlot slot;
+int            zero;
+
+	for ( i = 1; i <= acq->parms.nbufs; i++ ) {
+		idx  = (acq->last + i) % acq->parms.nbufs;
+		slot = &acq->slots[idx];
+		zero = 0;
+		if ( __atomic_compare_exchange_n( &slot->refs, &zero, -1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) {
+			acq->last       = idx;
+			slot->frame.seq = SEQ_INVALID;
+			return slot;
+		}
+	}
+	return 0;
+}
+
+static void
+acq_unclaim(Sis8300AcqSlot slot)
+{
+	slot->frame.seq = SEQ_INVALID;
+	__atomic_store_n( &slot->refs, 0, __ATOMIC_RELEASE );
+}
+
+static void
+acq_publish(Sis8300Acq acq, Sis8300AcqSlot slot)
+{
+uint64_t seq = acq->head;
+
+	if ( acq->parms.stats )
+		sis8300DspStats( &slot->frame, &slot->stats );
+
+	slot->frame.seq = seq;
+	__atomic_store_n( &slot->refs, 0, __ATOMIC_RELEASE );
+	__atomic_store_n( &acq->pub[seq & acq->qmsk], (seq << 8) | (uint64_t)(slot - acq->slots), __ATOMIC_RELEASE );
+	/* SEQ_CST: pairs with the reader incrementing 'waiters' and re-checking 'head' */
+	__atomic_store_n( &acq->head, seq + 1, __ATOMIC_SEQ_CST );
+	__atomic_store_n( &acq->stats.frames, acq->stats.frames + 1, __ATOMIC_RELAXED );
+
+	if ( __atomic_load_n( &acq->waiters, __ATOMIC_SEQ_CST ) ) {
+		pthread_mutex_lock( &acq->mtx );
+		pthread_cond_broadcast( &acq->cond );
+		pthread_mutex_unlock( &acq->mtx );
+	}
+}
+
+static void
+acq_error(Sis8300Acq acq)
+{
+struct timespec t;
+
+	__atomic_store_n( &acq->stats.errors, acq->stats.errors + 1, __ATOMIC_RELAXED );
+	/* don't spin if the device is broken */
+	t.tv_sec  = 0;
+	t.tv_nsec = 100000000;
+	nanosleep( &t, 0 );
+}
+
+static void
+acq_missed(Sis8300Acq acq, unsigned n)
+{
+int k = acq->kinds[n];
+	if ( k >= 0 && k < SIS8300_ACQ_NKINDS )
+		__atomic_store_n( &acq->stats.missed[k], acq->stats.missed[k] + 1, __ATOMIC_RELAXED );
+}
+
+/* Arm the acquisition at pattern position *nxt_p (the position advances
+ * in any case so that a failure doesn't stall the pattern). On success
+ * *cur_p is set to the position armed; a failure counts as a missed slot.
+ */
+static int
+acq_arm(Sis8300Acq acq, unsigned *nxt_p, unsigned *cur_p)
+{
+unsigned n = *nxt_p;
+
+	*nxt_p = ( n + 1 == acq->plen ) ? 0 : n + 1;
+	if ( sis8300DigiArmMode( acq->parms.fd, acq->modes[n] ) ) {
+		acq_missed( acq, n );
+		return -1;
+	}
+	*cur_p = n;
+	return 0;
+}
+
+static void *
+acq_thread(void *arg)
+{
+Sis8300Acq      acq = arg;
+Sis8300AcqParms p   = &acq->parms;
+Sis8300AcqSlot  slot;
+Sis8300FrameRec scratch;
+unsigned        nxt = 0, cur = 0, rd;
+int             armed = 0;
+int             st, cs;
+
+	/* the thread may only be cancelled while it waits for the DMA */
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cs );
+
+	for (;;) {
+		if ( ! armed && ! (armed = ( 0 == acq_arm( acq, &nxt, &cur ) )) ) {
+			pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, &cs );
+			acq_error( acq );
+			pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cs );
+			continue;
+		}
+
+		slot = acq_claim( acq );
+		rd   = cur;
+
+		pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, &cs );
+		st = sis8300DigiReadoutLayout( p->fd, acq->kinds[rd], &acq->lay,
+		                               slot ? slot->buf : acq->scratch, acq->sz,
+		                               slot ? &slot->frame : &scratch );
+		/* re-arm right away; the samples have been copied */
+		armed = ( 0 == acq_arm( acq, &nxt, &cur ) );
+		pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cs );
+
+		if ( st ) {
+			if ( slot )
+				acq_unclaim( slot );
+			acq_missed( acq, rd );
+		} else if ( slot ) {
+			acq_publish( acq, slot );
+		} else {
+			__atomic_store_n( &acq->stats.dropped, acq->stats.dropped + 1, __ATOMIC_RELAXED );
+		}
+
+		if ( st || ! armed ) {
+			pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, &cs );
+			acq_error( acq );
+			pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cs );
+		}
+	}
+	return 0;
+}
+
+/* io_submit() clears the key of every iocb it accepts */
+#define AIO_KEY_UNSUBMITTED 0xffffffff
+
+/* Reads which must complete within io_submit() before the driver is
+ * deemed synchronous (see acq_thread_aio())
+ */
+#define AIO_SYNC_PROBES   4
+
+typedef struct AcqAioSubmitRec_ {
+	Sis8300Acq acq;
+	unsigned   i;
+} AcqAioSubmitRec;
+
+/* Cancelled while submitting; a read the kernel accepted is left to
+ * sis8300AcqStop() (which also releases the slot otherwise).
+ */
+static void
+acq_aio_submit_cancelled(void *arg)
+{
+AcqAioSubmitRec *s = arg;
+
+	if ( 0 == __atomic_load_n( &s->acq->aio_iocb[s->i].aio_key, __ATOMIC_RELAXED ) )
+		s->acq->aio_pend[s->i] = 1;
+}
+
+/* Submit AIO read #i into a free slot (or its scratch buffer) */
+static int
+acq_aio_submit(Sis8300Acq acq, unsigned i)
+{
+struct iocb    *iocbp = &acq->aio_iocb[i];
+AcqAioSubmitRec sub;
+void           *buf;
+int             st, cs, ct;
+
+	acq->aio_slot[i] = acq_claim( acq );
+	buf = acq->aio_slot[i] ? acq->aio_slot[i]->buf : (char*)acq->scratch + i * acq->sz;
+	saio_prep_pread( iocbp, acq->parms.fd, buf, acq->dsz, 0, i );
+	iocbp->aio_key = AIO_KEY_UNSUBMITTED;
+
+	/* A driver without an asynchronous read_iter() blocks in io_submit()
+	 * until the DMA is done (maybe forever if no trigger arrives); this is
+	 * the only place where sis8300AcqStop() may cancel the AIO thread.
+	 */
+	sub.acq = acq;
+	sub.i   = i;
+	pthread_cleanup_push( acq_aio_submit_cancelled, &sub );
+	pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, &cs );
+	pthread_setcanceltype( PTHREAD_CANCEL_ASYNCHRONOUS, &ct );
+	st = saio_submit( acq->aio, 1, &iocbp );
+	pthread_setcanceltype( ct, &ct );
+	pthread_setcancelstate( cs, &cs );
+	pthread_cleanup_pop( 0 );
+
+	if ( 1 != st ) {
+		if ( acq->aio_slot[i] ) {
+			acq_unclaim( acq->aio_slot[i] );
+			acq->aio_slot[i] = 0;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/* The AIO thread terminates when 'quit' is set and may only be cancelled
+ * while submitting a read -- unless it falls back to acq_thread() (which
+ * may only be cancelled while waiting). sis8300AcqStop() thus always sets
+ * 'quit' and cancels.
+ *
+ * A driver may implement read_iter() synchronously, i.e., io_submit()
+ * returns only once the read is complete. A second read submitted for the
+ * same armed acquisition would then block forever. Therefore, a single
+ * read is kept in flight until one is found still pending after
+ * io_submit() returned; if AIO_SYNC_PROBES reads complete within
+ * io_submit() instead then the engine falls back to acq_thread().
+ */
+static void *
+acq_thread_aio(void *arg)
+{
+Sis8300Acq      acq  = arg;
+Sis8300AcqParms p    = &acq->parms;
+Sis8300AcqSlot *slot = acq->aio_slot;
+int            *pend = acq->aio_pend;
+struct io_event ev[SIS8300_ACQ_MAX_AIO];
+struct timespec tmo;
+unsigned        i, nxt = 0, cur = 0, rd;
+unsigned        depth = 1, nsync = 0;
+int             j, n, st, cs, armed = 0, aio_ok = 0, probe = 1, probing;
+const char     *why;
+
+	pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &cs );
+
+	/* reads abandoned by a previous sis8300AcqStop() keep their slots */
+	for ( i = 0; i < p->aio_depth; i++ )
+		pend[i] = 0;
+
+	while ( ! __atomic_load_n( &acq->quit, __ATOMIC_ACQUIRE ) ) {
+
+		if ( ! armed && ! (armed = ( 0 == acq_arm( acq, &nxt, &cur ) )) ) {
+			acq_error( acq );
+			continue;
+		}
+
+		/* keep 'depth' reads in flight */
+		for ( i = 0; i < depth; i++ ) {
+			if ( ! pend[i] && ! (pend[i] = ( 0 == acq_aio_submit( acq, i ) )) ) {
+				/* drivers without read_iter() fail every AIO read with EINVAL */
+				if ( ! aio_ok && (EINVAL == errno || EOPNOTSUPP == errno) ) {
+					why = "driver does not support AIO reads";
+					goto no_aio;
+				}
+				fprintf(stderr,"sis8300Acq: io_submit failed: %s\n", strerror(errno));
+				acq_error( acq );
+			}
+			aio_ok |= pend[i];
+		}
+
+		/* is the read still in flight now that io_submit() returned? */
+		probing = ( probe && pend[0] );
+
+		/* wake up periodically to check 'quit' */
+		tmo.tv_sec  = 0;
+		tmo.tv_nsec = probing ? 0 : 100000000;
+		if ( (n = saio_getevents( acq->aio, ! probing, p->aio_depth, ev, &tmo )) < 0 ) {
+			if ( EINTR != errno ) {
+				fprintf(stderr,"sis8300Acq: io_getevents failed: %s\n", strerror(errno));
+				acq_error( acq );
+			}
+			continue;
+		}
+
+		if ( probing && 0 == n ) {
+			/* the driver is asynchronous */
+			probe = 0;
+			depth = p->aio_depth;
+			continue;
+		}
+
+		for ( j = 0; j < n; j++ ) {
+			i       = ev[j].data;
+			pend[i] = 0;
+			st      = ( (long long)ev[j].res != (long long)acq->dsz );
+			rd      = cur;
+			/* re-arm right away */
+			armed   = ( 0 == acq_arm( acq, &nxt, &cur ) );
+			if ( st ) {
+				if ( slot[i] )
+					acq_unclaim( slot[i] );
+				acq_missed( acq, rd );
+			} else if ( slot[i] ) {
+				sis8300DigiFrameSetupLayout( &slot[i]->frame, acq->kinds[rd], &acq->lay, slot[i]->buf );
+				slot[i]->frame.trig = acq->trig;
+				clock_gettime( CLOCK_REALTIME, &slot[i]->frame.ts );
+				acq_publish( acq, slot[i] );
+			} else {
+				__atomic_store_n( &acq->stats.dropped, acq->stats.dropped + 1, __ATOMIC_RELAXED );
+			}
+			if ( st || ! armed )
+				acq_error( acq );
+			/* while probing the next read is submitted at the top of the loop */
+			if ( probing )
+				continue;
+			/* submit the read for the next acquisition before harvesting more */
+			if ( ! (pend[i] = ( 0 == acq_aio_submit( acq, i ) )) ) {
+				fprintf(stderr,"sis8300Acq: io_submit failed: %s\n", strerror(errno));
+			}
+		}
+
+		if ( probing && ++nsync >= AIO_SYNC_PROBES ) {
+			why = "driver completes AIO reads synchronously";
+			goto no_aio;
+		}
+	}
+
+	/* reads which cannot be cancelled are left to sis8300AcqStop() */
+	for ( i = 0; i < p->aio_depth; i++ ) {
+		if ( pend[i] && 0 == saio_cancel( acq->aio, &acq->aio_iocb[i], &ev[0] ) ) {
+			pend[i] = 0;
+			if ( slot[i] )
+				acq_unclaim( slot[i] );
+		}
+	}
+	return 0;
+
+no_aio:
+	/* nothing is in flight */
+	fprintf(stderr,"sis8300Acq: %s; using synchronous mode\n", why);
+	saio_destroy( acq->aio );
+	acq->aio = 0;
+	return acq_thread( arg );
+}
+
+/* Harvest (and discard) AIO reads still in flight, waiting up to 'ms'.
+ *
+ * RETURNS: number of reads still in flight.
+ */
+static unsigned
+acq_aio_drain(Sis8300Acq acq, long ms)
+{
+struct io_event ev[SIS8300_ACQ_MAX_AIO];
+struct timespec now, end, tmo;
+unsigned        i, npend = 0;
+int             j, n;
+
+	for ( i = 0; i < acq->parms.aio_depth; i++ )
+		npend += !! acq->aio_pend[i];
+
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	end.tv_sec  += ms / 1000;
+	end.tv_nsec += (ms % 1000) * 1000000L;
+	if ( end.tv_nsec >= 1000000000L ) {
+		end.tv_nsec -= 1000000000L;
+		end.tv_sec++;
+	}
+
+	while ( npend ) {
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		tmo.tv_sec  = end.tv_sec  - now.tv_sec;
+		tmo.tv_nsec = end.tv_nsec - now.tv_nsec;
+		if ( tmo.tv_nsec < 0 ) {
+			tmo.tv_nsec += 1000000000L;
+			tmo.tv_sec--;
+		}
+		if ( tmo.tv_sec < 0 )
+			break;
+		if ( (n = saio_getevents( acq->aio, 1, acq->parms.aio_depth, ev, &tmo )) < 0 ) {
+			if ( EINTR == errno )
+				continue;
+			break;
+		}
+		if ( 0 == n )
+			break;
+		for ( j = 0; j < n; j++ ) {
+			i = ev[j].data;
+			if ( i >= acq->parms.aio_depth || ! acq->aio_pend[i] )
+				continue;
+			acq->aio_pend[i] = 0;
+			if ( acq->aio_slot[i] )
+				acq_unclaim( acq->aio_slot[i] );
+			npend--;
+		}
+	}
+	return npend;
+}
+
+int
+sis8300AcqStart(Sis8300Acq acq)
+{
+int st;
+void *(*thread_fn)(void*) = acq_thread;
+
+	if ( acq->running )
+		return 0;
+
+	__atomic_store_n( &acq->stopped, 0, __ATOMIC_SEQ_CST );
+	__atomic_store_n( &acq->quit,    0, __ATOMIC_SEQ_CST );
+
+	acq->trig = sis8300DigiGetPretrigger( acq->parms.fd );
+
+	if ( acq->parms.aio_depth && acq->lay.dual ) {
+		/* samples must be deinterleaved as they are read */
+		fprintf(stderr,"sis8300AcqStart: AIO not supported with dual-channel firmware; using synchronous mode\n");
+	} else if ( acq->parms.aio_depth ) {
+		if ( saio_setup( acq->parms.aio_depth, &acq->aio ) ) {
+			fprintf(stderr,"sis8300AcqStart: AIO not available (%s); using synchronous mode\n", strerror(errno));
+			acq->aio = 0;
+		} else {
+			thread_fn = acq_thread_aio;
+		}
+	}
+
+	if ( (st = pthread_create( &acq->tid, 0, thread_fn, acq )) ) {
+		fprintf(stderr,"sis8300AcqStart: unable to create thread: %s\n", strerror(st));
+		if ( acq->aio ) {
+			saio_destroy( acq->aio );
+			acq->aio = 0;
+		}
+		return -1;
+	}
+	acq->running = 1;
+	return 0;
+}
+
+int
+sis8300AcqStop(Sis8300Acq acq)
+{
+unsigned i, npend;
+
+	if ( ! acq->running )
+		return 0;
+
+	/* see acq_thread_aio() */
+	__atomic_store_n( &acq->quit, 1, __ATOMIC_RELEASE );
+	pthread_cancel( acq->tid );
+	pthread_join( acq->tid, 0 );
+	acq->running = 0;
+
+	/* io_destroy() waits for reads which could not be cancelled and
+	 * these only complete with a DMA. Give them a chance while still
+	 * armed (and in case the driver fails them when disarmed) but don't
+	 * wait forever.
+	 */
+	if ( acq->aio )
+		acq_aio_drain( acq, STOP_AIO_TMO_MS );
+
+	sis8300DigiArm( acq->parms.fd, SIS8300_KIND_OFF );
+
+	if ( acq->aio ) {
+		if ( (npend = acq_aio_drain( acq, STOP_DISARM_TMO_MS )) ) {
+			/* the kernel may still write into their buffers */
+			fprintf(stderr,"sis8300AcqStop: WARNING -- %u AIO read(s) did not complete; abandoning them (buffers leaked)\n", npend);
+			acq->aio_leak += npend;
+			for ( i = 0; i < acq->parms.aio_depth; i++ ) {
+				if ( acq->aio_pend[i] && acq->aio_slot[i] )
+					acq->aio_slot[i]->leaked = 1;
+			}
+		} else {
+			saio_destroy( acq->aio );
+		}
+		acq->aio = 0;
+	}
+
+	/* the thread may have been cancelled while filling a slot */
+	for ( i = 0; i < acq->parms.nbufs; i++ ) {
+		if ( -1 == __atomic_load_n( &acq->slots[i].refs, __ATOMIC_ACQUIRE ) && ! acq->slots[i].leaked )
+			acq_unclaim( &acq->slots[i] );
+	}
+
+	pthread_mutex_lock( &acq->mtx );
+	__atomic_store_n( &acq->stopped, 1, __ATOMIC_SEQ_CST );
+	pthread_cond_broadcast( &acq->cond );
+	pthread_mutex_unlock( &acq->mtx );
+	return 0;
+}
+
+void
+sis8300AcqDestroy(Sis8300Acq acq)
+{
+unsigned i;
+
+	if ( ! acq )
+		return;
+
+	sis8300AcqStop( acq );
+
+	if ( acq->nrdrs ) {
+		fprintf(stderr,"sis8300AcqDestroy: WARNING -- %i readers still exist; leaking engine\n", acq->nrdrs);
+		return;
+	}
+
+	pthread_cond_destroy( &acq->cond );
+	pthread_mutex_destroy( &acq->mtx );
+	for ( i = 0; i < acq->parms.nbufs; i++ ) {
+		if ( ! acq->slots[i].leaked )
+			slot_buf_put( acq, acq->slots[i].buf );
+	}
+	free( acq->slots );
+	free( acq->pub );
+	/* abandoned reads may target the scratch buffer */
+	if ( ! acq->aio_leak )
+		free( acq->scratch );
+	free( acq->kinds );
+	free( acq->modes );
+	free( acq );
+}
+
+void
+sis8300AcqGetStats(Sis8300Acq acq, Sis8300AcqStats stats)
+{
+int k;
+	stats->frames  = __atomic_load_n( &acq->stats.frames,  __ATOMIC_RELAXED );
+	stats->dropped = __atomic_load_n( &acq->stats.dropped, __ATOMIC_RELAXED );
+	stats->errors  = __atomic_load_n( &acq->stats.errors,  __ATOMIC_RELAXED );
+	for ( k = 0; k < SIS8300_ACQ_NKINDS; k++ )
+		stats->missed[k] = __atomic_load_n( &acq->stats.missed[k], __ATOMIC_RELAXED );
+}
+
+Sis8300AcqReader
+sis8300AcqReaderCreate(Sis8300Acq acq)
+{
+Sis8300AcqReader rdr;
+
+	if ( ! (rdr = calloc( 1, sizeof(*rdr) )) ) {
+		fprintf(stderr,"sis8300AcqReaderCreate: no memory\n");
+		return 0;
+	}
+	rdr->acq    = acq;
+	rdr->cursor = __atomic_load_n( &acq->head, __ATOMIC_ACQUIRE );
+	__atomic_fetch_add( &acq->nrdrs, 1, __ATOMIC_RELAXED );
+	return rdr;
+}
+
+void
+sis8300AcqReaderDestroy(Sis8300AcqReader rdr)
+{
+	if ( ! rdr )
+		return;
+	__atomic_fetch_sub( &rdr->acq->nrdrs, 1, __ATOMIC_RELAXED );
+	free( rdr );
+}
+
+/* Try to take a reference to frame 'seq'.
+ * RETURNS: slot or NULL if the frame is lost.
+ */
+static Sis8300AcqSlot
+rdr_ref(Sis8300Acq acq, uint64_t seq)
+{
+uint64_t       e;
+Sis8300AcqSlot slot;
+int            r;
+
+	e = __atomic_load_n( &acq->pub[seq & acq->qmsk], __ATOMIC_ACQUIRE );
+	if ( (e >> 8) != seq )
+		return 0;
+
+	slot = &acq->slots[ e & 0xff ];
+	r    = __atomic_load_n( &slot->refs, __ATOMIC_RELAXED );
+	do {
+		if ( r < 0 )
+			return 0; /* being refilled */
+	} while ( ! __atomic_compare_exchange_n( &slot->refs, &r, r + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) );
+
+	if ( slot->frame.seq != seq ) {
+		/* recycled before we got hold of it */
+		__atomic_fetch_sub( &slot->refs, 1, __ATOMIC_RELEASE );
+		return 0;
+	}
+	return slot;
+}
+
+int
+sis8300AcqReaderGet(Sis8300AcqReader rdr, int timeout_ms, Sis8300Frame *frame_p)
+{
+Sis8300Acq      acq = rdr->acq;
+Sis8300AcqSlot  slot;
+uint64_t        head;
+struct timespec abst;
+int             st = 0;
+
+	if ( timeout_ms >= 0 ) {
+		clock_gettime( CLOCK_MONOTONIC, &abst );
+		abst.tv_sec  += timeout_ms / 1000;
+		abst.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if ( abst.tv_nsec >= 1000000000L ) {
+			abst.tv_nsec -= 1000000000L;
+			abst.tv_sec++;
+		}
+	}
+
+	for (;;) {
+		head = __atomic_load_n( &acq->head, __ATOMIC_ACQUIRE );
+
+		while ( rdr->cursor < head ) {
+			if ( head - rdr->cursor > acq->qmsk + 1 ) {
+				/* no longer in the ring */
+				rdr->overruns += head - (acq->qmsk + 1) - rdr->cursor;
+				rdr->cursor    = head - (acq->qmsk + 1);
+			}
+			slot = rdr_ref( acq, rdr->cursor );
+			rdr->cursor++;
+			if ( slot ) {
+				*frame_p = &slot->frame;
+				return 0;
+			}
+			rdr->overruns++;
+		}
+
+		if ( ETIMEDOUT == st ) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		pthread_mutex_lock( &acq->mtx );
+		__atomic_fetch_add( &acq->waiters, 1, __ATOMIC_SEQ_CST );
+		while (    rdr->cursor == __atomic_load_n( &acq->head, __ATOMIC_SEQ_CST )
+		        && ! __atomic_load_n( &acq->stopped, __ATOMIC_SEQ_CST )
+		        && ETIMEDOUT != st ) {
+			if ( timeout_ms >= 0 )
+				st = pthread_cond_timedwait( &acq->cond, &acq->mtx, &abst );
+			else
+				pthread_cond_wait( &acq->cond, &acq->mtx );
+		}
+		__atomic_fetch_sub( &acq->waiters, 1, __ATOMIC_SEQ_CST );
+		pthread_mutex_unlock( &acq->mtx );
+
+		if (    rdr->cursor == __atomic_load_n( &acq->head, __ATOMIC_ACQUIRE )
+		     && __atomic_load_n( &acq->stopped, __ATOMIC_ACQUIRE ) ) {
+			errno = ENODATA;
+			return -1;
+		}
+	}
+}
+
+const Sis8300DspStatsRec *
+sis8300AcqReaderStats(Sis8300AcqReader rdr, Sis8300Frame frame)
+{
+	if ( ! rdr->acq->parms.stats )
+		return 0;
+	return &((Sis8300AcqSlot)frame)->stats;
+}
+
+void
+sis8300AcqReaderRelease(Sis8300AcqReader rdr, Sis8300Frame frame)
+{
+Sis8300Acq     acq  = rdr->acq;
+Sis8300AcqSlot slot = (Sis8300AcqSlot)frame;
+uintptr_t      off  = (uintptr_t)slot - (uintptr_t)acq->slots;
+
+	/* dropping a reference on a slot of another engine would corrupt both */
+	if ( off >= acq->parms.nbufs * sizeof(*slot) || off % sizeof(*slot) ) {
+		fprintf(stderr,"sis8300AcqReaderRelease: frame was not obtained from this reader's engine\n");
+		return;
+	}
+	__atomic_fetch_sub( &slot->refs, 1, __ATOMIC_RELEASE );
+}
+
+uint64_t
+sis8300AcqReaderOverruns(Sis8300AcqReader rdr)
+{
+	return rdr->overruns;
+}
@@ -0,0 +1,162 @@
+#ifndef SIS8300ACQ_H
+#define SIS8300ACQ_H
+
+#include <sis8300Digi.h>
+#include <sis8300Dsp.h>
+#include <sis8300Pool.h>
+
+/* Multi-buffered acquisition engine.
+ *
+ * The engine owns the file descriptor (no other thread must arm or read
+ * while the engine is running). A dedicated reader thread keeps 'nbufs'
+ * frame buffers in rotation: as soon as a DMA has completed and the
+ * samples have been read the next acquisition is armed and the frame is
+ * published to consumers.
+ *
+ * Consumers ('readers') obtain frames in sequence. A reader which falls
+ * behind does not block the engine; it loses the frames which were
+ * recycled in the meantime and these are counted as 'overruns'. If all
+ * buffers are held by readers then the engine still reads (into a scratch
+ * buffer) and counts the frame as 'dropped'.
+ *
+ * Publishing and obtaining frames is lock-free; a mutex/condition variable
+ * is only used to put readers to sleep when no frame is available.
+ *
+ * Asynchronous mode ('aio_depth' > 0): reads for upcoming acquisitions
+ * are submitted ahead of time (linux AIO) and completions are harvested
+ * in batches. As for read() the driver completes queued reads in order,
+ * one per (armed) acquisition; the engine re-arms after each completion.
+ * Frames are the same as in synchronous mode. If the kernel or the driver
+ * does not support AIO (the first read is rejected), the driver completes
+ * reads synchronously (within io_submit(); only one read is submitted until
+ * this is ruled out) or the firmware uses dual-channel sampling then the
+ * engine falls back to synchronous mode.
+ * Reads in flight when the engine is stopped are given a bounded time to
+ * complete; any which don't are abandoned (and their buffers leaked).
+ * NOTE: reads in flight occupy buffers; 'nbufs' should exceed 'aio_depth'
+ *       by the number of frames readers hold at any time.
+ *
+ * Statistics ('stats' nonzero): per-channel statistics of each frame are
+ * computed by the engine (while the samples are still in the cache) before
+ * the frame is published; consumers which only need summaries need not
+ * look at the samples at all (sis8300AcqReaderStats()).
+ *
+ * Pattern ('pattern' non-NULL): the engine arms for a repeating sequence
+ * of kinds (e.g., 98 x BEAM, 1 x CRED, 1 x CGRN) instead of a single
+ * 'kind'. The sequence is expanded and the driver read modes computed at
+ * creation so that re-arming after a DMA costs no more than with a single
+ * kind; frames carry the kind they were acquired with. A slot whose arm
+ * or read fails is skipped (the sequence does not stall) and counted in
+ * 'missed'. The sequence starts over whenever the engine is started.
+ */
+
+/* 'count' consecutive acquisitions of 'kind' */
+typedef struct Sis8300AcqPatternRec_ {
+	int                kind;    /* SIS8300_KIND_BEAM, _CRED or _CGRN           */
+	unsigned           count;
+} Sis8300AcqPatternRec, *Sis8300AcqPattern;
+
+typedef struct Sis8300AcqParmsRec_ {
+	int                fd;
+	int                kind;    /* SIS8300_KIND_xxx to arm for (no 'pattern')  */
+	Sis8300ChannelSel  sel;     /* as given to sis8300DigiSetCount()           */
+	unsigned           nsmpl;   /* as given to sis8300DigiSetCount()           */
+	unsigned           nbufs;   /* number of frame buffers (2..SIS8300_ACQ_MAX_BUFS) */
+	unsigned           aio_depth; /* 0: synchronous read(); else # of reads kept
+	                             * in flight with linux AIO (..SIS8300_ACQ_MAX_AIO) */
+	int                stats;   /* compute per-channel statistics              */
+	const Sis8300AcqPatternRec *pattern; /* NULL: always arm for 'kind'        */
+	unsigned           npattern; /* number of pattern entries                  */
+	size_t             align;   /* channel block alignment (bytes; 0: packed;
+	                             * see sis8300DigiLayoutAlign()). Must match
+	                             * the layout given to sis8300DigiSetCountLayout() */
+	Sis8300Pool        pool;    /* take the frame buffers from this pool (NULL:
+	                             * allocate); returned by sis8300AcqDestroy()  */
+} Sis8300AcqParmsRec, *Sis8300AcqParms;
+
+#define SIS8300_ACQ_MAX_BUFS     255
+#define SIS8300_ACQ_MAX_AIO       16
+#define SIS8300_ACQ_MAX_PATTERN 65536 /* acquisitions per pattern period   */
+
+/* Counters indexed by kind (SIS8300_KIND_BEAM, _CRED, _CGRN) */
+#define SIS8300_ACQ_NKINDS 3
+
+typedef struct Sis8300AcqStatsRec_ {
+	uint64_t           frames;  /* frames published                            */
+	uint64_t           dropped; /* frames read while all buffers were busy     */
+	uint64_t           errors;  /* failed arm/read operations                  */
+	uint64_t           missed[SIS8300_ACQ_NKINDS]; /* acquisitions (pattern slots)
+	                             * lost to a failed arm or read, per kind       */
+} Sis8300AcqStatsRec, *Sis8300AcqStats;
+
+typedef struct Sis8300AcqRec_       *Sis8300Acq;
+typedef struct Sis8300AcqReaderRec_ *Sis8300AcqReader;
+
+/* Create an engine (the parameters are copied). The hardware must
+ * have been set up (sis8300DigiSetup(), sis8300DigiSetCount()).
+ *
+ * RETURNS: engine or NULL on error.
+ */
+Sis8300Acq
+sis8300AcqCreate(Sis8300AcqParms parms);
+
+/* Start/stop the reader thread. Stopping disarms the DMA and wakes
+ * all sleeping readers (which then fail with ENODATA once they have
+ * consumed all frames; before the engine is started for the first
+ * time readers just wait).
+ *
+ * RETURNS: 0 on success, -1 on error.
+ */
+int
+sis8300AcqStart(Sis8300Acq acq);
+
+int
+sis8300AcqStop(Sis8300Acq acq);
+
+/* Destroy an (stopped) engine; all readers must have been destroyed. */
+void
+sis8300AcqDestroy(Sis8300Acq acq);
+
+void
+sis8300AcqGetStats(Sis8300Acq acq, Sis8300AcqStats stats);
+
+/* Create a reader; the first frame it obtains is the next one published
+ * (a reader is not thread-safe -- use one per consumer thread).
+ *
+ * RETURNS: reader or NULL on error.
+ */
+Sis8300AcqReader
+sis8300AcqReaderCreate(Sis8300Acq acq);
+
+/* Destroy a reader; all its frames must have been released. */
+void
+sis8300AcqReaderDestroy(Sis8300AcqReader rdr);
+
+/* Obtain the next frame (waiting up to 'timeout_ms'; forever if negative).
+ * The frame is read-only and must be released.
+ *
+ * RETURNS: 0 on success, -1 on timeout (errno = ETIMEDOUT) or if the
+ *          engine is stopped (errno = ENODATA).
+ */
+int
+sis8300AcqReaderGet(Sis8300AcqReader rdr, int timeout_ms, Sis8300Frame *frame_p);
+
+/* Release a frame obtained from sis8300AcqReaderGet() (of a reader of the
+ * same engine; other frames are rejected with a message).
+ */
+void
+sis8300AcqReaderRelease(Sis8300AcqReader rdr, Sis8300Frame frame);
+
+/* Statistics of a frame obtained by sis8300AcqReaderGet(); valid until
+ * the frame is released.
+ *
+ * RETURNS: statistics or NULL if the engine does not compute them.
+ */
+const Sis8300DspStatsRec *
+sis8300AcqReaderStats(Sis8300AcqReader rdr, Sis8300Frame frame);
+
+/* Number of frames this reader has missed */
+uint64_t
+sis8300AcqReaderOverruns(Sis8300AcqReader rdr);
+
+#endif
@@ -0,0 +1,257 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sis8300Bpm.h>
+
+/* Beam position engine (see sis8300Bpm.h)
+ *
+ * Integration uses the statistics kernel on the windows (which also
+ * yields min/max for saturation detection); the position arithmetic is
+ * done in batches with the difference-over-sum and polynomial kernels
+ * of sis8300Dsp.c.
+ */
+
+typedef struct Sis8300BpmRec_ {
+	Sis8300BpmParmsRec   parms;   /* px/py point to our copies */
+	float                px[SIS8300_DSP_POLY2_NCOEFFS(SIS8300_DSP_POLY2_MAX_ORDER)];
+	float                py[SIS8300_DSP_POLY2_NCOEFFS(SIS8300_DSP_POLY2_MAX_ORDER)];
+	unsigned             max;
+	int16_t              sat_lo;  /* saturation thresholds */
+	int16_t              sat_hi;
+	float               *btn[SIS8300_BPM_NBTNS];
+	float               *x, *y, *sum;
+	float               *p, *q, *u, *v; /* scratch */
+	uint8_t             *flags;
+	Sis8300BpmResultsRec res;
+} Sis8300BpmRec;
+
+Sis8300Bpm
+sis8300BpmCreate(Sis8300BpmParms parms, unsigned max_frames)
+{
+Sis8300Bpm bpm;
+unsigned   b, nc;
+
+	for ( b = 0; b < SIS8300_BPM_NBTNS; b++ ) {
+		if ( parms->chnl[b] < 1 || parms->chnl[b] > SIS8300_MAX_CHANNELS ) {
+			fprintf(stderr,"sis8300BpmCreate: invalid channel # for button %c\n", 'a' + b);
+			return 0;
+		}
+	}
+	if ( 0 == parms->win_len || 0 == max_frames ) {
+		fprintf(stderr,"sis8300BpmCreate: empty integration window or batch\n");
+		return 0;
+	}
+	if ( SIS8300_BPM_GEOM_DIAG != parms->geom && SIS8300_BPM_GEOM_PLANAR != parms->geom ) {
+		fprintf(stderr,"sis8300BpmCreate: invalid geometry\n");
+		return 0;
+	}
+	if ( parms->order > SIS8300_DSP_POLY2_MAX_ORDER || (parms->order && (! parms->px || ! parms->py)) ) {
+		fprintf(stderr,"sis8300BpmCreate: invalid polynomial correction (max. order %u)\n", SIS8300_DSP_POLY2_MAX_ORDER);
+		return 0;
+	}
+	if ( SIS8300_ADC_FMT_16 != parms->adc_fmt && SIS8300_ADC_FMT_14_RJ != parms->adc_fmt ) {
+		fprintf(stderr,"sis8300BpmCreate: invalid ADC format\n");
+		return 0;
+	}
+
+	if ( ! (bpm = calloc( 1, sizeof(*bpm) )) ) {
+		fprintf(stderr,"sis8300BpmCreate: no memory\n");
+		return 0;
+	}
+
+	bpm->parms  = *parms;
+	bpm->max    = max_frames;
+	/* full scale of a 14-bit ADC: 0x7ffc/-0x8000 left-adjusted,
+	 * 0x1fff/-0x2000 right-adjusted
+	 */
+	bpm->sat_hi = ((1 << 13) - 1) << (SIS8300_ADC_FMT_14_RJ - parms->adc_fmt);
+	bpm->sat_lo = -(1 << 13) * (1 << (SIS8300_ADC_FMT_14_RJ - parms->adc_fmt));
+	if ( parms->order ) {
+		nc = SIS8300_DSP_POLY2_NCOEFFS( parms->order );
+		memcpy( bpm->px, parms->px, nc * sizeof(bpm->px[0]) );
+		memcpy( bpm->py, parms->py, nc * sizeof(bpm->py[0]) );
+	}
+	bpm->parms.px = bpm->px;
+	bpm->parms.py = bpm->py;
+
+	for ( b = 0; b < SIS8300_BPM_NBTNS; b++ ) {
+		if ( ! (bpm->btn[b] = malloc( max_frames * sizeof(float) )) )
+			goto bail;
+	}
+	if (    ! (bpm->x     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->y     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->sum   = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->p     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->q     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->u     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->v     = malloc( max_frames * sizeof(float) ))
+	     || ! (bpm->flags = malloc( max_frames * sizeof(uint8_t) )) )
+		goto bail;
+
+	return bpm;
+
+bail:
+	fprintf(stderr,"sis8300BpmCreate: no memory\n");
+	sis8300BpmDestroy( bpm );
+	return 0;
+}
+
+void
+sis8300BpmDestroy(Sis8300Bpm bpm)
+{
+unsigned b;
+	if ( ! bpm )
+		return;
+	for ( b = 0; b < SIS8300_BPM_NBTNS; b++ )
+		free( bpm->btn[b] );
+	free( bpm->x );
+	free( bpm->y );
+	free( bpm->sum );
+	free( bpm->p );
+	free( bpm->q );
+	free( bpm->u );
+	free( bpm->v );
+	free( bpm->flags );
+	free( bpm );
+}
+
+void
+sis8300BpmSetGains(Sis8300Bpm bpm, const float gain[SIS8300_BPM_NBTNS])
+{
+unsigned b;
+	for ( b = 0; b < SIS8300_BPM_NBTNS; b++ )
+		bpm->parms.gain[b] = gain[b];
+}
+
+/* Positions of 'n' frames from button signals; 'flags' must be initialized */
+static Sis8300BpmResults
+bpm_pos(Sis8300Bpm bpm, const float *a, const float *b, const float *c, const float *d, unsigned n)
+{
+Sis8300BpmParms p = &bpm->parms;
+float           kx, ky;
+float          *u, *v;
+unsigned        i;
+
+	/* with polynomial correction u, v are inputs to the polynomials */
+	if ( p->order ) {
+		u  = bpm->u;
+		v  = bpm->v;
+		kx = ky = 1.0f;
+	} else {
+		u  = bpm->x;
+		v  = bpm->y;
+		kx = p->kx;
+		ky = p->ky;
+	}
+
+	for ( i = 0; i < n; i++ )
+		bpm->sum[i] = a[i] + b[i] + c[i] + d[i];
+
+	if ( SIS8300_BPM_GEOM_DIAG == p->geom ) {
+		for ( i = 0; i < n; i++ ) {
+			bpm->p[i] = a[i] + d[i];
+			bpm->q[i] = b[i] + c[i];
+		}
+		sis8300DspDiffOverSum( u, bpm->p, bpm->q, n, kx );
+		for ( i = 0; i < n; i++ ) {
+			bpm->p[i] = a[i] + b[i];
+			bpm->q[i] = c[i] + d[i];
+		}
+		sis8300DspDiffOverSum( v, bpm->p, bpm->q, n, ky );
+	} else {
+		sis8300DspDiffOverSum( u, a, c, n, kx );
+		sis8300DspDiffOverSum( v, b, d, n, ky );
+	}
+
+	if ( p->order ) {
+		sis8300DspPoly2( bpm->x, u, v, n, p->px, p->order );
+		sis8300DspPoly2( bpm->y, u, v, n, p->py, p->order );
+	} else if ( 0.0f != p->x_off || 0.0f != p->y_off ) {
+		for ( i = 0; i < n; i++ ) {
+			bpm->x[i] += p->x_off;
+			bpm->y[i] += p->y_off;
+		}
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( ! (fabsf( bpm->sum[i] ) >= p->min_sum) ) {
+			bpm->x[i]      = 0.0f;
+			bpm->y[i]      = 0.0f;
+			bpm->flags[i] |= SIS8300_BPM_LOW_SUM;
+		}
+	}
+
+	bpm->res.n     = n;
+	bpm->res.x     = bpm->x;
+	bpm->res.y     = bpm->y;
+	bpm->res.sum   = bpm->sum;
+	bpm->res.flags = bpm->flags;
+	return &bpm->res;
+}
+
+Sis8300BpmResults
+sis8300BpmProcess(Sis8300Bpm bpm, Sis8300Frame *frames, unsigned n)
+{
+Sis8300BpmParms      p = &bpm->parms;
+Sis8300DspChStatsRec st;
+const int16_t       *x;
+double               v;
+unsigned             f, b;
+
+	if ( n > bpm->max ) {
+		fprintf(stderr,"sis8300BpmProcess: too many frames (max. %u)\n", bpm->max);
+		errno = EINVAL;
+		return 0;
+	}
+
+	for ( f = 0; f < n; f++ ) {
+		if (    p->win_start + p->win_len > frames[f]->nsmpl
+		     || p->bl_start  + p->bl_len  > frames[f]->nsmpl ) {
+			fprintf(stderr,"sis8300BpmProcess: window exceeds frame\n");
+			errno = EINVAL;
+			return 0;
+		}
+		bpm->flags[f] = 0;
+		for ( b = 0; b < SIS8300_BPM_NBTNS; b++ ) {
+			if ( ! (x = frames[f]->chnl[ p->chnl[b] - 1 ]) ) {
+				fprintf(stderr,"sis8300BpmProcess: channel # %i not in frame\n", p->chnl[b]);
+				errno = EINVAL;
+				return 0;
+			}
+			sis8300DspChStats( x + p->win_start, p->win_len, &st );
+			if ( st.min <= bpm->sat_lo || st.max >= bpm->sat_hi )
+				bpm->flags[f] |= SIS8300_BPM_SATURATED;
+			v = (double)st.sum;
+			if ( p->bl_len ) {
+				sis8300DspChStats( x + p->bl_start, p->bl_len, &st );
+				v -= (double)st.sum * (double)p->win_len / (double)p->bl_len;
+			}
+			bpm->btn[b][f] = p->gain[b] * (float)v;
+		}
+	}
+
+	for ( b = 0; b < SIS8300_BPM_NBTNS; b++ )
+		bpm->res.btn[b] = bpm->btn[b];
+
+	return bpm_pos( bpm, bpm->btn[0], bpm->btn[1], bpm->btn[2], bpm->btn[3], n );
+}
+
+Sis8300BpmResults
+sis8300BpmPositions(Sis8300Bpm bpm, const float *a, const float *b, const float *c, const float *d, unsigned n)
+{
+	if ( n > bpm->max ) {
+		fprintf(stderr,"sis8300BpmPositions: too many frames (max. %u)\n", bpm->max);
+		errno = EINVAL;
+		return 0;
+	}
+	memset( bpm->flags, 0, n * sizeof(bpm->flags[0]) );
+	bpm->res.btn[0] = a;
+	bpm->res.btn[1] = b;
+	bpm->res.btn[2] = c;
+	bpm->res.btn[3] = d;
+	return bpm_pos( bpm, a, b, c, d, n );
+}
@@ -0,0 +1,114 @@
+#ifndef SIS8300BPM_H
+#define SIS8300BPM_H
+
+#include <sis8300Digi.h>
+#include <sis8300Dsp.h>
+
+/* Four-button beam position monitor.
+ *
+ * For each frame the signals of the four buttons a, b, c, d are integrated
+ * over a window (optionally after subtracting a baseline estimated from a
+ * second window) and multiplied by per-button gains. Positions follow by
+ * difference over sum:
+ *
+ *   SIS8300_BPM_GEOM_DIAG   (buttons at 45 deg.: a upper right, b upper
+ *                            left, c lower left, d lower right)
+ *       u = ((a + d) - (b + c)) / (a + b + c + d)
+ *       v = ((a + b) - (c + d)) / (a + b + c + d)
+ *
+ *   SIS8300_BPM_GEOM_PLANAR (a right, b top, c left, d bottom)
+ *       u = (a - c) / (a + c)
+ *       v = (b - d) / (b + d)
+ *
+ *   x   = kx * u + x_off,  y = ky * v + y_off
+ *
+ * or, if a polynomial correction is configured ('order' > 0),
+ *
+ *   x = px(u, v),  y = py(u, v)           (see sis8300DspPoly2())
+ *
+ *   sum = a + b + c + d
+ *
+ * Frames are processed in batches; all stages work on arrays across the
+ * frames of a batch (vectorized).
+ */
+
+#define SIS8300_BPM_GEOM_DIAG   0
+#define SIS8300_BPM_GEOM_PLANAR 1
+
+#define SIS8300_BPM_NBTNS 4
+
+typedef struct Sis8300BpmParmsRec_ {
+	int                chnl[SIS8300_BPM_NBTNS]; /* channel # of buttons a, b, c, d */
+	unsigned           win_start; /* integration window (first sample, length) */
+	unsigned           win_len;
+	unsigned           bl_start;  /* baseline window; 'bl_len' zero: no        */
+	unsigned           bl_len;    /* baseline subtraction                      */
+	float              gain[SIS8300_BPM_NBTNS];
+	int                geom;      /* SIS8300_BPM_GEOM_xxx                      */
+	float              kx, ky;
+	float              x_off, y_off;
+	unsigned           order;     /* polynomial correction (0: none)           */
+	const float       *px, *py;   /* SIS8300_DSP_POLY2_NCOEFFS( order ) each   */
+	float              min_sum;   /* positions of frames with |sum| below are
+	                               * flagged (and set to 0)                    */
+	int                adc_fmt;   /* SIS8300_ADC_FMT_xxx (see
+	                               * sis8300DigiGetAdcFormat()); sets the
+	                               * saturation thresholds                     */
+} Sis8300BpmParmsRec, *Sis8300BpmParms;
+
+/* Result flags */
+#define SIS8300_BPM_SATURATED (1<<0) /* ADC saturated in the window of a button;
+                                      * i.e., a sample at the full-scale code of
+                                      * a 14-bit ADC in the format 'adc_fmt'
+                                      * (or beyond: 16-bit ADCs are flagged
+                                      * within 3 counts of full scale)       */
+#define SIS8300_BPM_LOW_SUM   (1<<1) /* |sum| < min_sum; no position           */
+
+/* Results of a batch (structure of arrays; 'n' frames) */
+typedef struct Sis8300BpmResultsRec_ {
+	unsigned           n;
+	const float       *btn[SIS8300_BPM_NBTNS]; /* calibrated button signals  */
+	const float       *x;
+	const float       *y;
+	const float       *sum;
+	const uint8_t     *flags;
+} Sis8300BpmResultsRec, *Sis8300BpmResults;
+
+typedef struct Sis8300BpmRec_ *Sis8300Bpm;
+
+/* Create an engine for batches of up to 'max_frames' frames (the
+ * parameters and polynomial coefficients are copied).
+ *
+ * RETURNS: engine or NULL on error.
+ */
+Sis8300Bpm
+sis8300BpmCreate(Sis8300BpmParms parms, unsigned max_frames);
+
+void
+sis8300BpmDestroy(Sis8300Bpm bpm);
+
+/* Change the per-button gains (e.g., to apply a new calibration; see
+ * sis8300CalToGains()). Takes effect with the next batch.
+ */
+void
+sis8300BpmSetGains(Sis8300Bpm bpm, const float gain[SIS8300_BPM_NBTNS]);
+
+/* Process 'n' frames (n <= max_frames); the windows must be inside the
+ * frames and the button channels present.
+ *
+ * The results are valid until the next call; an engine is not thread-safe.
+ *
+ * RETURNS: results or NULL on error.
+ */
+Sis8300BpmResults
+sis8300BpmProcess(Sis8300Bpm bpm, Sis8300Frame *frames, unsigned n);
+
+/* Compute positions from button signals integrated elsewhere (e.g., DDC
+ * amplitudes); gains are NOT applied, windows are not used.
+ *
+ * RETURNS: results or NULL on error.
+ */
+Sis8300BpmResults
+sis8300BpmPositions(Sis8300Bpm bpm, const float *a, const float *b, const float *c, const float *d, unsigned n);
+
+#endif
@@ -0,0 +1,326 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sis8300Cal.h>
+
+/* Calibration from red/green calibration frames (see sis8300Cal.h)
+ *
+ * The tone amplitude is measured by correlation with a table of the
+ * tone (mixer) and a boxcar filter producing a single output -- the
+ * same kernels the DDC uses.
+ *
+ * Published coefficients are protected by a sequence lock; they are
+ * copied word by word with (relaxed) atomic accesses so that readers
+ * racing with the writer are well-defined (and retry).
+ */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define KIND_RED 0
+#define KIND_GRN 1
+#define NKINDS   2
+
+#define COEFF_WORDS (sizeof(Sis8300CalCoeffsRec)/sizeof(uint32_t))
+
+typedef struct Sis8300CalRec_ {
+	Sis8300CalParmsRec  parms;
+	float              *nco_c;
+	float              *nco_s;
+	float              *mix_i;
+	float              *mix_q;
+	float              *h;
+	/* running averages of the complex amplitudes */
+	double              avg_i[NKINDS][SIS8300_MAX_CHANNELS];
+	double              avg_q[NKINDS][SIS8300_MAX_CHANNELS];
+	uint32_t            cnt  [NKINDS][SIS8300_MAX_CHANNELS];
+	uint32_t            nfrm [NKINDS];
+	Sis8300CalCoeffsRec work;     /* writer's copy                          */
+	uint32_t            seq;      /* odd while an update is in progress     */
+	union {
+		Sis8300CalCoeffsRec c;
+		uint32_t            w[COEFF_WORDS];
+	}                   pub;
+} Sis8300CalRec;
+
+static void
+coeffs_init(Sis8300CalCoeffs c)
+{
+int ch;
+	c->n_red = c->n_grn = 0;
+	c->valid = 0;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		c->gain[ch]  = 1.0f;
+		c->phase[ch] = 0.0f;
+	}
+}
+
+static void
+cal_publish(Sis8300Cal cal)
+{
+const uint32_t *src = (const uint32_t*)&cal->work;
+uint32_t        s   = cal->seq;
+unsigned        i;
+
+	cal->work.generation++;
+
+	__atomic_store_n( &cal->seq, s + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	for ( i = 0; i < COEFF_WORDS; i++ )
+		__atomic_store_n( &cal->pub.w[i], src[i], __ATOMIC_RELAXED );
+	__atomic_store_n( &cal->seq, s + 2, __ATOMIC_RELEASE );
+}
+
+Sis8300Cal
+sis8300CalCreate(int fd, Sis8300CalParms parms)
+{
+Sis8300Cal cal;
+double     r, cyc, scl;
+unsigned   n;
+
+	if ( 0 == parms->win_len || 0 == parms->navg ) {
+		fprintf(stderr,"sis8300CalCreate: empty window or zero averaging length\n");
+		return 0;
+	}
+	if ( parms->ref_chnl < 0 || parms->ref_chnl > SIS8300_MAX_CHANNELS ) {
+		fprintf(stderr,"sis8300CalCreate: invalid reference channel #\n");
+		return 0;
+	}
+
+	if ( ! (cal = calloc( 1, sizeof(*cal) )) ) {
+		fprintf(stderr,"sis8300CalCreate: no memory\n");
+		return 0;
+	}
+
+	cal->parms = *parms;
+	if (    0.0 != parms->f_cal
+	     && 0 == cal->parms.fclk
+	     && 0 == (cal->parms.fclk = sis8300DigiGetFclk( fd )) ) {
+		fprintf(stderr,"sis8300CalCreate: sample clock unknown (device not set up?)\n");
+		free( cal );
+		return 0;
+	}
+
+	n = parms->win_len;
+	if (    ! (cal->nco_c = malloc( n * sizeof(float) ))
+	     || ! (cal->nco_s = malloc( n * sizeof(float) ))
+	     || ! (cal->mix_i = malloc( n * sizeof(float) ))
+	     || ! (cal->mix_q = malloc( n * sizeof(float) ))
+	     || ! (cal->h     = malloc( n * sizeof(float) )) ) {
+		fprintf(stderr,"sis8300CalCreate: no memory\n");
+		sis8300CalDestroy( cal );
+		return 0;
+	}
+
+	/* tone phase is relative to the first sample of the frame */
+	r   = 0.0 == parms->f_cal ? 0.0 : parms->f_cal / (double)cal->parms.fclk;
+	scl = 0.0 == parms->f_cal ? 1.0 : 2.0;
+	for ( n = 0; n < parms->win_len; n++ ) {
+		cyc = r * (double)(n + parms->win_start);
+		cyc = 2.0 * M_PI * (cyc - floor( cyc ));
+		cal->nco_c[n] = (float)(  scl * cos( cyc ) );
+		cal->nco_s[n] = (float)( -scl * sin( cyc ) );
+		cal->h[n]     = (float)( 1.0 / (double)parms->win_len );
+	}
+
+	sis8300CalReset( cal );
+
+	return cal;
+}
+
+void
+sis8300CalDestroy(Sis8300Cal cal)
+{
+	if ( ! cal )
+		return;
+	free( cal->nco_c );
+	free( cal->nco_s );
+	free( cal->mix_i );
+	free( cal->mix_q );
+	free( cal->h );
+	free( cal );
+}
+
+void
+sis8300CalReset(Sis8300Cal cal)
+{
+	memset( cal->avg_i, 0, sizeof(cal->avg_i) );
+	memset( cal->avg_q, 0, sizeof(cal->avg_q) );
+	memset( cal->cnt,   0, sizeof(cal->cnt)   );
+	memset( cal->nfrm,  0, sizeof(cal->nfrm)  );
+	coeffs_init( &cal->work );
+	cal_publish( cal );
+}
+
+/* Derive coefficients from the running averages */
+static void
+cal_update(Sis8300Cal cal)
+{
+Sis8300CalCoeffs c = &cal->work;
+double           amp[SIS8300_MAX_CHANNELS];
+double           ref_amp, ri, rq, pi, pq, ci, cq;
+int              ch, k, n, ref = cal->parms.ref_chnl - 1;
+
+	coeffs_init( c );
+	c->n_red = cal->nfrm[KIND_RED];
+	c->n_grn = cal->nfrm[KIND_GRN];
+
+	/* amplitude: mean over the kinds measured */
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		amp[ch] = 0.0;
+		for ( k = n = 0; k < NKINDS; k++ ) {
+			if ( cal->cnt[k][ch] ) {
+				amp[ch] += sqrt( cal->avg_i[k][ch] * cal->avg_i[k][ch] + cal->avg_q[k][ch] * cal->avg_q[k][ch] );
+				n++;
+			}
+		}
+		if ( n && (amp[ch] /= (double)n) > 0.0 )
+			c->valid |= (1 << ch);
+	}
+
+	if ( ref >= 0 ) {
+		if ( ! (c->valid & (1 << ref)) ) {
+			c->valid = 0;
+			return;
+		}
+		ref_amp = amp[ref];
+	} else {
+		for ( ch = n = 0, ref_amp = 0.0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+			if ( (c->valid & (1 << ch)) ) {
+				ref_amp += amp[ch];
+				n++;
+			}
+		}
+		if ( ! n )
+			return;
+		ref_amp /= (double)n;
+	}
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( ! (c->valid & (1 << ch)) )
+			continue;
+		c->gain[ch] = (float)(ref_amp / amp[ch]);
+
+		/* phase: sum over kinds of the normalized A_ch * conj(A_ref); the
+		 * reference phase is that of the (amplitude-weighted) channel mean
+		 * if no reference channel is given.
+		 */
+		pi = pq = 0.0;
+		for ( k = 0; k < NKINDS; k++ ) {
+			if ( ! cal->cnt[k][ch] )
+				continue;
+			if ( ref >= 0 ) {
+				ri = cal->avg_i[k][ref];
+				rq = cal->avg_q[k][ref];
+			} else {
+				for ( n = 0, ri = rq = 0.0; n < SIS8300_MAX_CHANNELS; n++ ) {
+					if ( cal->cnt[k][n] && amp[n] > 0.0 ) {
+						ri += cal->avg_i[k][n] / amp[n];
+						rq += cal->avg_q[k][n] / amp[n];
+					}
+				}
+			}
+			ci  = cal->avg_i[k][ch] * ri + cal->avg_q[k][ch] * rq;
+			cq  = cal->avg_q[k][ch] * ri - cal->avg_i[k][ch] * rq;
+			if ( 0.0 != ci || 0.0 != cq ) {
+				pi += ci / hypot( ci, cq );
+				pq += cq / hypot( ci, cq );
+			}
+		}
+		c->phase[ch] = (float)( 0.0 == cal->parms.f_cal ? 0.0 : atan2( pq, pi ) );
+	}
+}
+
+int
+sis8300CalAccumulate(Sis8300Cal cal, Sis8300Frame frame)
+{
+float    yi, yq;
+unsigned m;
+int      k, ch;
+
+	switch ( frame->kind ) {
+		case SIS8300_KIND_CRED: k = KIND_RED; break;
+		case SIS8300_KIND_CGRN: k = KIND_GRN; break;
+		default:
+			return 1;
+	}
+
+	if ( cal->parms.win_start + cal->parms.win_len > frame->nsmpl ) {
+		fprintf(stderr,"sis8300CalAccumulate: window exceeds frame\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( ! frame->chnl[ch] )
+			continue;
+		sis8300DspMixIQ( cal->mix_i, cal->mix_q, frame->chnl[ch] + cal->parms.win_start, cal->nco_c, cal->nco_s, cal->parms.win_len );
+		sis8300DspFirDecimIQ( &yi, &yq, cal->mix_i, cal->mix_q, 1, 1, cal->h, cal->parms.win_len );
+
+		/* cumulative average until 'navg' frames are in, exponential thereafter */
+		if ( cal->cnt[k][ch] < cal->parms.navg )
+			cal->cnt[k][ch]++;
+		m = cal->cnt[k][ch];
+		cal->avg_i[k][ch] += ((double)yi - cal->avg_i[k][ch]) / (double)m;
+		cal->avg_q[k][ch] += ((double)yq - cal->avg_q[k][ch]) / (double)m;
+	}
+	cal->nfrm[k]++;
+
+	cal_update( cal );
+	cal_publish( cal );
+
+	return 0;
+}
+
+void
+sis8300CalGet(Sis8300Cal cal, Sis8300CalCoeffs coeffs)
+{
+uint32_t *dst = (uint32_t*)coeffs;
+uint32_t  s;
+unsigned  i;
+
+	do {
+		while ( (s = __atomic_load_n( &cal->seq, __ATOMIC_ACQUIRE )) & 1 )
+			/* update in progress */;
+		for ( i = 0; i < COEFF_WORDS; i++ )
+			dst[i] = __atomic_load_n( &cal->pub.w[i], __ATOMIC_RELAXED );
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	} while ( s != __atomic_load_n( &cal->seq, __ATOMIC_RELAXED ) );
+}
+
+uint64_t
+sis8300CalGeneration(Sis8300Cal cal)
+{
+Sis8300CalCoeffsRec c;
+	sis8300CalGet( cal, &c );
+	return c.generation;
+}
+
+void
+sis8300CalToDsp(Sis8300CalCoeffs coeffs, const double base[SIS8300_MAX_CHANNELS], Sis8300DspCal dsp)
+{
+int ch;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		dsp->gain[ch] = base ? base[ch] : 1.0;
+		if ( (coeffs->valid & (1 << ch)) )
+			dsp->gain[ch] *= (double)coeffs->gain[ch];
+	}
+}
+
+void
+sis8300CalToGains(Sis8300CalCoeffs coeffs, const int *chnl, const float *base, float *gain, unsigned n)
+{
+unsigned i;
+int      ch;
+	for ( i = 0; i < n; i++ ) {
+		ch      = chnl[i] - 1;
+		gain[i] = base[i];
+		if ( ch >= 0 && ch < SIS8300_MAX_CHANNELS && (coeffs->valid & (1 << ch)) )
+			gain[i] *= coeffs->gain[ch];
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef SIS8300CAL_H
+#define SIS8300CAL_H
+
+#include <sis8300Digi.h>
+#include <sis8300Dsp.h>
+
+/* Channel calibration from 'red' and 'green' calibration acquisitions
+ * (frames of kind SIS8300_KIND_CRED and SIS8300_KIND_CGRN).
+ *
+ * The complex amplitude of the calibration tone (frequency 'f_cal') is
+ * measured in a window of every calibration frame and running averages
+ * are kept per channel and kind. Coefficients are derived from the
+ * averages after every frame:
+ *
+ *   gain[ch-1]  = amplitude of the reference / amplitude of channel # ch
+ *   phase[ch-1] = phase of channel # ch relative to the reference (rad)
+ *
+ * (averaged over both kinds), i.e., multiplying by 'gain' and subtracting
+ * 'phase' equalizes the channels. With f_cal zero the tone is DC (the
+ * window average) and phases are zero.
+ *
+ * Accumulation is cheap (one frame at a time) and must be done by a
+ * single thread; coefficients are published atomically (seqlock) and
+ * may be read by any number of threads without blocking the writer.
+ */
+
+typedef struct Sis8300CalParmsRec_ {
+	double             f_cal;   /* calibration tone (Hz)                          */
+	unsigned long      fclk;    /* sample clock (Hz); 0: use sis8300DigiGetFclk() */
+	unsigned           win_start;
+	unsigned           win_len;
+	unsigned           navg;    /* averaging length (frames per kind; >= 1)       */
+	int                ref_chnl; /* reference channel #; 0: mean of all channels  */
+} Sis8300CalParmsRec, *Sis8300CalParms;
+
+typedef struct Sis8300CalCoeffsRec_ {
+	uint64_t           generation; /* incremented with every update              */
+	uint32_t           n_red;   /* number of frames accumulated                   */
+	uint32_t           n_grn;
+	uint32_t           valid;   /* bit ch-1 set if channel # ch is calibrated     */
+	float              gain [SIS8300_MAX_CHANNELS];
+	float              phase[SIS8300_MAX_CHANNELS];
+} Sis8300CalCoeffsRec, *Sis8300CalCoeffs;
+
+typedef struct Sis8300CalRec_ *Sis8300Cal;
+
+/* 'fd' is only used to obtain the sample clock if parms->fclk is zero
+ * (and the tone frequency nonzero).
+ *
+ * RETURNS: calibration or NULL on error.
+ */
+Sis8300Cal
+sis8300CalCreate(int fd, Sis8300CalParms parms);
+
+void
+sis8300CalDestroy(Sis8300Cal cal);
+
+/* Feed a frame; frames which are not calibration frames are ignored.
+ *
+ * RETURNS: 0 if the frame was accumulated (and new coefficients
+ *          published), 1 if the frame was ignored, -1 on error
+ *          (window exceeds frame).
+ */
+int
+sis8300CalAccumulate(Sis8300Cal cal, Sis8300Frame frame);
+
+/* Discard all averages (coefficients are reset to unity/zero) */
+void
+sis8300CalReset(Sis8300Cal cal);
+
+/* Obtain a consistent copy of the current coefficients (lock-free) */
+void
+sis8300CalGet(Sis8300Cal cal, Sis8300CalCoeffs coeffs);
+
+/* RETURNS: current generation (cheap check whether coefficients changed) */
+uint64_t
+sis8300CalGeneration(Sis8300Cal cal);
+
+/* Apply gains of calibrated channels to a conversion calibration
+ * (dsp->gain[ch-1] = base[ch-1] * gain[ch-1]). 'base' may be NULL (unity).
+ */
+void
+sis8300CalToDsp(Sis8300CalCoeffs coeffs, const double base[SIS8300_MAX_CHANNELS], Sis8300DspCal dsp);
+
+/* Gains for a list of 'n' channel #s (e.g., BPM buttons; see
+ * sis8300BpmSetGains()): gain[i] = base[i] * coeffs->gain[chnl[i]-1]
+ * (base[i] if the channel is not calibrated).
+ */
+void
+sis8300CalToGains(Sis8300CalCoeffs coeffs, const int *chnl, const float *base, float *gain, unsigned n);
+
+#endif
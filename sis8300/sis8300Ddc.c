@@ -0,0 +1,229 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sis8300Ddc.h>
+
+/* Digital down-conversion (see sis8300Ddc.h)
+ *
+ * Since the NCO phase is reset with every frame the NCO is a table
+ * (cos/sin of the sample index, factor 2 and sign folded in) and mixing
+ * is an element-wise product. Mixing and filtering use the kernels of
+ * sis8300Dsp.c (run-time selected SIMD implementations).
+ */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct Sis8300DdcRec_ {
+	Sis8300DdcParmsRec parms;   /* 'taps' points to our copy               */
+	unsigned           nsmpl;
+	unsigned           nin;     /* samples actually consumed per channel  */
+	unsigned           nout;
+	float             *h;       /* filter coefficients                    */
+	float             *hs;      /* scaled coefficients (calibration)      */
+	float             *nco_c;   /*  2 cos( phi(n) )                        */
+	float             *nco_s;   /* -2 sin( phi(n) )                        */
+	float             *mix_i;   /* mixer output                           */
+	float             *mix_q;
+} Sis8300DdcRec;
+
+Sis8300Ddc
+sis8300DdcCreate(int fd, Sis8300DdcParms parms, unsigned nsmpl)
+{
+Sis8300Ddc ddc;
+double     r, cyc;
+unsigned   n;
+
+	if ( parms->decim < 1 || parms->ntaps < 1 || ! parms->taps ) {
+		fprintf(stderr,"sis8300DdcCreate: invalid decimation ratio or filter\n");
+		return 0;
+	}
+	if ( nsmpl < parms->ntaps ) {
+		fprintf(stderr,"sis8300DdcCreate: frame shorter than filter\n");
+		return 0;
+	}
+
+	if ( ! (ddc = calloc( 1, sizeof(*ddc) )) ) {
+		fprintf(stderr,"sis8300DdcCreate: no memory\n");
+		return 0;
+	}
+
+	ddc->parms = *parms;
+	if ( 0 == ddc->parms.fclk && 0 == (ddc->parms.fclk = sis8300DigiGetFclk( fd )) ) {
+		fprintf(stderr,"sis8300DdcCreate: sample clock unknown (device not set up?)\n");
+		free( ddc );
+		return 0;
+	}
+
+	ddc->nsmpl = nsmpl;
+	ddc->nout  = (nsmpl - parms->ntaps) / parms->decim + 1;
+	ddc->nin   = (ddc->nout - 1) * parms->decim + parms->ntaps;
+
+	if (    ! (ddc->h     = malloc( parms->ntaps * sizeof(*ddc->h)     ))
+	     || ! (ddc->hs    = malloc( parms->ntaps * sizeof(*ddc->hs)    ))
+	     || ! (ddc->nco_c = malloc( ddc->nin     * sizeof(*ddc->nco_c) ))
+	     || ! (ddc->nco_s = malloc( ddc->nin     * sizeof(*ddc->nco_s) ))
+	     || ! (ddc->mix_i = malloc( ddc->nin     * sizeof(*ddc->mix_i) ))
+	     || ! (ddc->mix_q = malloc( ddc->nin     * sizeof(*ddc->mix_q) )) ) {
+		fprintf(stderr,"sis8300DdcCreate: no memory\n");
+		sis8300DdcDestroy( ddc );
+		return 0;
+	}
+
+	memcpy( ddc->h, parms->taps, parms->ntaps * sizeof(*ddc->h) );
+	ddc->parms.taps = ddc->h;
+
+	/* reduce the phase to one cycle before converting to an angle
+	 * so that precision doesn't degrade along the frame.
+	 */
+	r = ddc->parms.f_nco / (double)ddc->parms.fclk;
+	for ( n = 0; n < ddc->nin; n++ ) {
+		cyc = r * (double)n;
+		cyc = 2.0 * M_PI * (cyc - floor( cyc )) + ddc->parms.phase;
+		ddc->nco_c[n] = (float)(  2.0 * cos( cyc ) );
+		ddc->nco_s[n] = (float)( -2.0 * sin( cyc ) );
+	}
+
+	return ddc;
+}
+
+void
+sis8300DdcDestroy(Sis8300Ddc ddc)
+{
+	if ( ! ddc )
+		return;
+	free( ddc->h );
+	free( ddc->hs );
+	free( ddc->nco_c );
+	free( ddc->nco_s );
+	free( ddc->mix_i );
+	free( ddc->mix_q );
+	free( ddc );
+}
+
+unsigned
+sis8300DdcGetNumOut(Sis8300Ddc ddc)
+{
+	return ddc->nout;
+}
+
+int
+sis8300DdcProcess(Sis8300Ddc ddc, Sis8300Frame frame, Sis8300DspCal cal,
+                  float *i_out[SIS8300_MAX_CHANNELS], float *q_out[SIS8300_MAX_CHANNELS])
+{
+const float *h;
+float        g;
+unsigned     j;
+int          ch;
+
+	if ( frame->nsmpl != ddc->nsmpl ) {
+		fprintf(stderr,"sis8300DdcProcess: frame size mismatch (%u samples, expected %u)\n", frame->nsmpl, ddc->nsmpl);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( i_out[ch] && ! frame->chnl[ch] ) {
+			fprintf(stderr,"sis8300DdcProcess: channel # %i not in frame\n", ch + 1);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( ! i_out[ch] )
+			continue;
+
+		h = ddc->h;
+		if ( cal ) {
+			/* cheaper to scale the coefficients than the outputs */
+			g = (float)(cal->gain[ch] * (double)(1 << cal->shift));
+			for ( j = 0; j < ddc->parms.ntaps; j++ )
+				ddc->hs[j] = g * ddc->h[j];
+			h = ddc->hs;
+		}
+
+		sis8300DspMixIQ( ddc->mix_i, ddc->mix_q, frame->chnl[ch], ddc->nco_c, ddc->nco_s, ddc->nin );
+		sis8300DspFirDecimIQ( i_out[ch], q_out[ch], ddc->mix_i, ddc->mix_q, ddc->nout, ddc->parms.decim, h, ddc->parms.ntaps );
+	}
+
+	return 0;
+}
+
+unsigned
+sis8300DdcCicTaps(unsigned order, unsigned decim, float *taps)
+{
+double   h[6*(256-1)+1], t[6*(256-1)+1];
+unsigned n, len, o, i, k;
+double   norm;
+
+	if ( order < 1 || order > 6 || decim < 1 || decim > 256 ) {
+		fprintf(stderr,"sis8300DdcCicTaps: order (1..6) or decimation ratio (1..256) out of range\n");
+		return 0;
+	}
+
+	n = order * (decim - 1) + 1;
+	if ( ! taps )
+		return n;
+
+	/* convolve 'order' boxcars of length 'decim' */
+	len  = 1;
+	h[0] = 1.0;
+	for ( o = 0; o < order; o++ ) {
+		for ( i = 0; i < len + decim - 1; i++ ) {
+			t[i] = 0.0;
+			for ( k = 0; k < decim; k++ ) {
+				if ( i >= k && i - k < len )
+					t[i] += h[i - k];
+			}
+		}
+		len += decim - 1;
+		memcpy( h, t, len * sizeof(h[0]) );
+	}
+
+	norm = pow( (double)decim, (double)order );
+	for ( i = 0; i < n; i++ )
+		taps[i] = (float)(h[i] / norm);
+
+	return n;
+}
+
+unsigned
+sis8300DdcLowpassTaps(double fc, unsigned ntaps, float *taps)
+{
+double   m, x, w, sum;
+double  *h;
+unsigned i;
+
+	if ( ntaps < 1 || ! (fc > 0.0 && fc < 0.5) ) {
+		fprintf(stderr,"sis8300DdcLowpassTaps: invalid number of taps or cutoff\n");
+		return 0;
+	}
+
+	if ( ! (h = malloc( ntaps * sizeof(*h) )) ) {
+		fprintf(stderr,"sis8300DdcLowpassTaps: no memory\n");
+		return 0;
+	}
+
+	m   = (double)(ntaps - 1);
+	sum = 0.0;
+	for ( i = 0; i < ntaps; i++ ) {
+		x = (double)i - m/2.0;
+		h[i] = ( 0.0 == x ) ? 2.0 * fc : sin( 2.0 * M_PI * fc * x ) / (M_PI * x);
+		if ( ntaps > 1 ) {
+			w     = 2.0 * M_PI * (double)i / m;
+			h[i] *= 0.42 - 0.5 * cos( w ) + 0.08 * cos( 2.0 * w );
+		}
+		sum += h[i];
+	}
+	for ( i = 0; i < ntaps; i++ )
+		taps[i] = (float)(h[i] / sum);
+
+	free( h );
+	return ntaps;
+}
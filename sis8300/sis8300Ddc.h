@@ -0,0 +1,90 @@
+#ifndef SIS8300DDC_H
+#define SIS8300DDC_H
+
+#include <sis8300Digi.h>
+#include <sis8300Dsp.h>
+
+/* Digital down-conversion (I/Q demodulation).
+ *
+ * Each selected channel of a frame is mixed with a numerically controlled
+ * oscillator (NCO), low-pass filtered and decimated:
+ *
+ *   I[k] + j Q[k] = 2 * sum_j h[j] * x[n] * exp( -j (2 pi f_nco/fclk n + phase) ),
+ *
+ *   n = k * decim + j
+ *
+ * The factor 2 is chosen so that for a filter with unity DC gain the
+ * magnitude of (I, Q) is the amplitude of a sine wave at f_nco. The NCO
+ * phase is reset at the first sample of every frame, i.e., the phase of
+ * (I, Q) is relative to the first sample (which precedes the trigger by
+ * frame->trig samples; the phase relative to the trigger is larger by
+ * 2 pi f_nco/fclk trig).
+ *
+ * Only 'valid' outputs (filter fully inside the frame) are produced:
+ * (nsmpl - ntaps) / decim + 1 per channel.
+ */
+
+typedef struct Sis8300DdcParmsRec_ {
+	double             f_nco;   /* NCO frequency (Hz)                            */
+	double             phase;   /* NCO phase at the first sample (rad)           */
+	unsigned long      fclk;    /* sample clock (Hz); 0: use sis8300DigiGetFclk() */
+	unsigned           decim;   /* decimation ratio (>= 1)                       */
+	unsigned           ntaps;   /* number of filter coefficients                 */
+	const float       *taps;    /* filter coefficients (copied)                  */
+} Sis8300DdcParmsRec, *Sis8300DdcParms;
+
+typedef struct Sis8300DdcRec_ *Sis8300Ddc;
+
+/* Create a DDC for frames of 'nsmpl' samples per channel. 'fd' is only
+ * used to obtain the sample clock if parms->fclk is zero (in which case
+ * sis8300DigiSetup() must have been executed).
+ *
+ * RETURNS: DDC or NULL on error.
+ */
+Sis8300Ddc
+sis8300DdcCreate(int fd, Sis8300DdcParms parms, unsigned nsmpl);
+
+void
+sis8300DdcDestroy(Sis8300Ddc ddc);
+
+/* RETURNS: number of I/Q samples per channel produced by sis8300DdcProcess() */
+unsigned
+sis8300DdcGetNumOut(Sis8300Ddc ddc);
+
+/* Process a frame: i_out[ch-1], q_out[ch-1] receive the I/Q samples of
+ * channel # 'ch'; channels for which i_out[ch-1] is NULL are skipped.
+ * If 'cal' is non-NULL the outputs are scaled by gain[ch-1] * 2^shift
+ * (offsets are rejected by the filter unless f_nco is zero and are
+ * ignored).
+ *
+ * A DDC is not thread-safe; use one per thread.
+ *
+ * RETURNS: 0 on success, -1 on error (channel not in frame or frame
+ *          size mismatch).
+ */
+int
+sis8300DdcProcess(Sis8300Ddc ddc, Sis8300Frame frame, Sis8300DspCal cal,
+                  float *i_out[SIS8300_MAX_CHANNELS], float *q_out[SIS8300_MAX_CHANNELS]);
+
+/* Filter design helpers. Both return the number of coefficients stored
+ * into 'taps' (normalized to unity DC gain).
+ */
+
+/* Impulse response of a CIC decimator of order 'order' (1..6) and ratio
+ * 'decim' which has order * (decim - 1) + 1 coefficients; 'taps' may be
+ * NULL to just obtain the number.
+ *
+ * RETURNS: number of coefficients or 0 on error.
+ */
+unsigned
+sis8300DdcCicTaps(unsigned order, unsigned decim, float *taps);
+
+/* Windowed-sinc (Blackman) low-pass with cutoff 'fc' (relative to fclk,
+ * 0 < fc < 0.5) and 'ntaps' coefficients.
+ *
+ * RETURNS: ntaps or 0 on error.
+ */
+unsigned
+sis8300DdcLowpassTaps(double fc, unsigned ntaps, float *taps);
+
+#endif
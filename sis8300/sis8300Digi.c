@@ -8,11 +8,16 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <sis8300_defs.h>
 #include <sis8300_reg.h>
 
 #include <sis8300Digi.h>
+#include <sis8300Dsp.h>
 
 #include <ratapp.h>
 #include <stdlib.h>
@@ -134,15 +139,23 @@ sis8300_reg r;
 	return r.data;
 }
 
-static void
-rwr(int fd, unsigned off, uint32_t val)
+static int
+rwr_chk(int fd, unsigned off, uint32_t val)
 {
 sis8300_reg r;
 	r.offset = off;
 	r.data   = val;
 	if ( ioctl(fd, SIS8300_REG_WRITE, &r) ) {
 		fprintf(stderr,"ERROR: ioctl(SIS8300_REG_WRITE @%x) failed: %s\n", off, strerror(errno));
+		return -1;
 	}
+	return 0;
+}
+
+static void
+rwr(int fd, unsigned off, uint32_t val)
+{
+	rwr_chk(fd, off, val);
 }
 
 static void
@@ -170,6 +183,80 @@ sis8300_reg r;
 	return 0;
 }
 
+/* Settings which cannot be read back from the hardware are recorded
+ * per device (keyed by the device number so that all file descriptors
+ * referring to the same board share them).
+ */
+#define DEV_STATE_MAX 16
+
+/* The acquisition registers last written by sis8300DigiCountCommit() are
+ * cached so that only changes need to be written; 'cfg_known' and
+ * cfg.amask tell which of them are known. We assume no other process
+ * programs these registers (sis8300DigiSetup() resets the cache;
+ * sis8300DigiWriteReg() drops the registers it writes, see dev_cfg_reg()).
+ */
+#define CFG_LEN 1                   /* cfg.len is what the hardware has */
+#define CFG_CTL 2                   /* ctl     is what the hardware has */
+
+typedef struct DevStateRec_ {
+	dev_t              rdev;
+	unsigned long      fclk;      /* digitizer clock set by sis8300DigiSetup() */
+	int                dual;      /* dual-channel sampling firmware           */
+	unsigned           npre;      /* pretrigger samples                       */
+	uint32_t           chvalid;   /* channels of the firmware (0: unknown)    */
+	unsigned           cfg_known;
+	uint32_t           ctl;       /* SIS8300_SAMPLE_CONTROL_REG               */
+	Sis8300CountCfgRec cfg;
+} DevStateRec, *DevState;
+
+static DevStateRec     dev_state[DEV_STATE_MAX];
+static unsigned        dev_state_n = 0;
+static pthread_mutex_t dev_state_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* Find (or create) state of the device 'fd' refers to; caller must hold
+ * dev_state_mtx.
+ *
+ * RETURNS: state or NULL if not found (or table full).
+ */
+static DevState
+dev_state_find(int fd, int create)
+{
+struct stat sb;
+unsigned    i;
+
+	if ( fstat( fd, &sb ) ) {
+		fprintf(stderr,"ERROR: fstat failed: %s\n", strerror(errno));
+		return 0;
+	}
+	for ( i = 0; i < dev_state_n; i++ ) {
+		if ( dev_state[i].rdev == sb.st_rdev )
+			return &dev_state[i];
+	}
+	if ( ! create )
+		return 0;
+	if ( dev_state_n >= DEV_STATE_MAX ) {
+		fprintf(stderr,"ERROR: too many devices (max. %u)\n", DEV_STATE_MAX);
+		return 0;
+	}
+	memset( &dev_state[dev_state_n], 0, sizeof(dev_state[dev_state_n]) );
+	dev_state[dev_state_n].rdev = sb.st_rdev;
+	return &dev_state[dev_state_n++];
+}
+
+/* Copy of the state of device 'fd' (all zero if unknown) */
+static void
+dev_state_get(int fd, DevState st)
+{
+DevState ds;
+
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 0 )) )
+		*st = *ds;
+	else
+		memset( st, 0, sizeof(*st) );
+	pthread_mutex_unlock( &dev_state_mtx );
+}
+
 /* AD9268 ADC access primitives */
 
 static void
@@ -771,9 +858,7 @@ Si53xxLim   *l;
 unsigned    n1min, n1max, n1, n1h, n2h, n2l, nc, n3min, v2, v3;
 Rational    r, ro, r_max, r_arg;
 double      eps = 1.0/0.0, e;
-Convergent *c = 0;
-int         n_c, k;
-RatNum      im_i;
+RatappIter  it;
 
 	l = si53xx_getLims( p->wb );
 
@@ -810,16 +895,6 @@ RatNum      im_i;
 	 */
 	n1min = (n1min + 1) & ~1;
 
-	if ( (n_c = ratapp_estimate_terms( 0, &r_max )) < 0 ) {
-		fprintf(stderr,"si53xx_calcParms -- ratapp_estimate_terms failed\n");
-		return -1;
-	}
-
-	if ( ! (c = malloc( sizeof(*c) * n_c )) ) {
-		fprintf(stderr,"si53xx_calc_parms -- no memory\n");
-		return -1;
-	}
-
 	/* N2 must be even; compute N2_ = N2/2; we know that n1 has to be even, too
 	 * (at least as soon as n1 > n1hmax). Hence we perform all the computations
 	 * for n1/2.
@@ -833,56 +908,49 @@ RatNum      im_i;
 
 		nc = n1/n1h;
 
-		r_arg.n = n1 * fout;
-
-		/* Continued fraction expansion of n1 * fout / fin */
-		k = ratapp_find_convergents(c, n_c, &r_arg, &r_max);
-		if ( k < 0 && k>= n_c ) {
-			fprintf(stderr,"ratapp_find_convergents failed (return value %i, n_c %i)\n", k, n_c);
-			free( c );
+		if ( ratapp_mac( &r_arg.n, n1, fout, 0 ) ) {
+			fprintf(stderr,"si53xx_calcParms -- N1 * fout overflows\n");
 			return -1;
 		}
-		/* Find next best approximation */
-		while ( --k >= 0 ) {
-			/* Iterate over intermediates until finding an acceptable one */
-			im_i = c[k+1].a;
-			do {
-				im_i--;
-				im_i = ratapp_intermediate( &r, im_i, &c[k+1], &c[k], &r_arg );
-				/* Check if this one's better... */
-				e = fabs( (double)p->fin * (double)r.n / (double)r.d / (double)n1 - (double)fout );
-				if ( verbose )
-					printf("Checking n1h %u, nc %u, n1 %u, r.n %"PRIu64", r.d %"PRIu64", eps %g", n1h, nc, n1, r.n, r.d, e);
-				if ( e <= eps ) {
-					/* If as good pick the higher n1h but only if N2 can be factorized into legal values  */
-					if (    (e < eps || n1h > p->n1h)
-							&& (n2h = brutefac( r.n, l->n2hmin, l->n2hmax ))
-							&& (n2l = r.n/n2h*2) <= l->n2lmax ) {
-						if ( verbose )
-							printf("  ==> Accepted");
-						ro  = r;
-						eps = e;
-						p->n1h = n1h;
-						p->nc  = 2*nc;
-						p->n2h = n2h;
-
-						/* done */
-						k      = 0;
-						im_i   = 0;
-					}
-				} else {
-					/* end this effort */
-					k    = 0;
-					im_i = 0;
-				}
+
+		/* Continued fraction expansion of n1 * fout / fin; the iterator
+		 * yields the best approximation first (and nothing if there is
+		 * no approximation meeting r_max).
+		 */
+		ratapp_iter_init( &it, &r_arg, &r_max );
+
+		/* Iterate over approximations until finding an acceptable one */
+		while ( ratapp_iter_next( &it, &r ) >= 0 ) {
+			/* Check if this one's better... */
+			e = fabs( (double)p->fin * (double)r.n / (double)r.d / (double)n1 - (double)fout );
+			if ( verbose )
+				printf("Checking n1h %u, nc %u, n1 %u, r.n %"RATu", r.d %"RATu", eps %g", n1h, nc, n1, RATP(r.n), RATP(r.d), e);
+			if ( e > eps ) {
+				/* end this effort */
 				if ( verbose )
 					printf("\n");
-			} while ( im_i > 0 );
+				break;
+			}
+			/* If as good pick the higher n1h but only if N2 can be factorized into legal values  */
+			if (    (e < eps || n1h > p->n1h)
+					&& (n2h = brutefac( r.n, l->n2hmin, l->n2hmax ))
+					&& (n2l = r.n/n2h*2) <= l->n2lmax ) {
+				if ( verbose )
+					printf("  ==> Accepted\n");
+				ro  = r;
+				eps = e;
+				p->n1h = n1h;
+				p->nc  = 2*nc;
+				p->n2h = n2h;
+
+				/* done */
+				break;
+			}
+			if ( verbose )
+				printf("\n");
 		}
 	}
 
-	free( c );
-
 	if ( p->nc == 0 ) {
 		/* No allowable N1 found */
 		return -1;
@@ -1079,14 +1147,15 @@ long     fout;
 unsigned long fclk, fmax;
 int      rval = 0;
 int      is_8_ch_fw = is_8_channel_firmware( fd );
+DevState ds;
+int      dual;
 
 	if ( check_fd( fd, "sis8300DigiSetup" ) )
 		return -1;
 
-	/* Assume single-channel buffer logic */
-	if ( (rrd(fd, SIS8300_FIRMWARE_OPTIONS_REG) & SIS8300_DUAL_CHANNEL_SAMPLING) ) {
-		fprintf(stderr,"ERROR: firmware does not support single-channel mode\n");
-		return -1;
+	/* Single- or dual-channel buffer logic (affects memory layout only) */
+	if ( (dual = !! (rrd(fd, SIS8300_FIRMWARE_OPTIONS_REG) & SIS8300_DUAL_CHANNEL_SAMPLING)) ) {
+		fprintf(stderr,"Dual-channel sampling firmware\n");
 	}
 
 	/* Infinite divider ratio so that fclk doesn't become too high */
@@ -1172,11 +1241,23 @@ int      is_8_ch_fw = is_8_channel_firmware( fd );
 		rwr(fd, 0x405, 0x10);
 	}
 
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 1 )) ) {
+		ds->fclk      = fclk;
+		ds->dual      = dual;
+		ds->npre      = 0;
+		ds->chvalid   = (1 << (is_8_ch_fw ? 8 : SIS8300_MAX_CHANNELS)) - 1;
+		ds->ctl       = cmd;
+		ds->cfg_known = CFG_CTL;
+		ds->cfg.amask = 0;
+	}
+	pthread_mutex_unlock( &dev_state_mtx );
+
 	return rval;
 }
 
 int
-sis8300DigiArm(int fd, int kind)
+sis8300DigiReadMode(int kind)
 {
 int cmd;
 	switch ( kind ) {
@@ -1193,7 +1274,19 @@ int cmd;
 			cmd = SIS8300_READ_MODE_DMACHAIN_CAL_GRN;
 		break;
 	}
-	return ioctl(fd, SIS8300_READ_MODE, &cmd);
+	return cmd;
+}
+
+int
+sis8300DigiArmMode(int fd, int mode)
+{
+	return ioctl(fd, SIS8300_READ_MODE, &mode);
+}
+
+int
+sis8300DigiArm(int fd, int kind)
+{
+	return sis8300DigiArmMode( fd, sis8300DigiReadMode( kind ) );
 }
 
 Sis8300ChannelSel
@@ -1213,39 +1306,132 @@ Sis8300ChannelSel rval = 0;
 	return rval;
 }
 
-int
-sis8300DigiValidateSel(int fd, Sis8300ChannelSel sel)
+/* Decode a selector; 'valid' is the mask of channels the device has */
+static int
+layout_init(Sis8300Layout lay, Sis8300ChannelSel sel, unsigned nsmpl, uint32_t valid, int dual)
 {
-int               i,j,n,k;
-int               max;
-Sis8300ChannelSel s,t;
-
-	if ( check_fd( fd, "sis8300DigiValidateSel" ) )
-		return -1;
-
-	max = is_8_channel_firmware(fd) ? 8 : 10;
-
-	for ( i=0, s= (sel & ~SIS8300_VALIDATE_SEL_QUIET); 0 != (n = ( s & 0xf ) ); ) {
-		if ( n > max ) {
-			if ( ! (sel & SIS8300_VALIDATE_SEL_QUIET) )
-				fprintf(stderr,"channel # %i in selector pos %i too big (1..%i)\n", n, i, max);
+int      quiet = !! (sel & SIS8300_VALIDATE_SEL_QUIET);
+uint32_t bit;
+unsigned i;
+int      ch;
+
+	sel &= ~SIS8300_VALIDATE_SEL_QUIET;
+
+	memset( lay, 0, sizeof(*lay) );
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ )
+		lay->blk[i] = -1;
+
+	lay->sel   = sel;
+	lay->nsmpl = nsmpl;
+	lay->dual  = dual;
+
+	/* at most 15 nibbles (the last one holds SIS8300_VALIDATE_SEL_QUIET) */
+	for ( i = 0; (ch = (sel & 0xf)); i++, sel >>= 4 ) {
+		bit = 1 << (ch - 1);
+		if ( ! (bit & valid) ) {
+			if ( ! quiet )
+				fprintf(stderr,"channel # %i in selector pos %i too big (1..%i)\n", ch, i, 32 - __builtin_clz( valid ));
 			return -1;
 		}
-		i++;
-		s >>= 4;
-		for ( j=i, t=s; (k = t & 0xf); ) {
-			if ( k == n ) {
-				if ( ! (sel & SIS8300_VALIDATE_SEL_QUIET) )
-					fprintf(stderr,"channel # %i duplicated in selector pos %i\n", n, j);
+		if ( (bit & lay->mask) ) {
+			if ( ! quiet )
+				fprintf(stderr,"channel # %i duplicated in selector pos %i\n", ch, i);
+			return -1;
+		}
+		lay->mask       |= bit;
+		lay->chnl[i]     = ch;
+		lay->blk[ch - 1] = i;
+		lay->off[ch - 1] = (size_t)i * nsmpl;
+	}
+	lay->nch = i;
+	lay->sz  = (size_t)lay->nch * nsmpl * sizeof(int16_t);
+	lay->dsz = lay->sz;
+
+	/* dual-channel firmware: whole pairs, lower channel first */
+	if ( dual ) {
+		for ( i = 0; i < lay->nch; i += 2 ) {
+			if ( ! (lay->chnl[i] & 1) || i + 1 >= lay->nch || lay->chnl[i + 1] != lay->chnl[i] + 1 ) {
+				if ( ! quiet )
+					fprintf(stderr,"dual-channel firmware needs whole channel pairs (e.g., 0x4321)\n");
 				return -1;
 			}
-			j++;
-			t >>= 4;
 		}
 	}
 	return 0;
 }
 
+int
+sis8300DigiLayoutInit(Sis8300Layout lay, int fd, Sis8300ChannelSel sel, unsigned nsmpl)
+{
+uint32_t    valid = (1 << SIS8300_MAX_CHANNELS) - 1;
+int         dual  = 0;
+DevStateRec st;
+
+	if ( fd >= 0 ) {
+		/* capabilities recorded by sis8300DigiSetup() spare the register reads */
+		dev_state_get( fd, &st );
+		if ( st.chvalid ) {
+			valid = st.chvalid;
+		} else {
+			if ( check_fd( fd, (sel & SIS8300_VALIDATE_SEL_QUIET) ? 0 : "sis8300DigiLayoutInit" ) )
+				return -1;
+			if ( is_8_channel_firmware( fd ) )
+				valid = (1 << 8) - 1;
+		}
+		dual = st.dual;
+	}
+	return layout_init( lay, sel, nsmpl, valid, dual );
+}
+
+int
+sis8300DigiLayoutAlign(Sis8300Layout lay, size_t align)
+{
+size_t   blk = (size_t)lay->nsmpl * sizeof(int16_t);
+size_t   msk, pos;
+unsigned i;
+int      ch;
+
+	if ( align && ((align & (align - 1)) || align < 16 * sizeof(int16_t) || align > SIS8300_DIGI_MEM_SIZE) ) {
+		fprintf(stderr,"sis8300DigiLayoutAlign: alignment must be 0 or a power of two (32..%lu)\n", (unsigned long)SIS8300_DIGI_MEM_SIZE);
+		return -1;
+	}
+	msk = align ? align - 1 : 0;
+
+	/* with dual-channel firmware the pair's buffer (2 * nsmpl interleaved
+	 * samples at the first channel's address) still fits since the second
+	 * block starts no earlier than where it would if packed.
+	 */
+	for ( i = 0, pos = 0; i < lay->nch; i++ ) {
+		ch  = lay->chnl[i] - 1;
+		pos = (pos + msk) & ~msk;
+		lay->off[ch] = pos / sizeof(int16_t);
+		pos += blk;
+	}
+	lay->dsz = pos;
+	pos = (pos + msk) & ~msk;
+
+	if ( pos > SIS8300_DIGI_MEM_SIZE ) {
+		fprintf(stderr,"sis8300DigiLayoutAlign: aligned image exceeds board memory\n");
+		return -1;
+	}
+
+	lay->align = align;
+	lay->sz    = pos;
+	lay->pad   = pos - lay->nch * blk;
+	return 0;
+}
+
+int
+sis8300DigiValidateSel(int fd, Sis8300ChannelSel sel)
+{
+Sis8300LayoutRec lay;
+
+	if ( check_fd( fd, "sis8300DigiValidateSel" ) )
+		return -1;
+
+	return sis8300DigiLayoutInit( &lay, fd, sel, 0 );
+}
+
 /* channel_selector defines the order (and number) of channels in memory.
  * E.g., to have channels 4, 1, 8, 9 in this order in memory set 
  * 'channel_selector' = (9 << 12) | (8 << 8) | (1 << 4) | (4 << 0)
@@ -1254,39 +1440,531 @@ Sis8300ChannelSel s,t;
 int
 sis8300DigiSetCount(int fd, Sis8300ChannelSel channel_selector, unsigned nsmpl)
 {
-int      n,ch;
-int      nblks;
-uint32_t cmd;
+Sis8300LayoutRec lay;
 
 	if ( nsmpl & 0xf ) {
 		return -1;
 	}
 
 	/* check_fd is performed by this routine */
-	if ( sis8300DigiValidateSel(fd, channel_selector) ) {
+	if ( sis8300DigiLayoutInit( &lay, fd, channel_selector, nsmpl ) ) {
 		return -1;
 	}
 
-	channel_selector &= ~ SIS8300_VALIDATE_SEL_QUIET;
+	return sis8300DigiSetCountLayout( fd, &lay );
+}
 
-	nblks = (nsmpl >> 4);
+int
+sis8300DigiSetCountLayout(int fd, Sis8300Layout lay)
+{
+Sis8300CountCfgRec cfg;
 
-	rwr(fd, SIS8300_SAMPLE_LENGTH_REG,    nblks - 1);
+	if ( sis8300DigiCountPrepare( fd, lay, &cfg ) )
+		return -1;
+	return sis8300DigiCountCommit( fd, &cfg );
+}
 
-	cmd  = rrd(fd, SIS8300_SAMPLE_CONTROL_REG);
-	cmd |= 0x3ff;
+/* The trigger sample must be inside the window */
+static int
+pretrig_chk(unsigned npre, unsigned nsmpl, const char *p)
+{
+	if ( npre >= nsmpl ) {
+		fprintf(stderr,"%s: pretrigger (%u samples) must be shorter than the window (%u samples)\n", p, npre, nsmpl);
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int
+sis8300DigiCountPrepare(int fd, Sis8300Layout lay, Sis8300CountCfg cfg)
+{
+unsigned i, step;
+int      ch;
 
-	/* Sample to contiguous memory area */
-	for ( n=0; (ch = (channel_selector & 0xf)); n+=nblks, channel_selector >>= 4 ) {
-		ch--;
-		rwr(fd, SIS8300_SAMPLE_START_ADDRESS_CH1_REG + ch, n);
-		cmd &= ~(1<<ch);
+	if ( lay->nsmpl & 0xf ) {
+		return -1;
 	}
 
-	rwr(fd, SIS8300_SAMPLE_CONTROL_REG, cmd);
+	if ( pretrig_chk( sis8300DigiGetPretrigger( fd ), lay->nsmpl, "sis8300DigiCountPrepare" ) )
+		return -1;
+
+	if ( lay->dual != sis8300DigiIsDualChannel( fd ) ) {
+		fprintf(stderr,"sis8300DigiCountPrepare: layout not built for this device\n");
+		return -1;
+	}
+
+	cfg->len   = (lay->nsmpl >> 4) - 1;
+	cfg->ena   = 0;
+	cfg->amask = 0;
+
+	/* Sample to contiguous memory area; with dual-channel firmware a pair's
+	 * buffer holds both channels and its address register is the first channel's.
+	 */
+	step = lay->dual ? 2 : 1;
+	for ( i = 0; i < lay->nch; i += step ) {
+		ch = lay->chnl[i] - 1;
+		cfg->addr[ch]  = lay->off[ch] >> 4;
+		cfg->amask    |= (1 << ch);
+		cfg->ena      |= ((1 << step) - 1) << ch;
+	}
+	return 0;
+}
+
+int
+sis8300DigiCountCommit(int fd, Sis8300CountCfg cfg)
+{
+DevStateRec tmp;
+DevState    ds;
+sis8300_reg r;
+uint32_t    ctl;
+int         ch;
+int         rval = -1;
+
+	pthread_mutex_lock( &dev_state_mtx );
+
+	if ( ! (ds = dev_state_find( fd, 1 )) ) {
+		/* no cache; write everything */
+		memset( &tmp, 0, sizeof(tmp) );
+		ds = &tmp;
+	}
+
+	if ( ! (ds->cfg_known & CFG_CTL) ) {
+		r.offset = SIS8300_SAMPLE_CONTROL_REG;
+		if ( ioctl(fd, SIS8300_REG_READ, &r) ) {
+			fprintf(stderr,"sis8300DigiCountCommit: invalid file descriptor: %s\n", strerror(errno));
+			goto bail;
+		}
+		ds->ctl        = r.data;
+		ds->cfg_known |= CFG_CTL;
+	}
+
+	/* a failed write leaves the register unknown */
+	if ( ! (ds->cfg_known & CFG_LEN) || ds->cfg.len != cfg->len ) {
+		ds->cfg_known &= ~CFG_LEN;
+		if ( rwr_chk(fd, SIS8300_SAMPLE_LENGTH_REG, cfg->len) )
+			goto bail;
+		ds->cfg.len    = cfg->len;
+		ds->cfg_known |= CFG_LEN;
+	}
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( ! (cfg->amask & (1 << ch)) )
+			continue;
+		if ( (ds->cfg.amask & (1 << ch)) && ds->cfg.addr[ch] == cfg->addr[ch] )
+			continue;
+		ds->cfg.amask &= ~(1 << ch);
+		if ( rwr_chk(fd, SIS8300_SAMPLE_START_ADDRESS_CH1_REG + ch, cfg->addr[ch]) )
+			goto bail;
+		ds->cfg.addr[ch]  = cfg->addr[ch];
+		ds->cfg.amask    |= (1 << ch);
+	}
+
+	ctl = (ds->ctl | 0x3ff) & ~cfg->ena;
+	if ( ctl != ds->ctl ) {
+		ds->cfg_known &= ~CFG_CTL;
+		if ( rwr_chk(fd, SIS8300_SAMPLE_CONTROL_REG, ctl) )
+			goto bail;
+		ds->ctl        = ctl;
+		ds->cfg_known |= CFG_CTL;
+	}
+
+	rval = 0;
+
+bail:
+	pthread_mutex_unlock( &dev_state_mtx );
+	return rval;
+}
+
+int
+sis8300DigiSelNumChannels(Sis8300ChannelSel sel)
+{
+int n;
+	sel &= ~SIS8300_VALIDATE_SEL_QUIET;
+	for ( n=0; (sel & 0xf); sel >>= 4 )
+		n++;
+	return n;
+}
+
+size_t
+sis8300DigiFrameSize(Sis8300ChannelSel sel, unsigned nsmpl)
+{
+	return (size_t)sis8300DigiSelNumChannels( sel ) * (size_t)nsmpl * sizeof(int16_t);
+}
+
+int
+sis8300DigiFrameSetup(Sis8300Frame frame, int kind, Sis8300ChannelSel sel, unsigned nsmpl, const void *data)
+{
+Sis8300LayoutRec lay;
+
+	if ( layout_init( &lay, sel | SIS8300_VALIDATE_SEL_QUIET, nsmpl, (1 << SIS8300_MAX_CHANNELS) - 1, 0 ) ) {
+		fprintf(stderr,"sis8300DigiFrameSetup: invalid channel selector\n");
+		return -1;
+	}
+	sis8300DigiFrameSetupLayout( frame, kind, &lay, data );
+	return 0;
+}
+
+void
+sis8300DigiFrameSetupLayout(Sis8300Frame frame, int kind, Sis8300Layout lay, const void *data)
+{
+const int16_t *p = data;
+int            i;
+
+	frame->kind  = kind;
+	frame->sel   = lay->sel;
+	frame->nsmpl = lay->nsmpl;
+	frame->nch   = lay->nch;
+	frame->trig  = 0;
+	frame->data  = p;
+	frame->seq   = 0;
+	frame->ts.tv_sec  = 0;
+	frame->ts.tv_nsec = 0;
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ )
+		frame->chnl[i] = (lay->mask & (1 << i)) ? p + lay->off[i] : 0;
+}
+
+/* Read 'sz' bytes of sample memory starting at offset 'off' */
+static int
+read_full(int fd, void *buf, size_t sz, off_t off, const char *nm)
+{
+size_t  got;
+ssize_t put;
+
+	for ( got = 0; got < sz; got += put ) {
+		put = pread( fd, (char*)buf + got, sz - got, off + got );
+		if ( put < 0 ) {
+			if ( EINTR == errno ) {
+				put = 0;
+				continue;
+			}
+			fprintf(stderr,"%s: read failed: %s\n", nm, strerror(errno));
+			return -1;
+		}
+		if ( 0 == put ) {
+			fprintf(stderr,"%s: short read (%lu of %lu bytes)\n", nm, (unsigned long)got, (unsigned long)sz);
+			errno = EIO;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Dual-channel firmware: read() blocks until the armed DMA is done and
+ * consumes it, so the entire interleaved image must be read at once. It
+ * goes into a bounce buffer (per thread; kept for the next readout) from
+ * which the pairs are split into the channel blocks.
+ */
+static pthread_key_t  bounce_key;
+static pthread_once_t bounce_once = PTHREAD_ONCE_INIT;
+
+typedef struct BounceRec_ {
+	size_t             sz;
+	void              *buf;
+} BounceRec, *Bounce;
+
+static void
+bounce_free(void *arg)
+{
+Bounce b = arg;
+	free( b->buf );
+	free( b );
+}
+
+static void
+bounce_init(void)
+{
+	pthread_key_create( &bounce_key, bounce_free );
+}
+
+static void *
+bounce_get(size_t sz)
+{
+Bounce b;
+void  *p;
+
+	pthread_once( &bounce_once, bounce_init );
+	if ( ! (b = pthread_getspecific( bounce_key )) ) {
+		if ( ! (b = calloc( 1, sizeof(*b) )) )
+			return 0;
+		if ( pthread_setspecific( bounce_key, b ) ) {
+			free( b );
+			return 0;
+		}
+	}
+	if ( b->sz < sz ) {
+		if ( posix_memalign( &p, 4096, sz ) )
+			return 0;
+		free( b->buf );
+		b->buf = p;
+		b->sz  = sz;
+	}
+	return b->buf;
+}
+
+static int
+read_dual(int fd, Sis8300Layout lay, void *buf)
+{
+const int16_t *tmp;
+int16_t       *a, *b;
+unsigned       i;
+int            ch;
+
+	if ( ! (tmp = bounce_get( lay->dsz )) ) {
+		fprintf(stderr,"sis8300DigiReadout: no memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+	if ( read_full( fd, (void*)tmp, lay->dsz, 0, "sis8300DigiReadout" ) )
+		return -1;
+
+	/* the pair's buffer is at the first channel's offset */
+	for ( i = 0; i < lay->nch; i += 2 ) {
+		ch = lay->chnl[i] - 1;
+		a  = (int16_t*)buf + lay->off[ch];
+		b  = (int16_t*)buf + lay->off[ch + 1];
+		sis8300DspDeinterleave( a, b, tmp + lay->off[ch], lay->nsmpl );
+	}
+	return 0;
+}
+
+static int
+readout(int fd, int kind, Sis8300Layout lay, DevState st, void *buf, size_t bufsz, Sis8300Frame frame)
+{
+	if ( 0 == lay->sz || lay->sz > bufsz ) {
+		fprintf(stderr,"sis8300DigiReadout: buffer too small (need %lu bytes)\n", (unsigned long)lay->sz);
+		errno = EINVAL;
+		return -1;
+	}
+	/* the pretrigger may have changed since sis8300DigiSetCount() */
+	if ( pretrig_chk( st->npre, lay->nsmpl, "sis8300DigiReadout" ) )
+		return -1;
+
+	sis8300DigiFrameSetupLayout( frame, kind, lay, buf );
+	frame->trig = st->npre;
+
+	/* read() blocks until the DMA is done; channel blocks start at offset 0.
+	 * Trailing padding (aligned layouts) is not transferred.
+	 */
+	if ( lay->dual ) {
+		if ( read_dual( fd, lay, buf ) )
+			return -1;
+	} else {
+		if ( read_full( fd, buf, lay->dsz, 0, "sis8300DigiReadout" ) )
+			return -1;
+	}
+	clock_gettime( CLOCK_REALTIME, &frame->ts );
 	return 0;
 }
 
+int
+sis8300DigiReadout(int fd, int kind, Sis8300ChannelSel sel, unsigned nsmpl, void *buf, size_t bufsz, Sis8300Frame frame)
+{
+Sis8300LayoutRec lay;
+DevStateRec      st;
+
+	dev_state_get( fd, &st );
+
+	if ( layout_init( &lay, sel | SIS8300_VALIDATE_SEL_QUIET, nsmpl, (1 << SIS8300_MAX_CHANNELS) - 1, st.dual ) ) {
+		fprintf(stderr,"sis8300DigiReadout: invalid channel selector\n");
+		errno = EINVAL;
+		return -1;
+	}
+	return readout( fd, kind, &lay, &st, buf, bufsz, frame );
+}
+
+int
+sis8300DigiReadoutLayout(int fd, int kind, Sis8300Layout lay, void *buf, size_t bufsz, Sis8300Frame frame)
+{
+DevStateRec st;
+
+	dev_state_get( fd, &st );
+	return readout( fd, kind, lay, &st, buf, bufsz, frame );
+}
+
+/* Acquisition control/status register (SIS8300_ACQUISITION_CONTROL_STATUS_REG)
+ * bits as described in the Struck SIS8300 user manual ("Acquisition
+ * control/status register"); the driver header does not define them.
+ * Bit 0 starts sampling at once (software trigger) -- a record must be
+ * armed with bit 1 to wait for the trigger. sis8300DigiSetup() writes
+ * the reset (bit 2).
+ */
+#define ACQ_CTRL_START   (1<<0) /* write: start sampling now (not used)      */
+#define ACQ_CTRL_ARM     (1<<1) /* write: arm sample logic (start on trigger) */
+#define ACQ_CTRL_RESET   (1<<2) /* write: reset sample logic                 */
+#define ACQ_STAT_BUSY    (1<<0) /* read:  sampling in progress               */
+#define ACQ_STAT_ARMED   (1<<1) /* read:  armed, waiting for trigger         */
+
+/* seg_wait() polls with exponential backoff between these (ns) */
+#define SEG_POLL_MIN      2000
+#define SEG_POLL_MAX   1000000
+
+/* Program the start addresses for the channel blocks of a record at
+ * block address 'base' (same layout as sis8300DigiSetCount()).
+ */
+static int
+seg_set_addr(int fd, Sis8300Layout lay, uint32_t base)
+{
+sis8300_reg r;
+unsigned    i;
+int         ch;
+
+	for ( i = 0; i < lay->nch; i++ ) {
+		ch       = lay->chnl[i] - 1;
+		r.offset = SIS8300_SAMPLE_START_ADDRESS_CH1_REG + ch;
+		r.data   = base + (lay->off[ch] >> 4);
+		if ( ioctl(fd, SIS8300_REG_WRITE, &r) )
+			return -1;
+	}
+	return 0;
+}
+
+/* Addresses are no longer what sis8300DigiCountCommit() wrote */
+static void
+dev_cfg_forget(int fd)
+{
+DevState ds;
+
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 0 )) )
+		ds->cfg.amask = 0;
+	pthread_mutex_unlock( &dev_state_mtx );
+}
+
+/* Wait (up to 'timeout_ms') for the sample logic to complete a
+ * (register-armed) record. Records are short, so the first polls are
+ * close together; the interval then backs off so that a missing trigger
+ * doesn't keep a CPU busy with register reads.
+ */
+static int
+seg_wait(int fd, int timeout_ms)
+{
+sis8300_reg     r;
+struct timespec now, end, dly;
+long            ns = SEG_POLL_MIN;
+
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	end.tv_sec  += timeout_ms / 1000;
+	end.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if ( end.tv_nsec >= 1000000000L ) {
+		end.tv_nsec -= 1000000000L;
+		end.tv_sec++;
+	}
+
+	r.offset = SIS8300_ACQUISITION_CONTROL_STATUS_REG;
+	for (;;) {
+		if ( ioctl(fd, SIS8300_REG_READ, &r) )
+			return -1;
+		if ( ! (r.data & (ACQ_STAT_BUSY | ACQ_STAT_ARMED)) )
+			return 0;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		if ( now.tv_sec > end.tv_sec || (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec) ) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		dly.tv_sec  = 0;
+		dly.tv_nsec = ns;
+		nanosleep( &dly, 0 );
+		if ( (ns *= 2) > SEG_POLL_MAX )
+			ns = SEG_POLL_MAX;
+	}
+}
+
+int
+sis8300DigiReadoutSegments(int fd, Sis8300ChannelSel sel, unsigned nsmpl, unsigned nrec, int timeout_ms, void *buf, size_t bufsz, Sis8300Frame frames)
+{
+Sis8300LayoutRec lay;
+
+	if ( layout_init( &lay, sel | SIS8300_VALIDATE_SEL_QUIET, nsmpl, (1 << SIS8300_MAX_CHANNELS) - 1, 0 ) ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: invalid geometry\n");
+		errno = EINVAL;
+		return -1;
+	}
+	return sis8300DigiReadoutSegmentsLayout( fd, &lay, nrec, timeout_ms, buf, bufsz, frames );
+}
+
+int
+sis8300DigiReadoutSegmentsLayout(int fd, Sis8300Layout lay, unsigned nrec, int timeout_ms, void *buf, size_t bufsz, Sis8300Frame frames)
+{
+size_t           sz;
+uint32_t         rec_blks;
+unsigned         r, npre;
+sis8300_reg      arm;
+int              rval = -1;
+
+	if ( lay->dual || sis8300DigiIsDualChannel( fd ) ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: not supported with dual-channel firmware\n");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	if ( 0 == (sz = lay->sz) || 0 == nrec || (lay->nsmpl & 0xf) ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: invalid geometry\n");
+		errno = EINVAL;
+		return -1;
+	}
+	/* the sample logic is polled; waiting forever is not an option */
+	if ( timeout_ms < 0 ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: timeout must not be negative\n");
+		errno = EINVAL;
+		return -1;
+	}
+	if ( sz > SIS8300_DIGI_MEM_SIZE / nrec ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: records exceed board memory\n");
+		errno = EINVAL;
+		return -1;
+	}
+	if ( sz * nrec > bufsz ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: buffer too small (need %lu bytes)\n", (unsigned long)(sz * nrec));
+		errno = EINVAL;
+		return -1;
+	}
+	npre = sis8300DigiGetPretrigger( fd );
+	if ( pretrig_chk( npre, lay->nsmpl, "sis8300DigiReadoutSegments" ) )
+		return -1;
+	for ( r = 0; r < nrec; r++ )
+		sis8300DigiFrameSetupLayout( &frames[r], SIS8300_KIND_BEAM, lay, (char*)buf + r * sz );
+
+	rec_blks   = sz >> 5; /* 16-sample blocks */
+	arm.offset = SIS8300_ACQUISITION_CONTROL_STATUS_REG;
+	arm.data   = ACQ_CTRL_ARM;
+
+	/* intermediate records: sampling only */
+	for ( r = 0; r < nrec - 1; r++ ) {
+		if (    seg_set_addr( fd, lay, r * rec_blks )
+		     || ioctl( fd, SIS8300_REG_WRITE, &arm )
+		     || seg_wait( fd, timeout_ms ) ) {
+			fprintf(stderr,"sis8300DigiReadoutSegments: record %u failed: %s\n", r, strerror(errno));
+			goto bail;
+		}
+		/* as close to the trigger as polling gets */
+		clock_gettime( CLOCK_REALTIME, &frames[r].ts );
+	}
+
+	/* last record: armed for DMA which then transfers everything */
+	if (    seg_set_addr( fd, lay, r * rec_blks )
+	     || sis8300DigiArm( fd, SIS8300_KIND_BEAM ) ) {
+		fprintf(stderr,"sis8300DigiReadoutSegments: arming failed: %s\n", strerror(errno));
+		goto bail;
+	}
+
+	/* all but the last record's trailing padding */
+	if ( read_full( fd, buf, sz * (nrec - 1) + lay->dsz, 0, "sis8300DigiReadoutSegments" ) )
+		goto bail;
+
+	/* the last record completes with the DMA */
+	clock_gettime( CLOCK_REALTIME, &frames[nrec - 1].ts );
+	for ( r = 0; r < nrec; r++ )
+		frames[r].trig = npre;
+	rval = 0;
+
+bail:
+	/* back to the layout of sis8300DigiSetCount() */
+	if ( seg_set_addr( fd, lay, 0 ) )
+		dev_cfg_forget( fd );
+	return rval;
+}
+
 void
 sis8300DigiSetSim(int fd, int32_t a, int32_t b, int32_t c, int32_t d, int quiet)
 {
@@ -1344,6 +2022,32 @@ int    fd = (intptr_t)device;
 	return 0;
 }
 
+/* Raw write to a register cached by sis8300DigiCountCommit(): the cache
+ * no longer tells what the hardware has.
+ */
+static void
+dev_cfg_reg(int fd, unsigned reg)
+{
+DevState ds;
+
+	if (    SIS8300_SAMPLE_CONTROL_REG != reg
+	     && SIS8300_SAMPLE_LENGTH_REG  != reg
+	     && (   reg <  SIS8300_SAMPLE_START_ADDRESS_CH1_REG
+	         || reg >= SIS8300_SAMPLE_START_ADDRESS_CH1_REG + SIS8300_MAX_CHANNELS ) )
+		return;
+
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 0 )) ) {
+		if ( SIS8300_SAMPLE_CONTROL_REG == reg )
+			ds->cfg_known &= ~CFG_CTL;
+		else if ( SIS8300_SAMPLE_LENGTH_REG == reg )
+			ds->cfg_known &= ~CFG_LEN;
+		else
+			ds->cfg.amask &= ~(1 << (reg - SIS8300_SAMPLE_START_ADDRESS_CH1_REG));
+	}
+	pthread_mutex_unlock( &dev_state_mtx );
+}
+
 int
 sis8300DigiReadReg(int fd, unsigned reg, uint32_t *val_p)
 {
@@ -1359,6 +2063,10 @@ int
 sis8300DigiWriteReg(int fd, unsigned reg, uint32_t val)
 {
 sis8300_reg r;
+	/* validated and recorded (frame->trig must match the hardware) */
+	if ( SIS8300_PRETRIGGER_DELAY_REG == reg )
+		return sis8300DigiSetPretrigger( fd, val );
+	dev_cfg_reg( fd, reg );
 	r.offset = reg;
 	r.data   = val;
 	return ioctl(fd, SIS8300_REG_WRITE, &r);
@@ -1444,6 +2152,87 @@ sis8300DigiGet9510Clkhl(unsigned ratio)
 	return (ratio<<4) | ratio;
 }
 
+int
+sis8300DigiGetAdcFormat(int fd)
+{
+int chip_id;
+
+	if ( check_fd( fd, "sis8300DigiGetAdcFormat" ) )
+		return -1;
+
+	chip_id = adc_rd(fd, 0, 0x01);
+
+	switch ( chip_id ) {
+		case 0x32: /* AD9268 */
+			return SIS8300_ADC_FMT_16;
+
+		case 0x82: /* AD9643 */
+			/* left-adjusted by shift_adc_bits() if the firmware supports it */
+			if ( 0x10 == (rrd(fd, SIS8300_USER_CONTROL_STATUS_REG) & 0x30) )
+				return SIS8300_ADC_FMT_16;
+			return SIS8300_ADC_FMT_14_RJ;
+
+		default:
+			break;
+	}
+	fprintf(stderr,"sis8300DigiGetAdcFormat: unknown ADC chip (ID 0x%02x)\n", chip_id);
+	return -1;
+}
+
+unsigned long
+sis8300DigiGetFclk(int fd)
+{
+DevState      ds;
+unsigned long fclk = 0;
+
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 0 )) )
+		fclk = ds->fclk;
+	pthread_mutex_unlock( &dev_state_mtx );
+
+	return fclk;
+}
+
+int
+sis8300DigiSetPretrigger(int fd, unsigned npre)
+{
+DevState ds;
+
+	if ( check_fd( fd, "sis8300DigiSetPretrigger" ) )
+		return -1;
+
+	if ( (npre & 0xf) || npre > SIS8300_PRETRIGGER_MAX ) {
+		fprintf(stderr,"sis8300DigiSetPretrigger: must be a multiple of 16 <= %u\n", SIS8300_PRETRIGGER_MAX);
+		return -1;
+	}
+
+	if ( rwr_chk(fd, SIS8300_PRETRIGGER_DELAY_REG, npre) )
+		return -1;
+
+	pthread_mutex_lock( &dev_state_mtx );
+	if ( (ds = dev_state_find( fd, 1 )) )
+		ds->npre = npre;
+	pthread_mutex_unlock( &dev_state_mtx );
+
+	return ds ? 0 : -1;
+}
+
+unsigned
+sis8300DigiGetPretrigger(int fd)
+{
+DevStateRec st;
+	dev_state_get( fd, &st );
+	return st.npre;
+}
+
+int
+sis8300DigiIsDualChannel(int fd)
+{
+DevStateRec st;
+	dev_state_get( fd, &st );
+	return st.dual;
+}
+
 /* Set tap delay for fclk (Hz) -- it SUCKS that we have to to this */
 void
 sis8300DigiSetTapDelay(int fd, unsigned long fclk)
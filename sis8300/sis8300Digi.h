@@ -2,6 +2,8 @@
 #define SIS8300DIGI_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <time.h>
 
 #define SIS8300_KIND_OFF  (-1)
 #define SIS8300_KIND_BEAM 0
@@ -10,6 +12,8 @@
 
 typedef uint64_t Sis8300ChannelSel;
 
+#define SIS8300_MAX_CHANNELS 10
+
 typedef struct Si5326Parms_ {
 	unsigned long fin;
 	unsigned n3, n2h, n2l, n1h, nc;
@@ -141,9 +145,307 @@ sis8300DigiValidateSel(int fd, Sis8300ChannelSel sel);
 int
 sis8300DigiSetCount(int fd, Sis8300ChannelSel channel_selector, unsigned nsmpl);
 
+/* Record 'npre' samples (per channel) preceding the trigger. As the
+ * sample count 'npre' must be a multiple of 16; the window given to
+ * sis8300DigiSetCount() includes the pretrigger samples. Readout reports
+ * the index of the trigger sample (Sis8300FrameRec 'trig'; == npre).
+ * sis8300DigiSetup() resets the pretrigger to zero. Takes effect with
+ * the next acquisition armed (zero-copy maps pick it up when arming, the
+ * acquisition engine when started). The pretrigger must be shorter than
+ * the window; sis8300DigiCountPrepare() and readout fail (EINVAL)
+ * otherwise.
+ *
+ * RETURNS: 0 on success, -1 on error (invalid 'npre' or the register
+ *          write failed).
+ */
+#define SIS8300_PRETRIGGER_MAX 2032
+
+int
+sis8300DigiSetPretrigger(int fd, unsigned npre);
+
+/* RETURNS: pretrigger samples last set for the device 'fd' refers to */
+unsigned
+sis8300DigiGetPretrigger(int fd);
+
 int
 sis8300DigiArm(int fd, int kind);
 
+/* Driver read mode which arms for 'kind' (SIS8300_KIND_OFF or an invalid
+ * kind disarm). Modes may be computed ahead of time and armed with
+ * sis8300DigiArmMode() which is then just the ioctl.
+ */
+int
+sis8300DigiReadMode(int kind);
+
+int
+sis8300DigiArmMode(int fd, int mode);
+
+/* Readout of samples.
+ *
+ * After sis8300DigiSetCount() the samples of the selected channels
+ * are laid out in memory as contiguous blocks of 'nsmpl' samples each,
+ * in the order defined by the channel selector. A 'frame' describes
+ * such a memory image (after it has been read into user memory).
+ */
+typedef struct Sis8300FrameRec_ {
+	int                kind;    /* SIS8300_KIND_xxx the acquisition was armed for */
+	Sis8300ChannelSel  sel;     /* channel selector (memory layout)               */
+	unsigned           nsmpl;   /* samples per channel                            */
+	unsigned           nch;     /* number of channels in 'sel'                    */
+	unsigned           trig;    /* index of the trigger sample (pretrigger)       */
+	const int16_t     *data;    /* memory image (channel blocks; see chnl[])      */
+	/* samples of channel # 'ch' are at chnl[ch-1]; NULL if not selected  */
+	const int16_t     *chnl[SIS8300_MAX_CHANNELS];
+	uint64_t           seq;     /* sequence number (acquisition engine; else 0)   */
+	struct timespec    ts;      /* time when readout completed (CLOCK_REALTIME)   */
+} Sis8300FrameRec, *Sis8300Frame;
+
+/* Number of channels in a selector */
+int
+sis8300DigiSelNumChannels(Sis8300ChannelSel sel);
+
+/* Size (in bytes) of the memory image for a given selector and number
+ * of samples per channel.
+ */
+size_t
+sis8300DigiFrameSize(Sis8300ChannelSel sel, unsigned nsmpl);
+
+/* Fill a frame descriptor for a memory image at 'data'.
+ *
+ * RETURNS: 0 on success, -1 if the selector is invalid (channel # out
+ *          of range or duplicate).
+ */
+int
+sis8300DigiFrameSetup(Sis8300Frame frame, int kind, Sis8300ChannelSel sel, unsigned nsmpl, const void *data);
+
+/* Channel layout.
+ *
+ * A layout is decoded once from a selector (and the capabilities of the
+ * device) and answers all questions about the memory image by table
+ * lookup: where the block of a channel is, which channel a block holds
+ * and whether a channel is present (bitmask). It is a plain structure
+ * (no resources) and may be used wherever a selector/sample count pair
+ * is expected by the ...Layout() variants below.
+ */
+typedef struct Sis8300LayoutRec_ {
+	Sis8300ChannelSel  sel;     /* selector (without SIS8300_VALIDATE_SEL_QUIET)  */
+	unsigned           nsmpl;   /* samples per channel                            */
+	unsigned           nch;     /* number of channels                             */
+	uint32_t           mask;    /* bit ch-1 set if channel # ch is present        */
+	int                dual;    /* dual-channel firmware (sis8300DigiIsDualChannel()) */
+	size_t             sz;      /* size of the memory image (bytes)               */
+	size_t             align;   /* block alignment (bytes); 0: packed             */
+	size_t             pad;     /* bytes of 'sz' which are padding                */
+	size_t             dsz;     /* bytes up to the end of the last block (what a
+	                             * readout transfers; 'sz' minus trailing padding) */
+	int8_t             blk[SIS8300_MAX_CHANNELS];  /* [ch-1]: block # of channel # ch; -1 if absent */
+	uint8_t            chnl[SIS8300_MAX_CHANNELS]; /* [i]: channel # in block i (i < nch)       */
+	size_t             off[SIS8300_MAX_CHANNELS];  /* [ch-1]: first sample of channel # ch      */
+} Sis8300LayoutRec, *Sis8300Layout;
+
+/* Decode 'sel' (the 'nsmpl' samples per channel need not be a multiple of 16
+ * unless the layout is given to sis8300DigiSetCountLayout()). If 'fd' is
+ * nonnegative then the selector is checked against the capabilities of
+ * the device (number of channels, channel pairs with dual-channel firmware);
+ * otherwise channel #s 1..SIS8300_MAX_CHANNELS are accepted.
+ * Errors are reported on stderr unless SIS8300_VALIDATE_SEL_QUIET is set.
+ *
+ * RETURNS: 0 on success, -1 if the selector is invalid.
+ */
+int
+sis8300DigiLayoutInit(Sis8300Layout lay, int fd, Sis8300ChannelSel sel, unsigned nsmpl);
+
+/* Align the channel blocks of a layout (built by sis8300DigiLayoutInit())
+ * so that each starts on a multiple of 'align' bytes of the memory image,
+ * e.g., a cache line or a (huge) page. 'align' is a power of two >= 32
+ * (the granularity of the start address registers) or 0 (packed, which is
+ * what sis8300DigiLayoutInit() produces). The image size is rounded up to
+ * the alignment as well so that consecutive images (buffers, segmented
+ * records) stay aligned; lay->pad reports the bytes lost to padding. The
+ * trailing padding is never transferred (lay->dsz).
+ *
+ * Aligned blocks are only aligned in memory if the buffer is (at least
+ * as strictly); an aligned layout must be used with the ...Layout()
+ * variants throughout (sis8300DigiFrameSize() etc. assume packed blocks).
+ *
+ * RETURNS: 0 on success, -1 on error (invalid alignment or the image
+ *          exceeds the board memory).
+ */
+#define SIS8300_ALIGN_CACHELINE       64
+#define SIS8300_ALIGN_PAGE          4096
+#define SIS8300_ALIGN_HUGEPAGE (2UL*1024UL*1024UL)
+
+int
+sis8300DigiLayoutAlign(Sis8300Layout lay, size_t align);
+
+/* Same as sis8300DigiSetCount() (the layout must have been built for 'fd');
+ * equivalent to sis8300DigiCountPrepare() followed by sis8300DigiCountCommit().
+ */
+int
+sis8300DigiSetCountLayout(int fd, Sis8300Layout lay);
+
+/* Incremental reconfiguration.
+ *
+ * The acquisition registers a layout requires (sample length, start
+ * addresses, channel enables) are computed by sis8300DigiCountPrepare()
+ * without touching the hardware. sis8300DigiCountCommit() compares them
+ * with what was last applied to the device and only writes registers
+ * which differ (e.g., changing 'nsmpl' alone is a single register write).
+ *
+ * A new configuration may thus be prepared while an acquisition is in
+ * flight and committed after its readout, before the device is armed
+ * again. The registers must not be changed while the device is armed.
+ *
+ * The applied configuration is cached per device (shared by all file
+ * descriptors); it is assumed that nobody else writes these registers.
+ * sis8300DigiSetup() resets the cache.
+ */
+typedef struct Sis8300CountCfgRec_ {
+	uint32_t           len;     /* sample length register                         */
+	uint32_t           ena;     /* bit ch-1 set if channel # ch samples           */
+	uint32_t           amask;   /* bit ch-1 set if addr[ch-1] is used             */
+	uint32_t           addr[SIS8300_MAX_CHANNELS]; /* start addresses (16-sample blocks) */
+} Sis8300CountCfgRec, *Sis8300CountCfg;
+
+/* RETURNS: 0 on success, -1 if the layout is not valid for 'fd' */
+int
+sis8300DigiCountPrepare(int fd, Sis8300Layout lay, Sis8300CountCfg cfg);
+
+/* RETURNS: 0 on success, -1 on error (register access failed) */
+int
+sis8300DigiCountCommit(int fd, Sis8300CountCfg cfg);
+
+/* Same as sis8300DigiFrameSetup() but cannot fail */
+void
+sis8300DigiFrameSetupLayout(Sis8300Frame frame, int kind, Sis8300Layout lay, const void *data);
+
+/* Wait for an acquisition (armed with sis8300DigiArm( fd, kind ))
+ * to complete and read the samples into 'buf' (which must hold at
+ * least sis8300DigiFrameSize( sel, nsmpl ) bytes). 'sel' and
+ * 'nsmpl' must match what was given to sis8300DigiSetCount().
+ * Views of the individual channels (pointing into 'buf') and
+ * metadata are stored in *frame.
+ *
+ * NOTE: the driver's read() blocks until the armed DMA chain
+ *       has completed. The same thread-safety restrictions as
+ *       for sis8300DigiArm() apply (see sis8300DigiSetSim()).
+ *
+ * RETURNS: 0 on success, -1 on error (errno may be set).
+ */
+int
+sis8300DigiReadout(int fd, int kind, Sis8300ChannelSel sel, unsigned nsmpl, void *buf, size_t bufsz, Sis8300Frame frame);
+
+/* Same as sis8300DigiReadout() (the layout must have been built for 'fd') */
+int
+sis8300DigiReadoutLayout(int fd, int kind, Sis8300Layout lay, void *buf, size_t bufsz, Sis8300Frame frame);
+
+/* Segmented (multi-record) readout.
+ *
+ * Acquire 'nrec' records (one per trigger) into consecutive regions of
+ * the board memory and read them with a single bulk DMA. Record # r is
+ * a memory image as described above at byte offset r * sz (sz being
+ * sis8300DigiFrameSize( sel, nsmpl )); frames[r] describes it.
+ *
+ * Between triggers only the per-channel start addresses are advanced
+ * (precomputed) and the sample logic re-armed; records 0..nrec-2 are
+ * not transferred individually. The last record is armed for DMA and
+ * the read covers all records. Each intermediate record must arrive
+ * within 'timeout_ms' (>= 0; the sample logic is polled). Each frame is
+ * time stamped when its record is seen complete (the last one when the
+ * DMA is done).
+ *
+ * 'sel' and 'nsmpl' must match what was given to sis8300DigiSetCount();
+ * the start addresses are restored when done. Records are of kind
+ * SIS8300_KIND_BEAM (the calibration signals are switched by the driver
+ * only for DMA-armed acquisitions). 'buf' must hold nrec * sz bytes and
+ * the total must fit in the board memory (SIS8300_DIGI_MEM_SIZE).
+ *
+ * NOTE: The caller must not arm (the function arms itself); the same
+ *       thread-safety restrictions as for sis8300DigiArm() apply.
+ *
+ * RETURNS: 0 on success, -1 on error (errno may be set; ETIMEDOUT if a
+ *          trigger was missing).
+ */
+#define SIS8300_DIGI_MEM_SIZE (512UL*1024UL*1024UL) /* smallest board variant */
+
+int
+sis8300DigiReadoutSegments(int fd, Sis8300ChannelSel sel, unsigned nsmpl, unsigned nrec, int timeout_ms, void *buf, size_t bufsz, Sis8300Frame frames);
+
+/* Same as sis8300DigiReadoutSegments() for the layout given to
+ * sis8300DigiSetCountLayout() (records are lay->sz bytes apart).
+ */
+int
+sis8300DigiReadoutSegmentsLayout(int fd, Sis8300Layout lay, unsigned nrec, int timeout_ms, void *buf, size_t bufsz, Sis8300Frame frames);
+
+/* Zero-copy readout.
+ *
+ * The driver's DMA buffer is mapped (read-only) into the process and
+ * frames point directly into it; consumers process samples in place.
+ * Since the next acquisition overwrites the buffer, views must be
+ * released (sis8300DigiMapRelease()) before the next acquisition can
+ * be armed.
+ *
+ * Neither is part of the driver interface this library otherwise relies
+ * on: the driver must implement mmap() of the sample memory (offset 0)
+ * and signal completion of the DMA via poll() (POLLIN). Since this cannot
+ * be verified (a driver without poll() reports POLLIN at once; an mmap()
+ * of the register space would succeed, too) zero-copy is only used if the
+ * caller asserts that the driver qualifies (SIS8300_MAP_ZEROCOPY).
+ * Otherwise -- or if mmap() fails -- the map reads into a private buffer
+ * (sis8300DigiReadout()); the API is the same.
+ *
+ * A map is not thread-safe except for sis8300DigiMapRelease() which
+ * may be called from any thread.
+ */
+typedef struct Sis8300MapRec_ *Sis8300Map;
+
+/* Driver maps the DMA sample memory and implements poll() (see above) */
+#define SIS8300_MAP_ZEROCOPY (1<<0)
+
+/* Map the memory image for selector 'sel' and 'nsmpl' samples per channel
+ * (as given to sis8300DigiSetCount()); 'flags': SIS8300_MAP_ZEROCOPY or 0.
+ *
+ * RETURNS: map or NULL on error.
+ */
+Sis8300Map
+sis8300DigiMapCreate(int fd, Sis8300ChannelSel sel, unsigned nsmpl, int flags);
+
+/* Same for the layout given to sis8300DigiSetCountLayout() (copied) */
+Sis8300Map
+sis8300DigiMapCreateLayout(int fd, Sis8300Layout lay, int flags);
+
+/* RETURNS: nonzero if frames point directly into DMA memory, zero if
+ *          the map uses the read() fallback.
+ */
+int
+sis8300DigiMapIsZeroCopy(Sis8300Map map);
+
+/* Like sis8300DigiArm() but refused while views are outstanding.
+ *
+ * RETURNS: 0 on success, -1 on error (errno set to EBUSY if views
+ *          are outstanding).
+ */
+int
+sis8300DigiMapArm(Sis8300Map map, int kind);
+
+/* Wait (up to 'timeout_ms'; forever if negative) for the armed acquisition
+ * to complete and obtain a view of the samples. The view must be released.
+ * NOTE: the timeout relies on poll(); without SIS8300_MAP_ZEROCOPY it is
+ *       only effective if the driver implements poll().
+ * 
+ * RETURNS: 0 on success, -1 on error (errno set to ETIMEDOUT on timeout).
+ */
+int
+sis8300DigiMapWait(Sis8300Map map, int timeout_ms, Sis8300Frame frame);
+
+/* Release a view obtained from sis8300DigiMapWait() */
+void
+sis8300DigiMapRelease(Sis8300Map map, Sis8300Frame frame);
+
+/* Destroy map; all views must have been released */
+void
+sis8300DigiMapDestroy(Sis8300Map map);
+
 void
 sis8300DigiSetSim(int fd, int32_t a, int32_t b, int32_t c, int32_t d, int quiet);
 
@@ -162,6 +464,7 @@ sis8300DigiQspiWriteRead(const void *device, int data_out, uint16_t *data_in);
 int
 sis8300DigiReadReg(int fd, unsigned reg, uint32_t *val_p);
 
+/* Writing the pretrigger register is equivalent to sis8300DigiSetPretrigger() */
 int
 sis8300DigiWriteReg(int fd, unsigned reg, uint32_t val);
 
@@ -180,6 +483,47 @@ sis8300DigiGetADC_ID(int fd);
 unsigned long
 sis8300DigiGetFclkMax(int fd);
 
+/* Digitizer clock frequency configured by the last sis8300DigiSetup()
+ * of the device 'fd' refers to (through any file descriptor of this
+ * process).
+ *
+ * RETURNS: frequency (Hz) or zero if unknown (or the 9510 divider is
+ *          disabled).
+ */
+unsigned long
+sis8300DigiGetFclk(int fd);
+
+/* Dual-channel sampling firmware (as detected by the last sis8300DigiSetup()
+ * of the device 'fd' refers to).
+ *
+ * With this firmware the channels of a pair (1/2, 3/4, ..., 9/10) share
+ * a memory buffer and their samples are interleaved (first channel in the
+ * low half of every 32-bit word). Channel selectors must consist of whole
+ * pairs, lower channel first (e.g., 0x21, 0x4321, 0x6521); readout
+ * deinterleaves so that frames look the same as with single-channel
+ * firmware. Zero-copy maps fall back to read() and segmented readout is
+ * not supported.
+ *
+ * RETURNS: nonzero if the firmware uses dual-channel sampling.
+ */
+int
+sis8300DigiIsDualChannel(int fd);
+
+/* Determine the format of the samples delivered by the ADCs.
+ *
+ * RETURNS: SIS8300_ADC_FMT_16 if samples use the full 16-bit range
+ *          (16-bit ADC or 14-bit ADC left-adjusted by the firmware),
+ *          SIS8300_ADC_FMT_14_RJ if samples are 14-bit right-adjusted,
+ *          -1 on error (unknown ADC).
+ *          The value is the number of bits a sample must be shifted
+ *          left to be on the 16-bit scale.
+ */
+int
+sis8300DigiGetAdcFormat(int fd);
+
+#define SIS8300_ADC_FMT_16    0
+#define SIS8300_ADC_FMT_14_RJ 2
+
 /* Set tap delay for fclk (Hz) -- it SUCKS that we have to to this */
 void
 sis8300DigiSetTapDelay(int fd, unsigned long fclk);
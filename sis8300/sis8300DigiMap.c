@@ -0,0 +1,176 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include <sis8300Digi.h>
+
+/* Zero-copy access to the sample memory (see sis8300Digi.h) */
+
+typedef struct Sis8300MapRec_ {
+	int                fd;
+	int                kind;    /* kind the last acquisition was armed for */
+	unsigned           trig;    /* pretrigger in effect at that time       */
+	Sis8300LayoutRec   lay;
+	size_t             sz;      /* size of the memory image                */
+	size_t             mapsz;   /* size of the mapping (page aligned)      */
+	void              *mem;     /* DMA memory (zero-copy)                  */
+	void              *buf;     /* private buffer (read() fallback)        */
+	volatile int       views;   /* number of outstanding views             */
+} Sis8300MapRec;
+
+Sis8300Map
+sis8300DigiMapCreate(int fd, Sis8300ChannelSel sel, unsigned nsmpl, int flags)
+{
+Sis8300LayoutRec lay;
+
+	/* validates the selector */
+	if ( sis8300DigiLayoutInit( &lay, fd, sel, nsmpl ) )
+		return 0;
+
+	return sis8300DigiMapCreateLayout( fd, &lay, flags );
+}
+
+Sis8300Map
+sis8300DigiMapCreateLayout(int fd, Sis8300Layout lay, int flags)
+{
+Sis8300Map      map;
+long            pgsz = sysconf( _SC_PAGESIZE );
+size_t          algn;
+void           *p;
+
+	if ( ! (map = calloc( 1, sizeof(*map) )) ) {
+		fprintf(stderr,"sis8300DigiMapCreate: no memory\n");
+		return 0;
+	}
+
+	map->lay   = *lay;
+	map->fd    = fd;
+	map->kind  = SIS8300_KIND_OFF;
+	map->sz    = map->lay.sz;
+	map->mapsz = (map->sz + pgsz - 1) & ~(pgsz - 1);
+
+	if ( 0 == map->sz ) {
+		fprintf(stderr,"sis8300DigiMapCreate: empty selector or zero samples\n");
+		free( map );
+		return 0;
+	}
+
+	/* A successful mmap() alone doesn't prove that this is the sample
+	 * memory (nor that poll() tracks the DMA); the caller must vouch for
+	 * the driver. Interleaved memory of dual-channel firmware can't be
+	 * used in place.
+	 */
+	if ( ! (flags & SIS8300_MAP_ZEROCOPY) || map->lay.dual )
+		map->mem = MAP_FAILED;
+	else
+		map->mem = mmap( 0, map->mapsz, PROT_READ, MAP_SHARED, fd, 0 );
+
+	if ( MAP_FAILED == map->mem ) {
+		map->mem = 0;
+		/* read() into a private buffer, aligned like the channel blocks */
+		algn = map->lay.align > sizeof(void*) ? map->lay.align : sizeof(void*);
+		if ( posix_memalign( &p, algn, map->sz ) ) {
+			fprintf(stderr,"sis8300DigiMapCreate: no memory\n");
+			free( map );
+			return 0;
+		}
+		map->buf = p;
+	}
+
+	return map;
+}
+
+int
+sis8300DigiMapIsZeroCopy(Sis8300Map map)
+{
+	return 0 != map->mem;
+}
+
+int
+sis8300DigiMapArm(Sis8300Map map, int kind)
+{
+	/* the DMA would overwrite memory somebody is still looking at */
+	if ( map->views ) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ( sis8300DigiArm( map->fd, kind ) )
+		return -1;
+	map->kind = kind;
+	map->trig = sis8300DigiGetPretrigger( map->fd );
+	return 0;
+}
+
+int
+sis8300DigiMapWait(Sis8300Map map, int timeout_ms, Sis8300Frame frame)
+{
+struct pollfd pfd;
+int           st;
+
+	pfd.fd      = map->fd;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+
+	if ( map->mem || timeout_ms >= 0 ) {
+		while ( (st = poll( &pfd, 1, timeout_ms )) < 0 && EINTR == errno )
+			/* retry */;
+		if ( st < 0 ) {
+			fprintf(stderr,"sis8300DigiMapWait: poll failed: %s\n", strerror(errno));
+			return -1;
+		}
+		if ( 0 == st ) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if ( (pfd.revents & (POLLERR | POLLNVAL)) ) {
+			fprintf(stderr,"sis8300DigiMapWait: poll reported error\n");
+			errno = EIO;
+			return -1;
+		}
+	}
+
+	if ( map->mem ) {
+		sis8300DigiFrameSetupLayout( frame, map->kind, &map->lay, map->mem );
+		frame->trig = map->trig;
+		clock_gettime( CLOCK_REALTIME, &frame->ts );
+	} else {
+		if ( map->views ) {
+			errno = EBUSY;
+			return -1;
+		}
+		if ( sis8300DigiReadoutLayout( map->fd, map->kind, &map->lay, map->buf, map->sz, frame ) )
+			return -1;
+	}
+
+	__sync_fetch_and_add( &map->views, 1 );
+
+	return 0;
+}
+
+void
+sis8300DigiMapRelease(Sis8300Map map, Sis8300Frame frame)
+{
+	if ( frame->data ) {
+		__sync_fetch_and_sub( &map->views, 1 );
+		frame->data = 0;
+	}
+}
+
+void
+sis8300DigiMapDestroy(Sis8300Map map)
+{
+	if ( ! map )
+		return;
+	if ( map->views ) {
+		fprintf(stderr,"sis8300DigiMapDestroy: WARNING -- %i views still outstanding\n", map->views);
+	}
+	if ( map->mem )
+		munmap( map->mem, map->mapsz );
+	free( map->buf );
+	free( map );
+}
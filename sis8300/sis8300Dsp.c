@@ -0,0 +1,1613 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <sis8300Dsp.h>
+
+/* Sample processing kernels (see sis8300Dsp.h).
+ *
+ * SIMD versions are only built for x86 with a gcc which supports
+ * the 'target' attribute (so that the library itself can be compiled
+ * for a baseline CPU); elsewhere only the scalar versions exist.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define DSP_X86
+#include <immintrin.h>
+#define DSP_TARGET(t) __attribute__((target(t)))
+#endif
+
+typedef struct DspOpsRec_ {
+	int    impl;
+	void (*i16_f)(float  *, const int16_t *, unsigned, float,  float);
+	void (*i16_d)(double *, const int16_t *, unsigned, double, double);
+	void (*stats)(const int16_t *, unsigned, Sis8300DspChStats);
+	void (*mix)(float *, float *, const int16_t *, const float *, const float *, unsigned);
+	void (*fir_iq)(float *, float *, const float *, const float *, unsigned, unsigned, const float *, unsigned);
+	void (*dos)(float *, const float *, const float *, unsigned, float);
+	void (*poly2)(float *, const float *, const float *, unsigned, const float *, unsigned);
+	void (*dil)(int16_t *, int16_t *, const int16_t *, unsigned);
+} DspOpsRec, *DspOps;
+
+/* Max. number of SIMD iterations before the 32-bit partial sums of the
+ * statistics kernels must be flushed into the 64-bit total: each lane
+ * accumulates at most 2 * 2^15 per iteration.
+ */
+#define STATS_BLK 8192
+
+/* Scalar */
+
+static void
+i16_f_scalar(float *y, const int16_t *x, unsigned n, float g, float o)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ )
+		y[i] = (float)x[i] * g + o;
+}
+
+static void
+i16_d_scalar(double *y, const int16_t *x, unsigned n, double g, double o)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ )
+		y[i] = (double)x[i] * g + o;
+}
+
+/* Accumulate statistics of a block into running values */
+static void
+stats_acc(const int16_t *x, unsigned n, int16_t *min, int16_t *max, int64_t *sum, uint64_t *sumsq)
+{
+unsigned i;
+int16_t  mn = *min, mx = *max;
+int64_t  s  = 0;
+uint64_t q  = 0;
+	for ( i = 0; i < n; i++ ) {
+		if ( x[i] < mn )
+			mn = x[i];
+		if ( x[i] > mx )
+			mx = x[i];
+		s += x[i];
+		q += (uint64_t)((int32_t)x[i] * (int32_t)x[i]);
+	}
+	*min    = mn;
+	*max    = mx;
+	*sum   += s;
+	*sumsq += q;
+}
+
+static void
+stats_done(Sis8300DspChStats st, unsigned n, int16_t min, int16_t max, int64_t sum, uint64_t sumsq)
+{
+	st->count = n;
+	st->min   = n ? min : 0;
+	st->max   = n ? max : 0;
+	st->sum   = sum;
+	st->sumsq = sumsq;
+}
+
+static void
+stats_scalar(const int16_t *x, unsigned n, Sis8300DspChStats st)
+{
+int16_t  mn  = INT16_MAX;
+int16_t  mx  = INT16_MIN;
+int64_t  sum = 0;
+uint64_t sq  = 0;
+	stats_acc( x, n, &mn, &mx, &sum, &sq );
+	stats_done( st, n, mn, mx, sum, sq );
+}
+
+static void
+mix_scalar(float *i, float *q, const int16_t *x, const float *c, const float *s, unsigned n)
+{
+unsigned k;
+	for ( k = 0; k < n; k++ ) {
+		i[k] = (float)x[k] * c[k];
+		q[k] = (float)x[k] * s[k];
+	}
+}
+
+static void
+fir_iq_scalar(float *yi, float *yq, const float *xi, const float *xq, unsigned nout, unsigned decim, const float *h, unsigned ntaps)
+{
+unsigned k, j;
+float    ai, aq;
+	for ( k = 0; k < nout; k++, xi += decim, xq += decim ) {
+		ai = aq = 0.0f;
+		for ( j = 0; j < ntaps; j++ ) {
+			ai += h[j] * xi[j];
+			aq += h[j] * xq[j];
+		}
+		yi[k] = ai;
+		yq[k] = aq;
+	}
+}
+
+static void
+dos_scalar(float *r, const float *p, const float *q, unsigned n, float k)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ )
+		r[i] = k * (p[i] - q[i]) / (p[i] + q[i]);
+}
+
+/* Coefficients of sis8300DspPoly2() are ordered by total degree, then by
+ * decreasing power of u: 1, u, v, u^2, uv, v^2, u^3, ...
+ */
+static void
+poly2_scalar(float *r, const float *u, const float *v, unsigned n, const float *c, unsigned order)
+{
+unsigned i, d, j, k;
+float    pu[SIS8300_DSP_POLY2_MAX_ORDER + 1], pv[SIS8300_DSP_POLY2_MAX_ORDER + 1], acc;
+
+	for ( i = 0; i < n; i++ ) {
+		pu[0] = pv[0] = 1.0f;
+		for ( d = 1; d <= order; d++ ) {
+			pu[d] = pu[d-1] * u[i];
+			pv[d] = pv[d-1] * v[i];
+		}
+		acc = 0.0f;
+		for ( d = 0, k = 0; d <= order; d++ ) {
+			for ( j = 0; j <= d; j++, k++ )
+				acc += c[k] * pu[d - j] * pv[j];
+		}
+		r[i] = acc;
+	}
+}
+
+static void
+dil_scalar(int16_t *a, int16_t *b, const int16_t *x, unsigned n)
+{
+unsigned i;
+	for ( i = 0; i < n; i++ ) {
+		a[i] = x[2*i + 0];
+		b[i] = x[2*i + 1];
+	}
+}
+
+static const DspOpsRec dsp_ops_scalar = {
+	SIS8300_DSP_IMPL_SCALAR,
+	i16_f_scalar,
+	i16_d_scalar,
+	stats_scalar,
+	mix_scalar,
+	fir_iq_scalar,
+	dos_scalar,
+	poly2_scalar,
+	dil_scalar,
+};
+
+#ifdef DSP_X86
+
+/* SSE2; 8 samples per iteration. Unaligned loads/stores (outputs are
+ * user memory; DMA buffers are aligned anyways).
+ */
+
+/* sign-extend 16-bit to 32-bit */
+#define SSE2_LO32(v) _mm_srai_epi32( _mm_unpacklo_epi16( (v), (v) ), 16 )
+#define SSE2_HI32(v) _mm_srai_epi32( _mm_unpackhi_epi16( (v), (v) ), 16 )
+
+DSP_TARGET("sse2") static void
+i16_f_sse2(float *y, const int16_t *x, unsigned n, float g, float o)
+{
+unsigned i;
+__m128   vg = _mm_set1_ps( g );
+__m128   vo = _mm_set1_ps( o );
+__m128i  v;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		v = _mm_loadu_si128( (const __m128i*)(x + i) );
+		_mm_storeu_ps( y + i + 0, _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( SSE2_LO32( v ) ), vg ), vo ) );
+		_mm_storeu_ps( y + i + 4, _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( SSE2_HI32( v ) ), vg ), vo ) );
+	}
+	i16_f_scalar( y + i, x + i, n - i, g, o );
+}
+
+DSP_TARGET("sse2") static void
+i16_d_sse2(double *y, const int16_t *x, unsigned n, double g, double o)
+{
+unsigned i;
+__m128d  vg = _mm_set1_pd( g );
+__m128d  vo = _mm_set1_pd( o );
+__m128i  v, l, h;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		v = _mm_loadu_si128( (const __m128i*)(x + i) );
+		l = SSE2_LO32( v );
+		h = SSE2_HI32( v );
+		_mm_storeu_pd( y + i + 0, _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( l ), vg ), vo ) );
+		_mm_storeu_pd( y + i + 2, _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( _mm_shuffle_epi32( l, 0xee ) ), vg ), vo ) );
+		_mm_storeu_pd( y + i + 4, _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( h ), vg ), vo ) );
+		_mm_storeu_pd( y + i + 6, _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( _mm_shuffle_epi32( h, 0xee ) ), vg ), vo ) );
+	}
+	i16_d_scalar( y + i, x + i, n - i, g, o );
+}
+
+/* Statistics: min/max on 16-bit lanes; pmaddwd yields sums of pairs (x, with
+ * a vector of ones) and sums of squares of pairs. The latter are at most 2^31
+ * and are accumulated as unsigned 64-bit numbers.
+ */
+DSP_TARGET("sse2") static void
+stats_sse2(const int16_t *x, unsigned n, Sis8300DspChStats st)
+{
+unsigned i = 0, e, k;
+__m128i  vmin = _mm_set1_epi16( INT16_MAX );
+__m128i  vmax = _mm_set1_epi16( INT16_MIN );
+__m128i  ones = _mm_set1_epi16( 1 );
+__m128i  zero = _mm_setzero_si128();
+__m128i  vsq  = zero;
+__m128i  vsum, v, q;
+int16_t  mn, mx, l16[8];
+int32_t  l32[4];
+uint64_t l64[2];
+int64_t  sum  = 0;
+uint64_t sq;
+
+	while ( n - i >= 8 ) {
+		e    = n - i > 8*STATS_BLK ? i + 8*STATS_BLK : i + ((n - i) & ~7);
+		vsum = zero;
+		for ( ; i < e; i += 8 ) {
+			v    = _mm_loadu_si128( (const __m128i*)(x + i) );
+			vmin = _mm_min_epi16( vmin, v );
+			vmax = _mm_max_epi16( vmax, v );
+			vsum = _mm_add_epi32( vsum, _mm_madd_epi16( v, ones ) );
+			q    = _mm_madd_epi16( v, v );
+			vsq  = _mm_add_epi64( vsq, _mm_add_epi64( _mm_unpacklo_epi32( q, zero ), _mm_unpackhi_epi32( q, zero ) ) );
+		}
+		_mm_storeu_si128( (__m128i*)l32, vsum );
+		sum += (int64_t)l32[0] + (int64_t)l32[1] + (int64_t)l32[2] + (int64_t)l32[3];
+	}
+
+	_mm_storeu_si128( (__m128i*)l64, vsq );
+	sq = l64[0] + l64[1];
+	mn = INT16_MAX;
+	mx = INT16_MIN;
+	if ( i > 0 ) {
+		_mm_storeu_si128( (__m128i*)l16, vmin );
+		for ( k = 0; k < 8; k++ )
+			if ( l16[k] < mn )
+				mn = l16[k];
+		_mm_storeu_si128( (__m128i*)l16, vmax );
+		for ( k = 0; k < 8; k++ )
+			if ( l16[k] > mx )
+				mx = l16[k];
+	}
+	stats_acc( x + i, n - i, &mn, &mx, &sum, &sq );
+	stats_done( st, n, mn, mx, sum, sq );
+}
+
+DSP_TARGET("sse2") static void
+mix_sse2(float *i, float *q, const int16_t *x, const float *c, const float *s, unsigned n)
+{
+unsigned k;
+__m128i  v;
+__m128   l, h;
+
+	for ( k = 0; k + 8 <= n; k += 8 ) {
+		v = _mm_loadu_si128( (const __m128i*)(x + k) );
+		l = _mm_cvtepi32_ps( SSE2_LO32( v ) );
+		h = _mm_cvtepi32_ps( SSE2_HI32( v ) );
+		_mm_storeu_ps( i + k + 0, _mm_mul_ps( l, _mm_loadu_ps( c + k + 0 ) ) );
+		_mm_storeu_ps( i + k + 4, _mm_mul_ps( h, _mm_loadu_ps( c + k + 4 ) ) );
+		_mm_storeu_ps( q + k + 0, _mm_mul_ps( l, _mm_loadu_ps( s + k + 0 ) ) );
+		_mm_storeu_ps( q + k + 4, _mm_mul_ps( h, _mm_loadu_ps( s + k + 4 ) ) );
+	}
+	mix_scalar( i + k, q + k, x + k, c + k, s + k, n - k );
+}
+
+DSP_TARGET("sse2") static float
+hsum_sse2(__m128 v)
+{
+	v = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+	v = _mm_add_ss( v, _mm_shuffle_ps( v, v, 1 ) );
+	return _mm_cvtss_f32( v );
+}
+
+DSP_TARGET("sse2") static void
+fir_iq_sse2(float *yi, float *yq, const float *xi, const float *xq, unsigned nout, unsigned decim, const float *h, unsigned ntaps)
+{
+unsigned k, j;
+__m128   ai, aq, vh;
+float    si, sq;
+
+	for ( k = 0; k < nout; k++, xi += decim, xq += decim ) {
+		ai = aq = _mm_setzero_ps();
+		for ( j = 0; j + 4 <= ntaps; j += 4 ) {
+			vh = _mm_loadu_ps( h + j );
+			ai = _mm_add_ps( ai, _mm_mul_ps( vh, _mm_loadu_ps( xi + j ) ) );
+			aq = _mm_add_ps( aq, _mm_mul_ps( vh, _mm_loadu_ps( xq + j ) ) );
+		}
+		si = hsum_sse2( ai );
+		sq = hsum_sse2( aq );
+		for ( ; j < ntaps; j++ ) {
+			si += h[j] * xi[j];
+			sq += h[j] * xq[j];
+		}
+		yi[k] = si;
+		yq[k] = sq;
+	}
+}
+
+DSP_TARGET("sse2") static void
+dos_sse2(float *r, const float *p, const float *q, unsigned n, float k)
+{
+unsigned i;
+__m128   vk = _mm_set1_ps( k );
+__m128   vp, vq;
+
+	for ( i = 0; i + 4 <= n; i += 4 ) {
+		vp = _mm_loadu_ps( p + i );
+		vq = _mm_loadu_ps( q + i );
+		_mm_storeu_ps( r + i, _mm_div_ps( _mm_mul_ps( vk, _mm_sub_ps( vp, vq ) ), _mm_add_ps( vp, vq ) ) );
+	}
+	dos_scalar( r + i, p + i, q + i, n - i, k );
+}
+
+DSP_TARGET("sse2") static void
+poly2_sse2(float *r, const float *u, const float *v, unsigned n, const float *c, unsigned order)
+{
+unsigned i, d, j, k;
+__m128   pu[SIS8300_DSP_POLY2_MAX_ORDER + 1], pv[SIS8300_DSP_POLY2_MAX_ORDER + 1], acc;
+
+	for ( i = 0; i + 4 <= n; i += 4 ) {
+		pu[0] = pv[0] = _mm_set1_ps( 1.0f );
+		for ( d = 1; d <= order; d++ ) {
+			pu[d] = _mm_mul_ps( pu[d-1], _mm_loadu_ps( u + i ) );
+			pv[d] = _mm_mul_ps( pv[d-1], _mm_loadu_ps( v + i ) );
+		}
+		acc = _mm_setzero_ps();
+		for ( d = 0, k = 0; d <= order; d++ ) {
+			for ( j = 0; j <= d; j++, k++ )
+				acc = _mm_add_ps( acc, _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( c[k] ), pu[d - j] ), pv[j] ) );
+		}
+		_mm_storeu_ps( r + i, acc );
+	}
+	poly2_scalar( r + i, u + i, v + i, n - i, c, order );
+}
+
+/* even samples are the sign-extended low halves of 32-bit words, odd
+ * samples the (arithmetically shifted) high halves; packing can't saturate.
+ */
+DSP_TARGET("sse2") static void
+dil_sse2(int16_t *a, int16_t *b, const int16_t *x, unsigned n)
+{
+unsigned i;
+__m128i  v0, v1;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		v0 = _mm_loadu_si128( (const __m128i*)(x + 2*i + 0) );
+		v1 = _mm_loadu_si128( (const __m128i*)(x + 2*i + 8) );
+		_mm_storeu_si128( (__m128i*)(a + i), _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( v0, 16 ), 16 ),
+		                                                      _mm_srai_epi32( _mm_slli_epi32( v1, 16 ), 16 ) ) );
+		_mm_storeu_si128( (__m128i*)(b + i), _mm_packs_epi32( _mm_srai_epi32( v0, 16 ), _mm_srai_epi32( v1, 16 ) ) );
+	}
+	dil_scalar( a + i, b + i, x + 2*i, n - i );
+}
+
+static const DspOpsRec dsp_ops_sse2 = {
+	SIS8300_DSP_IMPL_SSE2,
+	i16_f_sse2,
+	i16_d_sse2,
+	stats_sse2,
+	mix_sse2,
+	fir_iq_sse2,
+	dos_sse2,
+	poly2_sse2,
+	dil_sse2,
+};
+
+/* AVX2; 16 samples per iteration. Multiply and add are not fused so
+ * that results are identical to the other implementations.
+ */
+
+DSP_TARGET("avx2") static void
+i16_f_avx2(float *y, const int16_t *x, unsigned n, float g, float o)
+{
+unsigned i;
+__m256   vg = _mm256_set1_ps( g );
+__m256   vo = _mm256_set1_ps( o );
+__m256i  v, l, h;
+
+	for ( i = 0; i + 16 <= n; i += 16 ) {
+		v = _mm256_loadu_si256( (const __m256i*)(x + i) );
+		l = _mm256_cvtepi16_epi32( _mm256_castsi256_si128( v ) );
+		h = _mm256_cvtepi16_epi32( _mm256_extracti128_si256( v, 1 ) );
+		_mm256_storeu_ps( y + i + 0, _mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( l ), vg ), vo ) );
+		_mm256_storeu_ps( y + i + 8, _mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( h ), vg ), vo ) );
+	}
+	i16_f_sse2( y + i, x + i, n - i, g, o );
+}
+
+DSP_TARGET("avx2") static void
+i16_d_avx2(double *y, const int16_t *x, unsigned n, double g, double o)
+{
+unsigned i;
+__m256d  vg = _mm256_set1_pd( g );
+__m256d  vo = _mm256_set1_pd( o );
+__m256i  v;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		v = _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)(x + i) ) );
+		_mm256_storeu_pd( y + i + 0, _mm256_add_pd( _mm256_mul_pd( _mm256_cvtepi32_pd( _mm256_castsi256_si128( v ) ), vg ), vo ) );
+		_mm256_storeu_pd( y + i + 4, _mm256_add_pd( _mm256_mul_pd( _mm256_cvtepi32_pd( _mm256_extracti128_si256( v, 1 ) ), vg ), vo ) );
+	}
+	i16_d_scalar( y + i, x + i, n - i, g, o );
+}
+
+DSP_TARGET("avx2") static void
+stats_avx2(const int16_t *x, unsigned n, Sis8300DspChStats st)
+{
+unsigned i = 0, e, k;
+__m256i  vmin = _mm256_set1_epi16( INT16_MAX );
+__m256i  vmax = _mm256_set1_epi16( INT16_MIN );
+__m256i  ones = _mm256_set1_epi16( 1 );
+__m256i  zero = _mm256_setzero_si256();
+__m256i  vsq  = zero;
+__m256i  vsum, v, q;
+int16_t  mn, mx, l16[16];
+int32_t  l32[8];
+uint64_t l64[4];
+int64_t  sum  = 0;
+uint64_t sq;
+
+	while ( n - i >= 16 ) {
+		e    = n - i > 16*STATS_BLK ? i + 16*STATS_BLK : i + ((n - i) & ~15);
+		vsum = zero;
+		for ( ; i < e; i += 16 ) {
+			v    = _mm256_loadu_si256( (const __m256i*)(x + i) );
+			vmin = _mm256_min_epi16( vmin, v );
+			vmax = _mm256_max_epi16( vmax, v );
+			vsum = _mm256_add_epi32( vsum, _mm256_madd_epi16( v, ones ) );
+			q    = _mm256_madd_epi16( v, v );
+			vsq  = _mm256_add_epi64( vsq, _mm256_add_epi64( _mm256_unpacklo_epi32( q, zero ), _mm256_unpackhi_epi32( q, zero ) ) );
+		}
+		_mm256_storeu_si256( (__m256i*)l32, vsum );
+		for ( k = 0; k < 8; k++ )
+			sum += l32[k];
+	}
+
+	_mm256_storeu_si256( (__m256i*)l64, vsq );
+	sq = l64[0] + l64[1] + l64[2] + l64[3];
+	mn = INT16_MAX;
+	mx = INT16_MIN;
+	if ( i > 0 ) {
+		_mm256_storeu_si256( (__m256i*)l16, vmin );
+		for ( k = 0; k < 16; k++ )
+			if ( l16[k] < mn )
+				mn = l16[k];
+		_mm256_storeu_si256( (__m256i*)l16, vmax );
+		for ( k = 0; k < 16; k++ )
+			if ( l16[k] > mx )
+				mx = l16[k];
+	}
+	stats_acc( x + i, n - i, &mn, &mx, &sum, &sq );
+	stats_done( st, n, mn, mx, sum, sq );
+}
+
+DSP_TARGET("avx2") static void
+mix_avx2(float *i, float *q, const int16_t *x, const float *c, const float *s, unsigned n)
+{
+unsigned k;
+__m256   v;
+
+	for ( k = 0; k + 8 <= n; k += 8 ) {
+		v = _mm256_cvtepi32_ps( _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)(x + k) ) ) );
+		_mm256_storeu_ps( i + k, _mm256_mul_ps( v, _mm256_loadu_ps( c + k ) ) );
+		_mm256_storeu_ps( q + k, _mm256_mul_ps( v, _mm256_loadu_ps( s + k ) ) );
+	}
+	mix_scalar( i + k, q + k, x + k, c + k, s + k, n - k );
+}
+
+DSP_TARGET("avx2") static void
+fir_iq_avx2(float *yi, float *yq, const float *xi, const float *xq, unsigned nout, unsigned decim, const float *h, unsigned ntaps)
+{
+unsigned k, j;
+__m256   ai, aq, vh;
+float    si, sq;
+
+	for ( k = 0; k < nout; k++, xi += decim, xq += decim ) {
+		ai = aq = _mm256_setzero_ps();
+		for ( j = 0; j + 8 <= ntaps; j += 8 ) {
+			vh = _mm256_loadu_ps( h + j );
+			ai = _mm256_add_ps( ai, _mm256_mul_ps( vh, _mm256_loadu_ps( xi + j ) ) );
+			aq = _mm256_add_ps( aq, _mm256_mul_ps( vh, _mm256_loadu_ps( xq + j ) ) );
+		}
+		si = hsum_sse2( _mm_add_ps( _mm256_castps256_ps128( ai ), _mm256_extractf128_ps( ai, 1 ) ) );
+		sq = hsum_sse2( _mm_add_ps( _mm256_castps256_ps128( aq ), _mm256_extractf128_ps( aq, 1 ) ) );
+		for ( ; j < ntaps; j++ ) {
+			si += h[j] * xi[j];
+			sq += h[j] * xq[j];
+		}
+		yi[k] = si;
+		yq[k] = sq;
+	}
+}
+
+DSP_TARGET("avx2") static void
+dos_avx2(float *r, const float *p, const float *q, unsigned n, float k)
+{
+unsigned i;
+__m256   vk = _mm256_set1_ps( k );
+__m256   vp, vq;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		vp = _mm256_loadu_ps( p + i );
+		vq = _mm256_loadu_ps( q + i );
+		_mm256_storeu_ps( r + i, _mm256_div_ps( _mm256_mul_ps( vk, _mm256_sub_ps( vp, vq ) ), _mm256_add_ps( vp, vq ) ) );
+	}
+	dos_sse2( r + i, p + i, q + i, n - i, k );
+}
+
+DSP_TARGET("avx2") static void
+poly2_avx2(float *r, const float *u, const float *v, unsigned n, const float *c, unsigned order)
+{
+unsigned i, d, j, k;
+__m256   pu[SIS8300_DSP_POLY2_MAX_ORDER + 1], pv[SIS8300_DSP_POLY2_MAX_ORDER + 1], acc;
+
+	for ( i = 0; i + 8 <= n; i += 8 ) {
+		pu[0] = pv[0] = _mm256_set1_ps( 1.0f );
+		for ( d = 1; d <= order; d++ ) {
+			pu[d] = _mm256_mul_ps( pu[d-1], _mm256_loadu_ps( u + i ) );
+			pv[d] = _mm256_mul_ps( pv[d-1], _mm256_loadu_ps( v + i ) );
+		}
+		acc = _mm256_setzero_ps();
+		for ( d = 0, k = 0; d <= order; d++ ) {
+			for ( j = 0; j <= d; j++, k++ )
+				acc = _mm256_add_ps( acc, _mm256_mul_ps( _mm256_mul_ps( _mm256_set1_ps( c[k] ), pu[d - j] ), pv[j] ) );
+		}
+		_mm256_storeu_ps( r + i, acc );
+	}
+	poly2_sse2( r + i, u + i, v + i, n - i, c, order );
+}
+
+/* as SSE2; packing works within 128-bit lanes, hence the permutation */
+DSP_TARGET("avx2") static void
+dil_avx2(int16_t *a, int16_t *b, const int16_t *x, unsigned n)
+{
+unsigned i;
+__m256i  v0, v1;
+
+	for ( i = 0; i + 16 <= n; i += 16 ) {
+		v0 = _mm256_loadu_si256( (const __m256i*)(x + 2*i +  0) );
+		v1 = _mm256_loadu_si256( (const __m256i*)(x + 2*i + 16) );
+		_mm256_storeu_si256( (__m256i*)(a + i), _mm256_permute4x64_epi64(
+		                     _mm256_packs_epi32( _mm256_srai_epi32( _mm256_slli_epi32( v0, 16 ), 16 ),
+		                                         _mm256_srai_epi32( _mm256_slli_epi32( v1, 16 ), 16 ) ), 0xd8 ) );
+		_mm256_storeu_si256( (__m256i*)(b + i), _mm256_permute4x64_epi64(
+		                     _mm256_packs_epi32( _mm256_srai_epi32( v0, 16 ), _mm256_srai_epi32( v1, 16 ) ), 0xd8 ) );
+	}
+	dil_sse2( a + i, b + i, x + 2*i, n - i );
+}
+
+static const DspOpsRec dsp_ops_avx2 = {
+	SIS8300_DSP_IMPL_AVX2,
+	i16_f_avx2,
+	i16_d_avx2,
+	stats_avx2,
+	mix_avx2,
+	fir_iq_avx2,
+	dos_avx2,
+	poly2_avx2,
+	dil_avx2,
+};
+
+#endif /* DSP_X86 */
+
+/* Dispatch */
+
+static const DspOpsRec *dsp_ops = 0;
+static pthread_once_t   dsp_once = PTHREAD_ONCE_INIT;
+
+static const DspOpsRec *
+dsp_ops_get(int impl)
+{
+#ifdef DSP_X86
+	__builtin_cpu_init();
+#endif
+	switch ( impl ) {
+		case SIS8300_DSP_IMPL_AUTO:
+#ifdef DSP_X86
+			if ( __builtin_cpu_supports( "avx2" ) )
+				return &dsp_ops_avx2;
+			if ( __builtin_cpu_supports( "sse2" ) )
+				return &dsp_ops_sse2;
+#endif
+			return &dsp_ops_scalar;
+
+		case SIS8300_DSP_IMPL_SCALAR:
+			return &dsp_ops_scalar;
+
+#ifdef DSP_X86
+		case SIS8300_DSP_IMPL_SSE2:
+			return __builtin_cpu_supports( "sse2" ) ? &dsp_ops_sse2 : 0;
+
+		case SIS8300_DSP_IMPL_AVX2:
+			return __builtin_cpu_supports( "avx2" ) ? &dsp_ops_avx2 : 0;
+#endif
+
+		default:
+			break;
+	}
+	return 0;
+}
+
+static void
+dsp_init(void)
+{
+	if ( ! dsp_ops )
+		dsp_ops = dsp_ops_get( SIS8300_DSP_IMPL_AUTO );
+}
+
+static const DspOpsRec *
+dsp(void)
+{
+	pthread_once( &dsp_once, dsp_init );
+	return dsp_ops;
+}
+
+int
+sis8300DspSetImpl(int impl)
+{
+const DspOpsRec *ops;
+
+	pthread_once( &dsp_once, dsp_init );
+
+	if ( ! (ops = dsp_ops_get( impl )) )
+		return -1;
+
+	dsp_ops = ops;
+	return ops->impl;
+}
+
+int
+sis8300DspGetImpl(void)
+{
+	return dsp()->impl;
+}
+
+const char *
+sis8300DspImplName(int impl)
+{
+	switch ( impl ) {
+		case SIS8300_DSP_IMPL_AUTO:   return "auto";
+		case SIS8300_DSP_IMPL_SCALAR: return "scalar";
+		case SIS8300_DSP_IMPL_SSE2:   return "sse2";
+		case SIS8300_DSP_IMPL_AVX2:   return "avx2";
+		default:                      break;
+	}
+	return "unknown";
+}
+
+/* Conversion */
+
+void
+sis8300DspCalInit(Sis8300DspCal cal, int shift)
+{
+int i;
+	cal->shift = shift;
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ ) {
+		cal->gain[i]   = 1.0;
+		cal->offset[i] = 0.0;
+	}
+}
+
+void
+sis8300DspI16ToFloat(float *y, const int16_t *x, unsigned n, float g, float o)
+{
+	dsp()->i16_f( y, x, n, g, o );
+}
+
+void
+sis8300DspI16ToDouble(double *y, const int16_t *x, unsigned n, double g, double o)
+{
+	dsp()->i16_d( y, x, n, g, o );
+}
+
+/* Check outputs and compute effective gain (shift folded in) and offset */
+static int
+cvt_check(Sis8300Frame frame, Sis8300DspCal cal, void *out[SIS8300_MAX_CHANNELS], double *g, double *o, const char *nm)
+{
+int i;
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ ) {
+		if ( ! out[i] )
+			continue;
+		if ( ! frame->chnl[i] ) {
+			fprintf(stderr,"%s: channel # %i not in frame\n", nm, i + 1);
+			errno = EINVAL;
+			return -1;
+		}
+		if ( cal ) {
+			g[i] = cal->gain[i] * (double)(1 << cal->shift);
+			o[i] = cal->offset[i];
+		} else {
+			g[i] = 1.0;
+			o[i] = 0.0;
+		}
+	}
+	return 0;
+}
+
+int
+sis8300DspConvertFloat(Sis8300Frame frame, Sis8300DspCal cal, float *out[SIS8300_MAX_CHANNELS])
+{
+const DspOpsRec *ops = dsp();
+double           g[SIS8300_MAX_CHANNELS];
+double           o[SIS8300_MAX_CHANNELS];
+int              i;
+
+	if ( cvt_check( frame, cal, (void**)out, g, o, "sis8300DspConvertFloat" ) )
+		return -1;
+
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ ) {
+		if ( out[i] )
+			ops->i16_f( out[i], frame->chnl[i], frame->nsmpl, (float)g[i], (float)o[i] );
+	}
+	return 0;
+}
+
+int
+sis8300DspConvertDouble(Sis8300Frame frame, Sis8300DspCal cal, double *out[SIS8300_MAX_CHANNELS])
+{
+const DspOpsRec *ops = dsp();
+double           g[SIS8300_MAX_CHANNELS];
+double           o[SIS8300_MAX_CHANNELS];
+int              i;
+
+	if ( cvt_check( frame, cal, (void**)out, g, o, "sis8300DspConvertDouble" ) )
+		return -1;
+
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ ) {
+		if ( out[i] )
+			ops->i16_d( out[i], frame->chnl[i], frame->nsmpl, g[i], o[i] );
+	}
+	return 0;
+}
+
+void
+sis8300DspMixIQ(float *i, float *q, const int16_t *x, const float *c, const float *s, unsigned n)
+{
+	dsp()->mix( i, q, x, c, s, n );
+}
+
+void
+sis8300DspFirDecimIQ(float *yi, float *yq, const float *xi, const float *xq, unsigned nout, unsigned decim, const float *h, unsigned ntaps)
+{
+	dsp()->fir_iq( yi, yq, xi, xq, nout, decim, h, ntaps );
+}
+
+void
+sis8300DspDiffOverSum(float *r, const float *p, const float *q, unsigned n, float k)
+{
+	dsp()->dos( r, p, q, n, k );
+}
+
+int
+sis8300DspPoly2(float *r, const float *u, const float *v, unsigned n, const float *c, unsigned order)
+{
+	if ( order > SIS8300_DSP_POLY2_MAX_ORDER ) {
+		fprintf(stderr,"sis8300DspPoly2: order too high (max. %u)\n", SIS8300_DSP_POLY2_MAX_ORDER);
+		return -1;
+	}
+	dsp()->poly2( r, u, v, n, c, order );
+	return 0;
+}
+
+void
+sis8300DspDeinterleave(int16_t *a, int16_t *b, const int16_t *x, unsigned n)
+{
+	dsp()->dil( a, b, x, n );
+}
+
+/* Statistics */
+
+void
+sis8300DspChStats(const int16_t *x, unsigned n, Sis8300DspChStats stats)
+{
+	dsp()->stats( x, n, stats );
+}
+
+void
+sis8300DspStats(Sis8300Frame frame, Sis8300DspStats stats)
+{
+const DspOpsRec *ops = dsp();
+int              i;
+
+	for ( i = 0; i < SIS8300_MAX_CHANNELS; i++ ) {
+		if ( frame->chnl[i] )
+			ops->stats( frame->chnl[i], frame->nsmpl, &stats->ch[i] );
+		else
+			memset( &stats->ch[i], 0, sizeof(stats->ch[i]) );
+	}
+}
+
+double
+sis8300DspStatsMean(Sis8300DspChStats stats)
+{
+	return stats->count ? (double)stats->sum / (double)stats->count : 0.0;
+}
+
+double
+sis8300DspStatsRms(Sis8300DspChStats stats)
+{
+	return stats->count ? sqrt( (double)stats->sumsq / (double)stats->count ) : 0.0;
+}
+
+#ifdef TEST_SIS8300DSP
+/* Test and benchmark program: all implementations available on this CPU
+ * are checked against the scalar one.
+ */
+#include <unistd.h>
+#include <time.h>
+#include <sis8300Ddc.h>
+#include <sis8300Bpm.h>
+#include <sis8300Cal.h>
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static uint64_t
+rnd64(void)
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return rnd_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void
+usage(const char *nm)
+{
+	printf("Usage: %s [-h] [-b n_samples] [-s seed]\n", nm);
+	printf("    Check SIMD kernels against scalar versions\n");
+	printf("  -b n_samples : benchmark kernels (n_samples per channel)\n");
+	printf("  -s seed      : seed for random numbers\n");
+}
+
+/* Frame with 'nch' channels in reverse order (10,9,...) */
+static int
+mkframe(Sis8300Frame frame, int16_t *buf, int nch, unsigned nsmpl)
+{
+Sis8300ChannelSel sel = 0;
+unsigned          i;
+int               ch;
+	for ( ch = nch; ch > 0; ch-- )
+		sel = (sel << 4) | ch;
+	for ( i = 0; i < nch * nsmpl; i++ )
+		buf[i] = (int16_t)rnd64();
+	/* make sure extremes are covered */
+	buf[0] = -32768;
+	if ( nch * nsmpl > 1 )
+		buf[1] = 32767;
+	return sis8300DigiFrameSetup( frame, SIS8300_KIND_BEAM, sel, nsmpl, buf );
+}
+
+static int
+check(void)
+{
+Sis8300FrameRec  frame;
+Sis8300DspCalRec cal;
+static int16_t   buf[SIS8300_MAX_CHANNELS * 100];
+static float     f_ref[SIS8300_MAX_CHANNELS][101], f[SIS8300_MAX_CHANNELS][101];
+static double    d_ref[SIS8300_MAX_CHANNELS][101], d[SIS8300_MAX_CHANNELS][101];
+float           *fo[SIS8300_MAX_CHANNELS];
+double          *dof[SIS8300_MAX_CHANNELS];
+unsigned         nsmpl, i;
+int              impl, ch, shift, off, nerr = 0;
+
+	for ( impl = SIS8300_DSP_IMPL_SSE2; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+		if ( sis8300DspSetImpl( impl ) < 0 ) {
+			printf("%s: not supported by this CPU; skipped\n", sis8300DspImplName( impl ));
+			continue;
+		}
+		for ( nsmpl = 0; nsmpl <= 100; nsmpl++ ) {
+		for ( shift = 0; shift <= 2; shift += 2 ) {
+			/* misalign outputs */
+			off = nsmpl & 1;
+			if ( mkframe( &frame, buf, SIS8300_MAX_CHANNELS, nsmpl ) )
+				return 1;
+			sis8300DspCalInit( &cal, shift );
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				cal.gain[ch]   = (double)(int64_t)rnd64() / 9.2E18;
+				cal.offset[ch] = (double)(int64_t)rnd64() / 9.2E16;
+			}
+
+			sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				fo[ch]  = f_ref[ch] + off;
+				dof[ch] = d_ref[ch] + off;
+			}
+			/* skip one channel */
+			fo[3] = 0; dof[3] = 0;
+			if ( sis8300DspConvertFloat( &frame, &cal, fo ) || sis8300DspConvertDouble( &frame, &cal, dof ) )
+				return 1;
+
+			sis8300DspSetImpl( impl );
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				fo[ch]  = f[ch] + off;
+				dof[ch] = d[ch] + off;
+			}
+			fo[3] = 0; dof[3] = 0;
+			if ( sis8300DspConvertFloat( &frame, &cal, fo ) || sis8300DspConvertDouble( &frame, &cal, dof ) )
+				return 1;
+
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				if ( 3 == ch )
+					continue;
+				for ( i = 0; i < nsmpl; i++ ) {
+					if ( f[ch][i+off] != f_ref[ch][i+off] || d[ch][i+off] != d_ref[ch][i+off] ) {
+						if ( nerr++ < 10 )
+							printf("%s: MISMATCH (nsmpl %u, ch %i, smpl %u): %g (float), %g (double); expected %g, %g\n",
+								sis8300DspImplName( impl ), nsmpl, ch + 1, i, f[ch][i+off], d[ch][i+off], f_ref[ch][i+off], d_ref[ch][i+off]);
+					}
+				}
+			}
+			/* raw sample scaled by 4 with unity gain */
+			if ( nsmpl > 0 ) {
+				sis8300DspCalInit( &cal, SIS8300_ADC_FMT_14_RJ );
+				if ( sis8300DspConvertDouble( &frame, &cal, dof ) )
+					return 1;
+				if ( dof[9][0] != 4.0 * (double)frame.chnl[9][0] ) {
+					if ( nerr++ < 10 )
+						printf("%s: shift not applied\n", sis8300DspImplName( impl ));
+				}
+			}
+		}
+		}
+		printf("%s: %s\n", sis8300DspImplName( impl ), nerr ? "FAILED" : "PASSED");
+	}
+
+	/* channel not in frame must be rejected */
+	if ( 0 == sis8300DigiFrameSetup( &frame, SIS8300_KIND_BEAM, 0x21, 1, buf ) ) {
+		memset( fo, 0, sizeof(fo) );
+		fo[2] = f[2];
+		if ( 0 == sis8300DspConvertFloat( &frame, 0, fo ) ) {
+			printf("Conversion of missing channel not rejected\n");
+			nerr++;
+		}
+	}
+
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+	return nerr ? 1 : 0;
+}
+
+/* Compare statistics with those of the scalar implementation and
+ * a straightforward reference computation.
+ */
+static int
+check_stats(void)
+{
+static int16_t       x[2*16*STATS_BLK + 33];
+Sis8300DspChStatsRec r, s;
+unsigned             n, i, lens[] = { 0, 1, 7, 8, 15, 16, 17, 100, 16*STATS_BLK, sizeof(x)/sizeof(x[0]) };
+int64_t              sum;
+uint64_t             sq;
+int                  impl, k, fill, nerr = 0;
+
+	for ( fill = 0; fill < 3; fill++ ) {
+		for ( i = 0; i < sizeof(x)/sizeof(x[0]); i++ ) {
+			/* random and the worst cases for the partial sums */
+			switch ( fill ) {
+				case 0:  x[i] = (int16_t)rnd64(); break;
+				case 1:  x[i] = INT16_MIN;        break;
+				default: x[i] = INT16_MAX;        break;
+			}
+		}
+		for ( k = 0; k < (int)(sizeof(lens)/sizeof(lens[0])); k++ ) {
+			n = lens[k];
+			sum = 0;
+			sq  = 0;
+			for ( i = 0; i < n; i++ ) {
+				sum += x[i];
+				sq  += (uint64_t)((int64_t)x[i] * (int64_t)x[i]);
+			}
+			sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+			sis8300DspChStats( x, n, &r );
+			if ( r.count != n || r.sum != sum || r.sumsq != sq ) {
+				if ( nerr++ < 10 )
+					printf("scalar stats: MISMATCH (n %u)\n", n);
+			}
+			for ( impl = SIS8300_DSP_IMPL_SSE2; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+				if ( sis8300DspSetImpl( impl ) < 0 )
+					continue;
+				sis8300DspChStats( x, n, &s );
+				if (    s.count != r.count || s.min   != r.min || s.max != r.max
+				     || s.sum   != r.sum   || s.sumsq != r.sumsq ) {
+					if ( nerr++ < 10 )
+						printf("%s stats: MISMATCH (n %u): min %i, max %i, sum %"PRIi64", sumsq %"PRIu64"; expected %i, %i, %"PRIi64", %"PRIu64"\n",
+							sis8300DspImplName( impl ), n, s.min, s.max, s.sum, s.sumsq, r.min, r.max, r.sum, r.sumsq);
+				}
+			}
+		}
+	}
+	printf("stats: %s\n", nerr ? "FAILED" : "PASSED");
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+	return nerr ? 1 : 0;
+}
+
+/* DDC kernels (summation order differs between implementations, hence
+ * results are compared with a tolerance) and a DDC of a known tone.
+ */
+static int
+check_ddc(void)
+{
+static int16_t     x[1000];
+static float       c[1000], sn[1000], mi[2][1000], mq[2][1000], h[70];
+static float       yi[2][200], yq[2][200];
+Sis8300FrameRec    frame;
+Sis8300DdcParmsRec parms;
+Sis8300DspCalRec   cal;
+Sis8300Ddc         ddc;
+float             *io[SIS8300_MAX_CHANNELS], *qo[SIS8300_MAX_CHANNELS];
+unsigned           n, i, k, ntaps, decim, nout;
+double             tol, a, phi, ei, eq, fclk = 250.0E6, fsig = 20.0E6;
+int                impl, nerr = 0;
+
+	for ( i = 0; i < sizeof(x)/sizeof(x[0]); i++ ) {
+		x[i]  = (int16_t)rnd64();
+		c[i]  = (float)(int64_t)rnd64() / 4.6E18;
+		sn[i] = (float)(int64_t)rnd64() / 4.6E18;
+	}
+	for ( i = 0; i < sizeof(h)/sizeof(h[0]); i++ )
+		h[i] = (float)(int64_t)rnd64() / 9.2E18;
+
+	for ( impl = SIS8300_DSP_IMPL_SSE2; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+		if ( sis8300DspSetImpl( impl ) < 0 )
+			continue;
+		for ( n = 0; n < 40; n++ ) {
+			sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+			sis8300DspMixIQ( mi[0], mq[0], x + 1, c + 1, sn + 1, n );
+			sis8300DspSetImpl( impl );
+			sis8300DspMixIQ( mi[1], mq[1], x + 1, c + 1, sn + 1, n );
+			for ( i = 0; i < n; i++ ) {
+				if ( mi[0][i] != mi[1][i] || mq[0][i] != mq[1][i] ) {
+					if ( nerr++ < 10 )
+						printf("%s mix: MISMATCH (n %u, i %u)\n", sis8300DspImplName( impl ), n, i);
+				}
+			}
+		}
+		sis8300DspMixIQ( mi[0], mq[0], x, c, sn, sizeof(x)/sizeof(x[0]) );
+		for ( ntaps = 1; ntaps <= sizeof(h)/sizeof(h[0]); ntaps += 3 ) {
+			for ( decim = 1; decim <= 12; decim += 5 ) {
+				nout = (sizeof(x)/sizeof(x[0]) - 1 - ntaps) / decim + 1;
+				if ( nout > sizeof(yi[0])/sizeof(yi[0][0]) )
+					nout = sizeof(yi[0])/sizeof(yi[0][0]);
+				sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+				sis8300DspFirDecimIQ( yi[0], yq[0], mi[0] + 1, mq[0] + 1, nout, decim, h, ntaps );
+				sis8300DspSetImpl( impl );
+				sis8300DspFirDecimIQ( yi[1], yq[1], mi[0] + 1, mq[0] + 1, nout, decim, h, ntaps );
+				for ( k = 0; k < nout; k++ ) {
+					/* bound of the rounding error */
+					for ( tol = 0.0, i = 0; i < ntaps; i++ )
+						tol += fabs( h[i] ) * (fabs( mi[0][1 + k*decim + i] ) + fabs( mq[0][1 + k*decim + i] ));
+					tol *= ntaps * 1.0E-7;
+					if ( fabs( yi[0][k] - yi[1][k] ) > tol || fabs( yq[0][k] - yq[1][k] ) > tol ) {
+						if ( nerr++ < 10 )
+							printf("%s FIR: MISMATCH (ntaps %u, decim %u, k %u): %g %g; expected %g %g\n",
+								sis8300DspImplName( impl ), ntaps, decim, k, yi[1][k], yq[1][k], yi[0][k], yq[0][k]);
+					}
+				}
+			}
+		}
+	}
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+
+	/* CIC coefficients */
+	if ( 3*(10-1)+1 != (ntaps = sis8300DdcCicTaps( 3, 10, 0 )) || ntaps != sis8300DdcCicTaps( 3, 10, h ) ) {
+		printf("sis8300DdcCicTaps: wrong number of coefficients\n");
+		nerr++;
+	} else {
+		for ( a = 0.0, i = 0; i < ntaps; i++ )
+			a += h[i];
+		if ( fabs( a - 1.0 ) > 1.0E-6 || h[0] != h[ntaps-1] || fabs( h[0] - 1.0E-3 ) > 1.0E-9 ) {
+			printf("sis8300DdcCicTaps: wrong coefficients\n");
+			nerr++;
+		}
+	}
+
+	/* tone at 20MHz on channels 1 and 2 (with different phases) */
+	a   = 10000.0;
+	phi = 0.7;
+	if ( sis8300DigiFrameSetup( &frame, SIS8300_KIND_BEAM, 0x21, 500, x ) )
+		return 1;
+	for ( i = 0; i < 500; i++ ) {
+		x[i]       = (int16_t)lrint( a * cos( 2.0*M_PI*fsig/fclk*i + phi ) );
+		x[500 + i] = (int16_t)lrint( a * cos( 2.0*M_PI*fsig/fclk*i - phi ) );
+	}
+	parms.f_nco = fsig;
+	parms.phase = 0.0;
+	parms.fclk  = (unsigned long)fclk;
+	parms.decim = 10;
+	parms.ntaps = sis8300DdcLowpassTaps( 0.02, 61, h );
+	parms.taps  = h;
+	if ( ! (ddc = sis8300DdcCreate( -1, &parms, 500 )) )
+		return 1;
+	memset( io, 0, sizeof(io) );
+	memset( qo, 0, sizeof(qo) );
+	io[0] = yi[0]; qo[0] = yq[0];
+	io[1] = yi[1]; qo[1] = yq[1];
+	sis8300DspCalInit( &cal, SIS8300_ADC_FMT_14_RJ );
+	cal.gain[1] = 0.125;
+	if ( (500 - 61)/10 + 1 != sis8300DdcGetNumOut( ddc ) || sis8300DdcProcess( ddc, &frame, &cal, io, qo ) ) {
+		printf("DDC: processing failed\n");
+		nerr++;
+	} else {
+		for ( k = 0; k < sis8300DdcGetNumOut( ddc ); k++ ) {
+			/* channel 1: scaled by 4 (shift); channel 2: 0.5 */
+			ei = yi[0][k] - 4.0 * a * cos( phi );
+			eq = yq[0][k] - 4.0 * a * sin( phi );
+			if ( fabs( ei ) > 4.0 || fabs( eq ) > 4.0 ) {
+				if ( nerr++ < 10 )
+					printf("DDC: ch 1 output %u off by %g, %g\n", k, ei, eq);
+			}
+			ei = yi[1][k] - 0.5 * a * cos( -phi );
+			eq = yq[1][k] - 0.5 * a * sin( -phi );
+			if ( fabs( ei ) > 0.5 || fabs( eq ) > 0.5 ) {
+				if ( nerr++ < 10 )
+					printf("DDC: ch 2 output %u off by %g, %g\n", k, ei, eq);
+			}
+		}
+	}
+	sis8300DdcDestroy( ddc );
+
+	printf("ddc: %s\n", nerr ? "FAILED" : "PASSED");
+	return nerr ? 1 : 0;
+}
+
+/* Position kernels and the BPM engine on frames with known button signals */
+static int
+check_bpm(void)
+{
+#define NF 37
+static float       p[NF], q[NF], r[2][NF], c[SIS8300_DSP_POLY2_NCOEFFS(SIS8300_DSP_POLY2_MAX_ORDER)];
+static int16_t     buf[NF][4*64];
+Sis8300FrameRec    frm[NF];
+Sis8300Frame       frames[NF];
+Sis8300BpmParmsRec parms;
+Sis8300Bpm         bpm;
+Sis8300BpmResults  res;
+float              px[3] = { 0.1f, 2.0f, 0.0f }, py[3] = { -0.1f, 0.0f, 3.0f };
+double             amp[4], s, xe, ye;
+unsigned           i, n, order, k;
+int                impl, b, nerr = 0;
+
+	for ( i = 0; i < NF; i++ ) {
+		p[i] = (float)(int64_t)rnd64() / 9.2E15;
+		q[i] = (float)(int64_t)rnd64() / 9.2E15;
+	}
+	for ( i = 0; i < sizeof(c)/sizeof(c[0]); i++ )
+		c[i] = (float)(int64_t)rnd64() / 9.2E18;
+
+	for ( impl = SIS8300_DSP_IMPL_SSE2; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+		if ( sis8300DspSetImpl( impl ) < 0 )
+			continue;
+		for ( n = 0; n <= NF; n++ ) {
+			sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+			sis8300DspDiffOverSum( r[0], p, q, n, 3.0f );
+			sis8300DspSetImpl( impl );
+			sis8300DspDiffOverSum( r[1], p, q, n, 3.0f );
+			if ( memcmp( r[0], r[1], n * sizeof(r[0][0]) ) ) {
+				if ( nerr++ < 10 )
+					printf("%s diff/sum: MISMATCH (n %u)\n", sis8300DspImplName( impl ), n);
+			}
+			for ( order = 0; order <= SIS8300_DSP_POLY2_MAX_ORDER; order++ ) {
+				/* use the difference over sum as inputs (|u|, |v| < 1) */
+				sis8300DspSetImpl( SIS8300_DSP_IMPL_SCALAR );
+				sis8300DspPoly2( r[0], r[1], r[1] + 1, n - (n > 0), c, order );
+				sis8300DspSetImpl( impl );
+				sis8300DspPoly2( p, r[1], r[1] + 1, n - (n > 0), c, order );
+				if ( memcmp( r[0], p, (n - (n > 0)) * sizeof(p[0]) ) ) {
+					if ( nerr++ < 10 )
+						printf("%s poly2: MISMATCH (n %u, order %u)\n", sis8300DspImplName( impl ), n, order);
+				}
+			}
+		}
+	}
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+
+	/* Frames: channels 4..1 hold buttons a..d; baseline of 100 counts in
+	 * samples 0..15, pulse in samples 16..47.
+	 */
+	memset( &parms, 0, sizeof(parms) );
+	for ( b = 0; b < 4; b++ ) {
+		parms.chnl[b] = 4 - b;
+		parms.gain[b] = 1.0f + 0.1f * b;
+	}
+	parms.win_start = 16;
+	parms.win_len   = 32;
+	parms.bl_start  = 0;
+	parms.bl_len    = 16;
+	parms.geom      = SIS8300_BPM_GEOM_DIAG;
+	parms.kx        = 10.0f;
+	parms.ky        = 20.0f;
+	parms.x_off     = 1.0f;
+	parms.min_sum   = 1000.0f;
+
+	for ( i = 0; i < NF; i++ ) {
+		if ( sis8300DigiFrameSetup( &frm[i], SIS8300_KIND_BEAM, 0x1234, 64, buf[i] ) )
+			return 1;
+		frames[i] = &frm[i];
+		for ( b = 0; b < 4; b++ ) {
+			/* buffer holds channels 4, 3, 2, 1 = buttons a, b, c, d */
+			amp[b] = (i == 5) ? 0.0 : 1000.0 + (double)(rnd64() % 7000);
+			for ( k = 0; k < 64; k++ )
+				buf[i][64*b + k] = 100 + ((k >= 16 && k < 48) ? (int16_t)amp[b] : 0);
+		}
+		/* saturate a button in frame 7 (full scale of a left-adjusted
+		 * 14-bit ADC)
+		 */
+		if ( 7 == i )
+			buf[i][64*2 + 20] = 0x7ffc;
+	}
+	if ( ! (bpm = sis8300BpmCreate( &parms, NF )) || ! (res = sis8300BpmProcess( bpm, frames, NF )) ) {
+		printf("BPM: processing failed\n");
+		return 1;
+	}
+	for ( i = 0; i < NF; i++ ) {
+		for ( b = 0; b < 4; b++ )
+			amp[b] = parms.gain[b] * 32.0 * (double)(buf[i][64*b + 16] - 100);
+		s  = amp[0] + amp[1] + amp[2] + amp[3];
+		xe = parms.kx * ((amp[0] + amp[3]) - (amp[1] + amp[2])) / s + parms.x_off;
+		ye = parms.ky * ((amp[0] + amp[1]) - (amp[2] + amp[3])) / s;
+		if ( 5 == i ) {
+			if ( ! (res->flags[i] & SIS8300_BPM_LOW_SUM) || 0.0f != res->x[i] ) {
+				if ( nerr++ < 10 )
+					printf("BPM: low sum not flagged\n");
+			}
+			continue;
+		}
+		if ( (7 == i) != !!(res->flags[i] & SIS8300_BPM_SATURATED) ) {
+			if ( nerr++ < 10 )
+				printf("BPM: saturation flag wrong (frame %u)\n", i);
+		}
+		if ( 7 == i )
+			continue;
+		if ( fabs( res->x[i] - xe ) > 1.0E-4 || fabs( res->y[i] - ye ) > 1.0E-4 || fabs( res->sum[i] - s ) > 1.0E-6 * s ) {
+			if ( nerr++ < 10 )
+				printf("BPM: frame %u: x %g, y %g, sum %g; expected %g, %g, %g\n", i, res->x[i], res->y[i], res->sum[i], xe, ye, s);
+		}
+	}
+	sis8300BpmDestroy( bpm );
+
+	/* right-adjusted 14-bit samples saturate at 8191 */
+	buf[7][64*2 + 20] = 8191;
+	parms.adc_fmt     = SIS8300_ADC_FMT_14_RJ;
+	if ( ! (bpm = sis8300BpmCreate( &parms, NF )) || ! (res = sis8300BpmProcess( bpm, frames, NF )) ) {
+		printf("BPM: processing failed\n");
+		return 1;
+	}
+	for ( i = 0; i < NF; i++ ) {
+		if ( 5 != i && (7 == i) != !!(res->flags[i] & SIS8300_BPM_SATURATED) ) {
+			if ( nerr++ < 10 )
+				printf("BPM: saturation flag wrong (right-adjusted; frame %u)\n", i);
+		}
+	}
+	sis8300BpmDestroy( bpm );
+
+	/* polynomial correction: x = 0.1 + 2 u, y = -0.1 + 3 v (planar) */
+	parms.geom    = SIS8300_BPM_GEOM_PLANAR;
+	parms.order   = 1;
+	parms.px      = px;
+	parms.py      = py;
+	parms.min_sum = 0.0f;
+	if ( ! (bpm = sis8300BpmCreate( &parms, NF )) ) {
+		printf("BPM: creation failed\n");
+		return 1;
+	}
+	p[0] = 3.0f; p[1] = 1.0f;
+	q[0] = 1.0f; q[1] = 1.0f;
+	/* a = 3, b = 1, c = 1, d = 1 -> u = 0.5, v = 0 */
+	res = sis8300BpmPositions( bpm, p, p + 1, q, q + 1, 1 );
+	if ( ! res || fabs( res->x[0] - 1.1 ) > 1.0E-6 || fabs( res->y[0] + 0.1 ) > 1.0E-6 ) {
+		printf("BPM: polynomial correction failed\n");
+		nerr++;
+	}
+	sis8300BpmDestroy( bpm );
+
+	printf("bpm: %s\n", nerr ? "FAILED" : "PASSED");
+	return nerr ? 1 : 0;
+#undef NF
+}
+
+/* Calibration: channels with known tone amplitudes and phases */
+static int
+check_cal(void)
+{
+static int16_t      buf[3*256];
+static const double amp[3] = { 1000.0, 2000.0, 500.0 };
+static const double phs[3] = { 0.0, 0.3, -0.5 };
+Sis8300FrameRec     frame;
+Sis8300CalParmsRec  parms;
+Sis8300CalCoeffsRec c;
+Sis8300DspCalRec    dcal;
+Sis8300Cal          cal;
+float               g[2];
+int                 chl[2] = { 3, 7 };
+float               base[2] = { 2.0f, 3.0f };
+unsigned            i, f;
+int                 ch, kind, nerr = 0;
+
+	parms.f_cal     = 250.0E6/16.0;
+	parms.fclk      = 250000000UL;
+	parms.win_start = 32;
+	parms.win_len   = 192;
+	parms.navg      = 4;
+	parms.ref_chnl  = 1;
+	if ( ! (cal = sis8300CalCreate( -1, &parms )) )
+		return 1;
+
+	sis8300CalGet( cal, &c );
+	if ( c.valid || 1.0f != c.gain[0] ) {
+		printf("cal: initial coefficients wrong\n");
+		nerr++;
+	}
+
+	for ( f = 0; f < 10; f++ ) {
+		kind = (f & 1) ? SIS8300_KIND_CGRN : SIS8300_KIND_CRED;
+		/* selector 0x321: channel 1 first */
+		if ( sis8300DigiFrameSetup( &frame, kind, 0x321, 256, buf ) )
+			return 1;
+		for ( ch = 0; ch < 3; ch++ ) {
+			for ( i = 0; i < 256; i++ ) {
+				/* green a bit stronger; add some noise */
+				buf[256*ch + i] = (int16_t)lrint( ((f & 1) ? 1.1 : 1.0) * amp[ch] * cos( 2.0*M_PI*i/16.0 + phs[ch] ) + (double)(rnd64() % 5) - 2.0 );
+			}
+		}
+		if ( sis8300CalAccumulate( cal, &frame ) ) {
+			printf("cal: accumulation failed\n");
+			nerr++;
+		}
+	}
+	frame.kind = SIS8300_KIND_BEAM;
+	if ( 1 != sis8300CalAccumulate( cal, &frame ) ) {
+		printf("cal: beam frame not ignored\n");
+		nerr++;
+	}
+
+	sis8300CalGet( cal, &c );
+	if ( 5 != c.n_red || 5 != c.n_grn || 0x7 != c.valid || c.generation != sis8300CalGeneration( cal ) ) {
+		printf("cal: wrong counters/valid mask\n");
+		nerr++;
+	}
+	for ( ch = 0; ch < 3; ch++ ) {
+		if ( fabs( c.gain[ch] - amp[0]/amp[ch] ) > 1.0E-2 * amp[0]/amp[ch] || fabs( c.phase[ch] - phs[ch] ) > 1.0E-2 ) {
+			if ( nerr++ < 10 )
+				printf("cal: channel %i: gain %g, phase %g; expected %g, %g\n", ch + 1, c.gain[ch], c.phase[ch], amp[0]/amp[ch], phs[ch]);
+		}
+	}
+
+	sis8300DspCalInit( &dcal, 0 );
+	sis8300CalToDsp( &c, 0, &dcal );
+	sis8300CalToGains( &c, chl, base, g, 2 );
+	if ( dcal.gain[2] != c.gain[2] || 1.0 != dcal.gain[3] || g[0] != 2.0f * c.gain[2] || g[1] != 3.0f ) {
+		printf("cal: applying coefficients failed\n");
+		nerr++;
+	}
+
+	sis8300CalReset( cal );
+	sis8300CalGet( cal, &c );
+	if ( c.valid || c.n_red ) {
+		printf("cal: reset failed\n");
+		nerr++;
+	}
+	sis8300CalDestroy( cal );
+
+	printf("cal: %s\n", nerr ? "FAILED" : "PASSED");
+	return nerr ? 1 : 0;
+}
+
+/* Deinterleaving (exact); unaligned and odd lengths */
+static int
+check_dil(void)
+{
+static int16_t x[2*100 + 1], a[100 + 1], b[100 + 1];
+unsigned       n, i;
+int            impl, nerr = 0;
+
+	for ( i = 0; i < sizeof(x)/sizeof(x[0]); i++ )
+		x[i] = (int16_t)rnd64();
+
+	for ( impl = SIS8300_DSP_IMPL_SCALAR; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+		if ( sis8300DspSetImpl( impl ) < 0 )
+			continue;
+		for ( n = 0; n <= 100; n++ ) {
+			memset( a, 0, sizeof(a) );
+			memset( b, 0, sizeof(b) );
+			sis8300DspDeinterleave( a + 1, b + 1, x + 1, n );
+			for ( i = 0; i < n; i++ ) {
+				if ( a[i + 1] != x[2*i + 1] || b[i + 1] != x[2*i + 2] ) {
+					if ( nerr++ < 10 )
+						printf("%s deinterleave: MISMATCH (n %u, i %u)\n", sis8300DspImplName( impl ), n, i);
+					break;
+				}
+			}
+			if ( a[0] || b[0] || (n < 100 && (a[n + 1] || b[n + 1])) ) {
+				if ( nerr++ < 10 )
+					printf("%s deinterleave: out of bounds (n %u)\n", sis8300DspImplName( impl ), n);
+			}
+		}
+	}
+	printf("deinterleave: %s\n", nerr ? "FAILED" : "PASSED");
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+	return nerr ? 1 : 0;
+}
+
+static double
+bench_now(void)
+{
+struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return (double)t.tv_sec * 1.0E9 + (double)t.tv_nsec;
+}
+
+static int
+bench(unsigned nsmpl)
+{
+Sis8300FrameRec    frame;
+Sis8300DspCalRec   cal;
+Sis8300DspStatsRec stats;
+Sis8300DdcParmsRec parms;
+Sis8300Ddc         ddc;
+float              h[64];
+float             *io[SIS8300_MAX_CHANNELS], *qo[SIS8300_MAX_CHANNELS];
+Sis8300BpmParmsRec bparms;
+Sis8300Bpm         bpm;
+float              poly[SIS8300_DSP_POLY2_NCOEFFS(3)];
+int16_t           *buf;
+float             *fo[SIS8300_MAX_CHANNELS];
+double            *dof[SIS8300_MAX_CHANNELS];
+double             t0, bytes;
+int                impl, ch, rep, nrep;
+
+	if ( 0 == nsmpl )
+		return 0;
+
+	buf = malloc( sizeof(*buf) * SIS8300_MAX_CHANNELS * nsmpl );
+	if ( ! buf )
+		return 1;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		fo[ch]  = malloc( sizeof(*fo[ch])  * nsmpl );
+		dof[ch] = malloc( sizeof(*dof[ch]) * nsmpl );
+		if ( ! fo[ch] || ! dof[ch] )
+			return 1;
+	}
+	if ( mkframe( &frame, buf, SIS8300_MAX_CHANNELS, nsmpl ) )
+		return 1;
+	sis8300DspCalInit( &cal, 0 );
+
+	memset( &bparms, 0, sizeof(bparms) );
+	for ( ch = 0; ch < SIS8300_BPM_NBTNS; ch++ ) {
+		bparms.chnl[ch] = ch + 1;
+		bparms.gain[ch] = 1.0f;
+	}
+	for ( ch = 0; ch < (int)(sizeof(poly)/sizeof(poly[0])); ch++ )
+		poly[ch] = 1.0f / (float)(ch + 1);
+	bparms.win_len = 1;
+	bparms.order   = 3;
+	bparms.px      = poly;
+	bparms.py      = poly;
+
+	/* about 1GB of input per measurement */
+	nrep = (int)(1.0E9 / (2.0 * SIS8300_MAX_CHANNELS * nsmpl)) + 1;
+
+	for ( impl = SIS8300_DSP_IMPL_SCALAR; impl <= SIS8300_DSP_IMPL_AVX2; impl++ ) {
+		if ( sis8300DspSetImpl( impl ) < 0 )
+			continue;
+		/* warm up */
+		sis8300DspConvertFloat( &frame, &cal, fo );
+		t0 = bench_now();
+		for ( rep = 0; rep < nrep; rep++ )
+			sis8300DspConvertFloat( &frame, &cal, fo );
+		t0 = bench_now() - t0;
+		bytes = (double)nrep * SIS8300_MAX_CHANNELS * nsmpl * (sizeof(int16_t) + sizeof(float));
+		printf("%-8s float : %8.2f ns/frame, %6.2f GB/s (in + out)\n", sis8300DspImplName( impl ), t0/nrep, bytes/t0);
+
+		sis8300DspConvertDouble( &frame, &cal, dof );
+		t0 = bench_now();
+		for ( rep = 0; rep < nrep; rep++ )
+			sis8300DspConvertDouble( &frame, &cal, dof );
+		t0 = bench_now() - t0;
+		bytes = (double)nrep * SIS8300_MAX_CHANNELS * nsmpl * (sizeof(int16_t) + sizeof(double));
+		printf("%-8s double: %8.2f ns/frame, %6.2f GB/s (in + out)\n", sis8300DspImplName( impl ), t0/nrep, bytes/t0);
+
+		sis8300DspStats( &frame, &stats );
+		t0 = bench_now();
+		for ( rep = 0; rep < nrep; rep++ )
+			sis8300DspStats( &frame, &stats );
+		t0 = bench_now() - t0;
+		bytes = (double)nrep * SIS8300_MAX_CHANNELS * nsmpl * sizeof(int16_t);
+		printf("%-8s stats : %8.2f ns/frame, %6.2f GB/s (in)\n", sis8300DspImplName( impl ), t0/nrep, bytes/t0);
+
+		/* DDC: 64 taps, decimation by 8; I/Q output into the float arrays */
+		parms.f_nco = 20.0E6;
+		parms.phase = 0.0;
+		parms.fclk  = 250000000UL;
+		parms.decim = 8;
+		parms.ntaps = sis8300DdcLowpassTaps( 0.05, 64, h );
+		parms.taps  = h;
+		if ( nsmpl >= parms.ntaps && (ddc = sis8300DdcCreate( -1, &parms, nsmpl )) ) {
+			/* 5 channels: I to fo[ch], Q to fo[ch+5] */
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				io[ch] = ch < SIS8300_MAX_CHANNELS/2 ? fo[ch] : 0;
+				qo[ch] = ch < SIS8300_MAX_CHANNELS/2 ? fo[ch + SIS8300_MAX_CHANNELS/2] : 0;
+			}
+			sis8300DdcProcess( ddc, &frame, 0, io, qo );
+			t0 = bench_now();
+			for ( rep = 0; rep < nrep/10 + 1; rep++ )
+				sis8300DdcProcess( ddc, &frame, 0, io, qo );
+			t0 = bench_now() - t0;
+			bytes = (double)(nrep/10 + 1) * SIS8300_MAX_CHANNELS/2 * nsmpl * sizeof(int16_t);
+			printf("%-8s ddc   : %8.2f ns/frame, %6.2f GB/s (in; 5 channels)\n", sis8300DspImplName( impl ), t0/(nrep/10 + 1), bytes/t0);
+			sis8300DdcDestroy( ddc );
+		}
+
+		/* BPM positions (3rd-order correction); button signals from the float arrays */
+		if ( (bpm = sis8300BpmCreate( &bparms, nsmpl )) ) {
+			sis8300BpmPositions( bpm, fo[0], fo[1], fo[2], fo[3], nsmpl );
+			t0 = bench_now();
+			for ( rep = 0; rep < nrep; rep++ )
+				sis8300BpmPositions( bpm, fo[0], fo[1], fo[2], fo[3], nsmpl );
+			t0 = bench_now() - t0;
+			printf("%-8s bpm   : %8.2f ns/position\n", sis8300DspImplName( impl ), t0/((double)nrep * nsmpl));
+			sis8300BpmDestroy( bpm );
+		}
+	}
+	sis8300DspSetImpl( SIS8300_DSP_IMPL_AUTO );
+
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		free( fo[ch] );
+		free( dof[ch] );
+	}
+	free( buf );
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+int      opt;
+unsigned n_bench = 0;
+long     seed;
+int      rval;
+
+	while ( (opt = getopt(argc, argv, "hb:s:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'b':
+				if ( 1 != sscanf(optarg,"%u",&n_bench) ) {
+					fprintf(stderr,"Invalid -b argument\n");
+					return 1;
+				}
+				break;
+			case 's':
+				if ( 1 != sscanf(optarg,"%li",&seed) ) {
+					fprintf(stderr,"Invalid -s argument\n");
+					return 1;
+				}
+				/* state must not be zero */
+				rnd_state = (uint64_t)seed ^ 0x2545f4914f6cdd1dULL;
+				if ( 0 == rnd_state )
+					rnd_state = 1;
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	printf("Default implementation: %s\n", sis8300DspImplName( sis8300DspGetImpl() ));
+
+	if (    (rval = check())
+	     || (rval = check_stats())
+	     || (rval = check_ddc())
+	     || (rval = check_bpm())
+	     || (rval = check_cal())
+	     || (rval = check_dil()) )
+		return rval;
+
+	return bench( n_bench );
+}
+#endif
@@ -0,0 +1,150 @@
+#ifndef SIS8300DSP_H
+#define SIS8300DSP_H
+
+#include <sis8300Digi.h>
+
+/* Sample processing kernels.
+ *
+ * The kernels operate on frames (see sis8300Digi.h) and are available
+ * in several implementations (scalar C, SSE2, AVX2). The best one
+ * supported by the CPU is selected at run-time when the first kernel
+ * is used; sis8300DspSetImpl() may be used to override the choice
+ * (e.g., for testing or benchmarking).
+ */
+
+#define SIS8300_DSP_IMPL_AUTO   (-1)
+#define SIS8300_DSP_IMPL_SCALAR   0
+#define SIS8300_DSP_IMPL_SSE2     1
+#define SIS8300_DSP_IMPL_AVX2     2
+
+/* Select implementation (SIS8300_DSP_IMPL_AUTO: best available).
+ * This is not thread-safe; no kernels must be executing.
+ *
+ * RETURNS: implementation selected or -1 if 'impl' is not supported
+ *          on this CPU (previous selection remains in effect).
+ */
+int
+sis8300DspSetImpl(int impl);
+
+/* RETURNS: implementation currently in use */
+int
+sis8300DspGetImpl(void);
+
+/* RETURNS: name of an implementation (static string) */
+const char *
+sis8300DspImplName(int impl);
+
+/* Conversion of raw samples.
+ *
+ *   y = gain[ch-1] * (raw << shift) + offset[ch-1]
+ *
+ * 'shift' brings samples of 14-bit ADCs which are delivered right-adjusted
+ * onto the scale of 16-bit samples; it is obtained from
+ * sis8300DigiGetAdcFormat(). Hence gain and offset always refer to the
+ * 16-bit scale, no matter what digitizer is used.
+ */
+typedef struct Sis8300DspCalRec_ {
+	int                shift;   /* SIS8300_ADC_FMT_xxx                          */
+	double             gain  [SIS8300_MAX_CHANNELS]; /* indexed by channel # - 1 */
+	double             offset[SIS8300_MAX_CHANNELS];
+} Sis8300DspCalRec, *Sis8300DspCal;
+
+/* Initialize: unity gain, zero offset */
+void
+sis8300DspCalInit(Sis8300DspCal cal, int shift);
+
+/* Convert the channels of a frame into separate arrays of 'frame->nsmpl'
+ * elements. out[ch-1] receives the samples of channel # 'ch'; channels
+ * for which out[ch-1] is NULL are skipped. 'cal' may be NULL (unity gain,
+ * zero offset and no shift).
+ *
+ * RETURNS: 0 on success, -1 if an output is given for a channel which
+ *          is not in the frame.
+ */
+int
+sis8300DspConvertFloat(Sis8300Frame frame, Sis8300DspCal cal, float *out[SIS8300_MAX_CHANNELS]);
+
+int
+sis8300DspConvertDouble(Sis8300Frame frame, Sis8300DspCal cal, double *out[SIS8300_MAX_CHANNELS]);
+
+/* Per-channel statistics (of raw samples, i.e., without shift or
+ * calibration applied) computed in a single pass.
+ */
+typedef struct Sis8300DspChStatsRec_ {
+	uint32_t           count;   /* number of samples; zero if channel not in frame */
+	int16_t            min;
+	int16_t            max;
+	int64_t            sum;
+	uint64_t           sumsq;   /* sum of squares                               */
+} Sis8300DspChStatsRec, *Sis8300DspChStats;
+
+typedef struct Sis8300DspStatsRec_ {
+	Sis8300DspChStatsRec ch[SIS8300_MAX_CHANNELS]; /* indexed by channel # - 1 */
+} Sis8300DspStatsRec, *Sis8300DspStats;
+
+/* Compute statistics of all channels in a frame */
+void
+sis8300DspStats(Sis8300Frame frame, Sis8300DspStats stats);
+
+/* Statistics of a single block of samples */
+void
+sis8300DspChStats(const int16_t *x, unsigned n, Sis8300DspChStats stats);
+
+/* Mean and RMS (root of the mean of squares) of raw samples; zero if
+ * there are no samples. With calibration (see above) the calibrated
+ * mean is gain * 2^shift * mean + offset, the standard deviation
+ * |gain| * 2^shift * sqrt( rms^2 - mean^2 ).
+ */
+double
+sis8300DspStatsMean(Sis8300DspChStats stats);
+
+double
+sis8300DspStatsRms(Sis8300DspChStats stats);
+
+/* Kernels for a single block of samples: y[i] = g * x[i] + o */
+void
+sis8300DspI16ToFloat(float *y, const int16_t *x, unsigned n, float g, float o);
+
+void
+sis8300DspI16ToDouble(double *y, const int16_t *x, unsigned n, double g, double o);
+
+/* Mixer (see sis8300Ddc.h): i[k] = c[k] * x[k], q[k] = s[k] * x[k] */
+void
+sis8300DspMixIQ(float *i, float *q, const int16_t *x, const float *c, const float *s, unsigned n);
+
+/* Decimating FIR filter applied to a pair of signals:
+ *
+ *   yi[k] = sum_{j < ntaps} h[j] * xi[k * decim + j],   k < nout
+ *
+ * (same for yq/xq); the inputs must hold (nout - 1) * decim + ntaps elements.
+ */
+void
+sis8300DspFirDecimIQ(float *yi, float *yq, const float *xi, const float *xq, unsigned nout, unsigned decim, const float *h, unsigned ntaps);
+
+/* Difference over sum: r[i] = k * (p[i] - q[i]) / (p[i] + q[i]) */
+void
+sis8300DspDiffOverSum(float *r, const float *p, const float *q, unsigned n, float k);
+
+/* Polynomial in two variables of total degree 'order':
+ *
+ *   r[i] = sum_{a + b <= order} c[k] * u[i]^a * v[i]^b
+ *
+ * Coefficients are ordered by total degree and then by decreasing power
+ * of u: 1, u, v, u^2, u*v, v^2, u^3, ... (SIS8300_DSP_POLY2_NCOEFFS(order)
+ * of them).
+ *
+ * RETURNS: 0 on success, -1 if 'order' is too high.
+ */
+#define SIS8300_DSP_POLY2_MAX_ORDER 5
+#define SIS8300_DSP_POLY2_NCOEFFS(order) (((order) + 1) * ((order) + 2) / 2)
+
+int
+sis8300DspPoly2(float *r, const float *u, const float *v, unsigned n, const float *c, unsigned order);
+
+/* Split 'n' sample pairs: a[i] = x[2*i], b[i] = x[2*i + 1] (memory
+ * layout of the dual-channel firmware; 'x' must not overlap the outputs).
+ */
+void
+sis8300DspDeinterleave(int16_t *a, int16_t *b, const int16_t *x, unsigned n);
+
+#endif
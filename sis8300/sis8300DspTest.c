@@ -0,0 +1,3 @@
+/* Test and benchmark program for sis8300Dsp.c (run with -h for options) */
+#define TEST_SIS8300DSP
+#include "sis8300Dsp.c"
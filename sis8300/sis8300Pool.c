@@ -0,0 +1,474 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include <sis8300Pool.h>
+
+/* Frame buffer pool (see sis8300Pool.h)
+ *
+ * Free buffers form a stack (Treiber) linked through next[]; the head
+ * word holds the index of the top buffer and a tag which is incremented
+ * with every update so that a CAS cannot succeed on a head which was
+ * popped and pushed again in the meantime (ABA).
+ *
+ * mbind() is called directly (the system call) to avoid a dependency
+ * on libnuma.
+ */
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#define POOL_NIL     ((uint32_t)-1)
+#define HEAD(tag, i) (((uint64_t)(tag) << 32) | (uint32_t)(i))
+
+typedef struct Sis8300PoolRec_ {
+	char              *mem;     /* the mapping                             */
+	size_t             mapsz;
+	char              *base;    /* first buffer                            */
+	size_t             stride;
+	Sis8300PoolInfoRec info;
+	uint64_t           head;    /* tag << 32 | top of the free stack       */
+	uint32_t          *next;
+	uint8_t           *busy;    /* catches buffers returned twice          */
+} Sis8300PoolRec;
+
+int
+sis8300PoolNumaNode(int fd)
+{
+struct stat sb;
+char        path[64];
+FILE       *f;
+int         node;
+
+	if ( fstat( fd, &sb ) ) {
+		fprintf(stderr,"sis8300PoolNumaNode: fstat failed: %s\n", strerror(errno));
+		return -1;
+	}
+	snprintf( path, sizeof(path), "/sys/dev/char/%u:%u/device/numa_node", major( sb.st_rdev ), minor( sb.st_rdev ) );
+	if ( ! (f = fopen( path, "r" )) )
+		return -1;
+	if ( 1 != fscanf( f, "%i", &node ) )
+		node = -1;
+	fclose( f );
+	return node;
+}
+
+static int
+pool_bind(void *addr, size_t len, int node)
+{
+unsigned long mask[16];
+unsigned      bits = 8 * sizeof(mask[0]);
+
+	if ( node < 0 || (unsigned)node >= sizeof(mask) * 8 ) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset( mask, 0, sizeof(mask) );
+	mask[node / bits] = 1UL << (node % bits);
+	return syscall( SYS_mbind, addr, len, MPOL_BIND, mask, sizeof(mask) * 8, 0 ) ? -1 : 0;
+}
+
+#ifdef MAP_HUGETLB
+/* Free huge pages on a NUMA node (-1 if unknown) */
+static long
+node_free_huge(int node)
+{
+char  path[128];
+FILE *f;
+long  n;
+
+	snprintf( path, sizeof(path), "/sys/devices/system/node/node%i/hugepages/hugepages-%lukB/free_hugepages",
+	          node, (unsigned long)(SIS8300_ALIGN_HUGEPAGE / 1024) );
+	if ( ! (f = fopen( path, "r" )) )
+		return -1;
+	if ( 1 != fscanf( f, "%li", &n ) )
+		n = -1;
+	fclose( f );
+	return n;
+}
+#endif
+
+Sis8300Pool
+sis8300PoolCreate(Sis8300PoolParms parms)
+{
+Sis8300Pool pool;
+size_t      align = parms->align ? parms->align : SIS8300_ALIGN_PAGE;
+size_t      pgsz  = sysconf( _SC_PAGESIZE );
+size_t      need;
+unsigned    i;
+
+	if ( 0 == parms->bufsz || parms->nbufs < 1 || parms->nbufs > SIS8300_POOL_MAX_BUFS ) {
+		fprintf(stderr,"sis8300PoolCreate: invalid buffer size or number of buffers (1..%u)\n", SIS8300_POOL_MAX_BUFS);
+		return 0;
+	}
+	if ( (align & (align - 1)) ) {
+		fprintf(stderr,"sis8300PoolCreate: alignment must be a power of two\n");
+		return 0;
+	}
+
+	if ( ! (pool = calloc( 1, sizeof(*pool) )) ) {
+		fprintf(stderr,"sis8300PoolCreate: no memory\n");
+		return 0;
+	}
+	pool->mem         = MAP_FAILED;
+	pool->stride      = (parms->bufsz + align - 1) & ~(align - 1);
+	pool->info.bufsz  = parms->bufsz;
+	pool->info.stride = pool->stride;
+	pool->info.align  = align;
+	pool->info.nbufs  = parms->nbufs;
+	pool->info.avail  = parms->nbufs;
+	pool->info.node   = -1;
+
+	if (    ! (pool->next = malloc( parms->nbufs * sizeof(*pool->next) ))
+	     || ! (pool->busy = calloc( parms->nbufs, sizeof(*pool->busy) )) ) {
+		fprintf(stderr,"sis8300PoolCreate: no memory\n");
+		goto bail;
+	}
+
+	if ( (parms->flags & SIS8300_POOL_NUMA) )
+		pool->info.node = parms->node >= 0 ? parms->node : sis8300PoolNumaNode( parms->fd );
+
+#ifdef MAP_HUGETLB
+	if ( (parms->flags & SIS8300_POOL_HUGE) ) {
+		need        = pool->stride * parms->nbufs + (align > SIS8300_ALIGN_HUGEPAGE ? align - SIS8300_ALIGN_HUGEPAGE : 0);
+		pool->mapsz = (need + SIS8300_ALIGN_HUGEPAGE - 1) & ~(SIS8300_ALIGN_HUGEPAGE - 1);
+		/* the reservation made by mmap() is not per node; a bound mapping
+		 * faulting on a node without free huge pages gets SIGBUS
+		 */
+		if ( pool->info.node >= 0 && node_free_huge( pool->info.node ) < (long)(pool->mapsz / SIS8300_ALIGN_HUGEPAGE) ) {
+			fprintf(stderr,"sis8300PoolCreate: not enough free huge pages on NUMA node %i; using normal pages\n", pool->info.node);
+		} else {
+			pool->mem = mmap( 0, pool->mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+			if ( MAP_FAILED == pool->mem )
+				fprintf(stderr,"sis8300PoolCreate: no huge pages (%s); using normal pages\n", strerror(errno));
+			else
+				pool->info.huge = 1;
+		}
+	}
+#endif
+	if ( MAP_FAILED == pool->mem ) {
+		need        = pool->stride * parms->nbufs + (align > pgsz ? align - pgsz : 0);
+		pool->mapsz = (need + pgsz - 1) & ~(pgsz - 1);
+		pool->mem   = mmap( 0, pool->mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( MAP_FAILED == pool->mem ) {
+			fprintf(stderr,"sis8300PoolCreate: mmap failed: %s\n", strerror(errno));
+			goto bail;
+		}
+#ifdef MADV_HUGEPAGE
+		if ( (parms->flags & SIS8300_POOL_HUGE) )
+			madvise( pool->mem, pool->mapsz, MADV_HUGEPAGE );
+#endif
+	}
+	pool->base = (char*)(((uintptr_t)pool->mem + align - 1) & ~(uintptr_t)(align - 1));
+
+	/* bind before the pages are touched */
+	if ( pool->info.node >= 0 && pool_bind( pool->mem, pool->mapsz, pool->info.node ) ) {
+		fprintf(stderr,"sis8300PoolCreate: binding to NUMA node %i failed: %s\n", pool->info.node, strerror(errno));
+		goto bail;
+	}
+
+	if ( (parms->flags & SIS8300_POOL_LOCK) ) {
+		if ( mlock( pool->mem, pool->mapsz ) ) {
+			fprintf(stderr,"sis8300PoolCreate: mlock failed: %s (RLIMIT_MEMLOCK?)\n", strerror(errno));
+			goto bail;
+		}
+		pool->info.locked = 1;
+	}
+
+	/* fault everything in now rather than in the acquisition path */
+	memset( pool->mem, 0, pool->mapsz );
+
+	for ( i = 0; i < parms->nbufs; i++ )
+		pool->next[i] = i + 1 < parms->nbufs ? i + 1 : POOL_NIL;
+	pool->head = HEAD( 0, 0 );
+
+	return pool;
+
+bail:
+	sis8300PoolDestroy( pool );
+	return 0;
+}
+
+void
+sis8300PoolDestroy(Sis8300Pool pool)
+{
+	if ( ! pool )
+		return;
+	if ( pool->info.avail != pool->info.nbufs )
+		fprintf(stderr,"sis8300PoolDestroy: WARNING -- %u buffer(s) still in use\n", pool->info.nbufs - pool->info.avail);
+	if ( MAP_FAILED != pool->mem )
+		munmap( pool->mem, pool->mapsz );
+	free( pool->next );
+	free( pool->busy );
+	free( pool );
+}
+
+void *
+sis8300PoolGet(Sis8300Pool pool)
+{
+uint64_t h, n;
+uint32_t i;
+
+	h = __atomic_load_n( &pool->head, __ATOMIC_ACQUIRE );
+	do {
+		if ( POOL_NIL == (i = (uint32_t)h) )
+			return 0;
+		/* next[i] may be stale if 'i' was popped meanwhile; the CAS fails then */
+		n = HEAD( (h >> 32) + 1, __atomic_load_n( &pool->next[i], __ATOMIC_RELAXED ) );
+	} while ( ! __atomic_compare_exchange_n( &pool->head, &h, n, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE ) );
+
+	__atomic_store_n( &pool->busy[i], 1, __ATOMIC_RELAXED );
+	__atomic_sub_fetch( &pool->info.avail, 1, __ATOMIC_RELAXED );
+	return pool->base + (size_t)i * pool->stride;
+}
+
+int
+sis8300PoolPut(Sis8300Pool pool, void *buf)
+{
+uint64_t h, n;
+uint32_t i;
+
+	i = sis8300PoolIndex( pool, buf );
+	if ( i >= pool->info.nbufs || ! __atomic_exchange_n( &pool->busy[i], 0, __ATOMIC_RELAXED ) ) {
+		fprintf(stderr,"sis8300PoolPut: not a buffer of this pool (or returned twice)\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	__atomic_add_fetch( &pool->info.avail, 1, __ATOMIC_RELAXED );
+	h = __atomic_load_n( &pool->head, __ATOMIC_RELAXED );
+	do {
+		__atomic_store_n( &pool->next[i], (uint32_t)h, __ATOMIC_RELAXED );
+		n = HEAD( (h >> 32) + 1, i );
+	} while ( ! __atomic_compare_exchange_n( &pool->head, &h, n, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+	return 0;
+}
+
+unsigned
+sis8300PoolIndex(Sis8300Pool pool, const void *buf)
+{
+uintptr_t off = (uintptr_t)buf - (uintptr_t)pool->base;
+
+	if ( (const char*)buf < pool->base || (off % pool->stride) )
+		return (unsigned)-1;
+	return off / pool->stride;
+}
+
+void *
+sis8300PoolBuf(Sis8300Pool pool, unsigned idx)
+{
+	return idx < pool->info.nbufs ? pool->base + (size_t)idx * pool->stride : 0;
+}
+
+void
+sis8300PoolGetInfo(Sis8300Pool pool, Sis8300PoolInfo info)
+{
+	*info       = pool->info;
+	info->avail = __atomic_load_n( &pool->info.avail, __ATOMIC_RELAXED );
+}
+
+#ifdef TEST_SIS8300POOL
+/* Stress test: threads get and put buffers concurrently; every buffer
+ * handed out is marked as owned (a buffer handed out twice is caught)
+ * and stamped. Also checks exhaustion and that foreign pointers and
+ * buffers returned twice are rejected.
+ */
+#include <pthread.h>
+#include <getopt.h>
+
+#define TEST_MAX_HELD 8
+
+typedef struct TestThrRec_ {
+	Sis8300Pool  pool;
+	unsigned    *owner;   /* 0 or 1 + index of the thread holding a buffer */
+	unsigned     idx;
+	unsigned     niter;
+	unsigned     bad;
+	unsigned     empty;
+} TestThrRec, *TestThr;
+
+static void *
+test_thr(void *arg)
+{
+TestThr   t = arg;
+void     *held[TEST_MAX_HELD];
+unsigned  it, n, k, i, zero, seed = t->idx;
+
+	for ( it = 0; it < t->niter; it++ ) {
+		n = 1 + rand_r( &seed ) % TEST_MAX_HELD;
+		for ( k = 0; k < n; k++ ) {
+			if ( ! (held[k] = sis8300PoolGet( t->pool )) ) {
+				t->empty++;
+				break;
+			}
+			i    = sis8300PoolIndex( t->pool, held[k] );
+			zero = 0;
+			if (    i >= t->pool->info.nbufs
+			     || ! __atomic_compare_exchange_n( &t->owner[i], &zero, t->idx + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) ) {
+				fprintf(stderr,"Buffer %u handed out twice\n", i);
+				t->bad++;
+				held[k] = 0;
+				continue;
+			}
+			*(unsigned*)held[k] = (t->idx << 24) | it;
+		}
+		n = k;
+		for ( k = 0; k < n; k++ ) {
+			if ( ! held[k] )
+				continue;
+			i = sis8300PoolIndex( t->pool, held[k] );
+			if ( *(unsigned*)held[k] != ((t->idx << 24) | it) )
+				t->bad++;
+			__atomic_store_n( &t->owner[i], 0, __ATOMIC_RELEASE );
+			if ( sis8300PoolPut( t->pool, held[k] ) )
+				t->bad++;
+		}
+	}
+	return 0;
+}
+
+static void
+usage(const char *nm)
+{
+	printf("Usage: %s [-h] [-H] [-t n_threads] [-n n_bufs] [-i n_iterations]\n", nm);
+	printf("    Get and put pool buffers from several threads and check them\n");
+	printf("  -H              : back the pool with huge pages\n");
+	printf("  -t n_threads    : number of threads (default 8)\n");
+	printf("  -n n_bufs       : number of buffers (default 32)\n");
+	printf("  -i n_iterations : get/put rounds per thread (default 200000)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+Sis8300PoolParmsRec pp;
+Sis8300PoolInfoRec  inf;
+Sis8300Pool         pool;
+TestThrRec          thr[64];
+pthread_t           tid[64];
+unsigned           *owner;
+void              **all;
+unsigned            nthr = 8, niter = 200000, k, bad = 0, nbad, empty = 0;
+int                 opt, foreign;
+
+	memset( &pp, 0, sizeof(pp) );
+	pp.bufsz = 12345;
+	pp.nbufs = 32;
+	pp.node  = -1;
+	pp.fd    = -1;
+
+	while ( (opt = getopt(argc, argv, "hHt:n:i:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'H':
+				pp.flags |= SIS8300_POOL_HUGE;
+				break;
+			case 't':
+				if ( 1 != sscanf(optarg,"%u",&nthr) || nthr < 1 || nthr > sizeof(thr)/sizeof(thr[0]) ) {
+					fprintf(stderr,"Invalid -t argument (1..%u)\n", (unsigned)(sizeof(thr)/sizeof(thr[0])));
+					return 1;
+				}
+				break;
+			case 'n':
+				if ( 1 != sscanf(optarg,"%u",&pp.nbufs) ) {
+					fprintf(stderr,"Invalid -n argument\n");
+					return 1;
+				}
+				break;
+			case 'i':
+				if ( 1 != sscanf(optarg,"%u",&niter) ) {
+					fprintf(stderr,"Invalid -i argument\n");
+					return 1;
+				}
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	if ( ! (pool = sis8300PoolCreate( &pp )) )
+		return 1;
+	if (    ! (owner = calloc( pp.nbufs, sizeof(*owner) ))
+	     || ! (all   = calloc( pp.nbufs, sizeof(*all) )) ) {
+		fprintf(stderr,"No memory\n");
+		return 1;
+	}
+
+	/* exhaustion */
+	for ( k = 0; k < pp.nbufs; k++ ) {
+		if ( ! (all[k] = sis8300PoolGet( pool )) || ((uintptr_t)all[k] & (SIS8300_ALIGN_PAGE - 1)) )
+			bad++;
+	}
+	if ( sis8300PoolGet( pool ) )
+		bad++;
+	for ( k = 0; k < pp.nbufs; k++ ) {
+		if ( all[k] && sis8300PoolPut( pool, all[k] ) )
+			bad++;
+	}
+	printf("Exhaustion: %u errors\n", bad);
+
+	/* these are rejected (with a message) */
+	nbad = bad;
+	if ( 0 == sis8300PoolPut( pool, &foreign ) || EINVAL != errno )
+		bad++;
+	if ( ! (all[0] = sis8300PoolGet( pool )) ) {
+		bad++;
+	} else {
+		if ( 0 == sis8300PoolPut( pool, (char*)all[0] + 1 ) )
+			bad++;
+		if ( sis8300PoolPut( pool, all[0] ) )
+			bad++;
+		if ( 0 == sis8300PoolPut( pool, all[0] ) || EINVAL != errno )
+			bad++;
+	}
+	sis8300PoolGetInfo( pool, &inf );
+	if ( inf.avail != inf.nbufs )
+		bad++;
+	printf("Foreign and double put: %u errors\n", bad - nbad);
+	nbad = 0;
+
+	for ( k = 0; k < nthr; k++ ) {
+		thr[k].pool  = pool;
+		thr[k].owner = owner;
+		thr[k].idx   = k;
+		thr[k].niter = niter;
+		thr[k].bad   = 0;
+		thr[k].empty = 0;
+		if ( pthread_create( &tid[k], 0, test_thr, &thr[k] ) ) {
+			fprintf(stderr,"Unable to create thread\n");
+			return 1;
+		}
+	}
+	for ( k = 0; k < nthr; k++ ) {
+		pthread_join( tid[k], 0 );
+		nbad  += thr[k].bad;
+		empty += thr[k].empty;
+	}
+	sis8300PoolGetInfo( pool, &inf );
+	if ( inf.avail != inf.nbufs ) {
+		fprintf(stderr,"%u buffer(s) not returned\n", inf.nbufs - inf.avail);
+		nbad++;
+	}
+	bad += nbad;
+	printf("Stress (%u threads, %u buffers%s; pool empty %u times): %u errors\n",
+		nthr, pp.nbufs, inf.huge ? ", huge pages" : "", empty, nbad);
+
+	sis8300PoolDestroy( pool );
+	free( owner );
+	free( all );
+
+	printf("Pool test %s\n", bad ? "FAILED" : "PASSED");
+	return !! bad;
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef SIS8300POOL_H
+#define SIS8300POOL_H
+
+#include <sis8300Digi.h>
+
+/* Frame buffer pool.
+ *
+ * A fixed number of equally sized buffers is carved out of one mapping
+ * which is set up completely at creation: optionally backed by (2 MiB)
+ * huge pages, bound to a NUMA node (by default the node of the board's
+ * PCIe slot), locked into memory and prefaulted. Obtaining and returning
+ * buffers is O(1), lock-free and never allocates; buffers do not page
+ * fault and take few TLB entries.
+ *
+ * If huge pages are requested but none are available (see
+ * /proc/sys/vm/nr_hugepages) the pool falls back to normal pages (with
+ * transparent huge pages advised); sis8300PoolGetInfo() tells.
+ */
+
+#define SIS8300_POOL_HUGE (1<<0)    /* back with huge pages                    */
+#define SIS8300_POOL_LOCK (1<<1)    /* mlock() (mind RLIMIT_MEMLOCK)           */
+#define SIS8300_POOL_NUMA (1<<2)    /* bind to NUMA node 'node'                */
+
+#define SIS8300_POOL_MAX_BUFS 65536
+
+typedef struct Sis8300PoolParmsRec_ {
+	size_t             bufsz;   /* bytes per buffer (e.g., a layout's 'sz')     */
+	unsigned           nbufs;   /* 1..SIS8300_POOL_MAX_BUFS                     */
+	size_t             align;   /* buffer alignment (power of two; 0: page)     */
+	unsigned           flags;   /* SIS8300_POOL_xxx                             */
+	int                node;    /* NUMA node; -1: that of the board 'fd'        */
+	int                fd;      /* only used to find the node                   */
+} Sis8300PoolParmsRec, *Sis8300PoolParms;
+
+typedef struct Sis8300PoolInfoRec_ {
+	size_t             bufsz;
+	size_t             stride;  /* distance between buffers                     */
+	size_t             align;
+	unsigned           nbufs;
+	unsigned           avail;   /* buffers currently free                      */
+	int                huge;    /* backed by huge pages                         */
+	int                locked;
+	int                node;    /* node the memory is bound to (-1: none)      */
+} Sis8300PoolInfoRec, *Sis8300PoolInfo;
+
+typedef struct Sis8300PoolRec_ *Sis8300Pool;
+
+/* RETURNS: pool or NULL on error (e.g., locking or binding failed). */
+Sis8300Pool
+sis8300PoolCreate(Sis8300PoolParms parms);
+
+/* All buffers must have been returned */
+void
+sis8300PoolDestroy(Sis8300Pool pool);
+
+/* Obtain a free buffer (thread-safe, lock-free).
+ *
+ * RETURNS: buffer or NULL if the pool is exhausted.
+ */
+void *
+sis8300PoolGet(Sis8300Pool pool);
+
+/* Return a buffer (thread-safe, lock-free).
+ *
+ * RETURNS: 0 on success, -1 if 'buf' is not a buffer of the pool or
+ *          has already been returned.
+ */
+int
+sis8300PoolPut(Sis8300Pool pool, void *buf);
+
+/* Buffers are numbered 0..nbufs-1 (e.g., to pass them by index) */
+unsigned
+sis8300PoolIndex(Sis8300Pool pool, const void *buf);
+
+void *
+sis8300PoolBuf(Sis8300Pool pool, unsigned idx);
+
+void
+sis8300PoolGetInfo(Sis8300Pool pool, Sis8300PoolInfo info);
+
+/* NUMA node of the PCIe slot of the board 'fd' refers to.
+ *
+ * RETURNS: node or -1 if unknown (or not a NUMA system).
+ */
+int
+sis8300PoolNumaNode(int fd);
+
+#endif
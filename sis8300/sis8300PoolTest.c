@@ -0,0 +1,3 @@
+/* Test program for sis8300Pool.c (run with -h for options) */
+#define TEST_SIS8300POOL
+#include "sis8300Pool.c"
@@ -0,0 +1,933 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <sis8300Rec.h>
+
+/* Recording of acquired frames (see sis8300Rec.h)
+ *
+ * The appending thread fills a chunk buffer and hands it to the writer
+ * thread when the next record does not fit. The file offset of a chunk
+ * is assigned when it is started (chunks are written in order, each one
+ * padded to SIS8300_REC_ALIGN) so that index entries can be made at
+ * once. Every chunk buffer comes with room for the index entries of its
+ * frames; the writer thread collects them into the index of the file
+ * (which grows there, not in the appending thread). Chunk buffers
+ * circulate between a free stack and the writer's queue; the mutex is
+ * held only for moving a buffer and never across I/O.
+ */
+
+#define CHUNK_DFLT   (8*1024*1024)
+#define NCHUNKS_DFLT 8
+#define CHDR_SZ      sizeof(Sis8300RecChunkRec)
+
+#define ROUNDUP(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_FLAGS SIS8300_REC_F_BE
+#else
+#define HOST_FLAGS 0
+#endif
+
+typedef struct RecQRec_ {
+	unsigned           buf;
+	uint64_t           off;
+	uint64_t           size;
+} RecQRec;
+
+typedef struct Sis8300RecRec_ {
+	int                fd;
+	Sis8300RecHdr      hdr;     /* aligned (O_DIRECT)                      */
+	size_t             chunksz;
+	unsigned           nchunks;
+	char             **chk;
+	Sis8300RecIndex   *ent;     /* index entries of each chunk buffer      */
+	uint32_t           maxfr;   /* frames per chunk                        */
+	unsigned          *free;    /* free chunk buffers (stack)              */
+	unsigned           nfree;
+	RecQRec           *q;       /* chunks waiting for the writer (ring)    */
+	unsigned           qhd, qn;
+	int                cur;     /* chunk being filled; -1: none            */
+	size_t             pos;
+	uint32_t           cnfr;    /* frames in the current chunk             */
+	uint64_t           foff;    /* file offset of the current/next chunk   */
+	uint64_t           nchk;
+	Sis8300RecIndex    idx;     /* owned by the writer thread              */
+	uint64_t           nidx, idxcap;
+	int                idxerr;  /* index incomplete (no memory)            */
+	size_t             smplsz;  /* sample bytes in a record                */
+	int                stop;
+	int                running;
+	pthread_t          tid;
+	pthread_mutex_t    mtx;
+	pthread_cond_t     cond;
+	Sis8300RecStatsRec stats;
+} Sis8300RecRec;
+
+typedef struct Sis8300RecReaderRec_ {
+	const char         *map;
+	size_t              mapsz;
+	const Sis8300RecHdrRec   *hdr;
+	const Sis8300RecIndexRec *idx;
+	Sis8300RecIndex     own;    /* rebuilt index (recording not closed)    */
+	uint64_t            n;
+	Sis8300LayoutRec    lay;
+} Sis8300RecReaderRec;
+
+void
+sis8300RecClockInit(Sis8300RecClock clk, int fd, Si5326Parms si5326_parms, unsigned clkhl)
+{
+int id;
+
+	memset( clk, 0, sizeof(*clk) );
+	if ( si5326_parms ) {
+		clk->fin   = si5326_parms->fin;
+		clk->n3    = si5326_parms->n3;
+		clk->n2h   = si5326_parms->n2h;
+		clk->n2l   = si5326_parms->n2l;
+		clk->n1h   = si5326_parms->n1h;
+		clk->nc    = si5326_parms->nc;
+		clk->bw    = si5326_parms->bw;
+		clk->bwsel = si5326_parms->bwsel;
+		clk->wb    = si5326_parms->wb;
+	}
+	clk->clkhl = clkhl;
+	/* as computed by sis8300DigiSetup() */
+	if ( SIS8300_SILENT_9510_DIVIDER == clkhl )
+		clk->ratio = 0;
+	else
+		clk->ratio = clkhl > 0xff ? 1 : (clkhl & 0xf) + ((clkhl>>4) & 0xf) + 2;
+	clk->adc_fmt = -1;
+
+	if ( fd < 0 )
+		return;
+
+	clk->fclk    = sis8300DigiGetFclk( fd );
+	clk->adc_fmt = sis8300DigiGetAdcFormat( fd );
+	switch ( (id = sis8300DigiGetADC_ID( fd )) ) {
+		case 0x32: clk->adc_bits = 16; break; /* AD9268 */
+		case 0x82: clk->adc_bits = 14; break; /* AD9643 */
+		default:   break;
+	}
+}
+
+/* Write 'sz' bytes at 'off' (retrying partial writes) */
+static int
+rec_pwrite(int fd, const char *p, size_t sz, uint64_t off)
+{
+ssize_t n;
+
+	while ( sz ) {
+		if ( (n = pwrite( fd, p, sz, off )) < 0 ) {
+			if ( EINTR == errno )
+				continue;
+			return -1;
+		}
+		p   += n;
+		sz  -= n;
+		off += n;
+	}
+	return 0;
+}
+
+/* Append the index entries of chunk buffer 'buf' to the index */
+static void
+rec_collect(Sis8300Rec rec, unsigned buf)
+{
+uint32_t        n = ((Sis8300RecChunk)rec->chk[buf])->nframes;
+Sis8300RecIndex e;
+uint64_t        cap;
+
+	if ( rec->idxerr )
+		return;
+	if ( rec->nidx + n > rec->idxcap ) {
+		for ( cap = rec->idxcap ? rec->idxcap : 4096; cap < rec->nidx + n; cap *= 2 )
+			;
+		if ( ! (e = realloc( rec->idx, cap * sizeof(*e) )) ) {
+			fprintf(stderr,"sis8300Rec: no memory for the index; readers will have to rebuild it\n");
+			rec->idxerr = 1;
+			return;
+		}
+		rec->idx    = e;
+		rec->idxcap = cap;
+	}
+	memcpy( rec->idx + rec->nidx, rec->ent[buf], n * sizeof(*rec->idx) );
+	rec->nidx += n;
+}
+
+static void *
+rec_thread(void *arg)
+{
+Sis8300Rec rec = arg;
+RecQRec    e;
+int        err;
+
+	pthread_mutex_lock( &rec->mtx );
+	for ( ;; ) {
+		while ( 0 == rec->qn && ! rec->stop )
+			pthread_cond_wait( &rec->cond, &rec->mtx );
+		if ( 0 == rec->qn )
+			break;
+		e = rec->q[rec->qhd];
+		pthread_mutex_unlock( &rec->mtx );
+
+		if ( (err = rec_pwrite( rec->fd, rec->chk[e.buf], e.size, e.off )) )
+			fprintf(stderr,"sis8300Rec: writing chunk failed: %s\n", strerror(errno));
+		rec_collect( rec, e.buf );
+
+		pthread_mutex_lock( &rec->mtx );
+		/* dequeue only now: the chunk counts as busy until written */
+		rec->qhd = (rec->qhd + 1) % rec->nchunks;
+		rec->qn--;
+		rec->free[rec->nfree++] = e.buf;
+		if ( err ) {
+			rec->stats.errors++;
+		} else {
+			rec->stats.chunks++;
+			rec->stats.bytes += e.size;
+		}
+	}
+	pthread_mutex_unlock( &rec->mtx );
+	return 0;
+}
+
+/* Hand the current chunk to the writer */
+static void
+rec_submit(Sis8300Rec rec)
+{
+Sis8300RecChunk c = (Sis8300RecChunk)rec->chk[rec->cur];
+RecQRec         e;
+
+	memset( c, 0, CHDR_SZ );
+	c->magic   = SIS8300_REC_CHUNK_MAGIC;
+	c->nframes = rec->cnfr;
+	c->num     = rec->nchk++;
+	c->used    = rec->pos;
+	c->size    = ROUNDUP( rec->pos, SIS8300_REC_ALIGN );
+	/* don't write stale data into the padding */
+	memset( rec->chk[rec->cur] + rec->pos, 0, c->size - rec->pos );
+
+	e.buf  = rec->cur;
+	e.off  = rec->foff;
+	e.size = c->size;
+
+	rec->foff += c->size;
+	rec->cur   = -1;
+
+	pthread_mutex_lock( &rec->mtx );
+	rec->q[(rec->qhd + rec->qn) % rec->nchunks] = e;
+	if ( ++rec->qn > rec->stats.maxq )
+		rec->stats.maxq = rec->qn;
+	pthread_cond_signal( &rec->cond );
+	pthread_mutex_unlock( &rec->mtx );
+}
+
+Sis8300Rec
+sis8300RecCreate(Sis8300RecParms parms)
+{
+Sis8300Rec      rec;
+Sis8300LayoutRec lay;
+struct timespec now;
+unsigned        i;
+int             st, oflgs = O_WRONLY | O_CREAT | O_TRUNC;
+
+	if ( sis8300DigiLayoutInit( &lay, -1, parms->sel, parms->nsmpl ) )
+		return 0;
+	if ( 1 == parms->nchunks ) {
+		fprintf(stderr,"sis8300RecCreate: need at least 2 chunk buffers\n");
+		return 0;
+	}
+
+	if ( ! (rec = calloc( 1, sizeof(*rec) )) ) {
+		fprintf(stderr,"sis8300RecCreate: no memory\n");
+		return 0;
+	}
+	rec->fd      = -1;
+	rec->cur     = -1;
+	rec->smplsz  = (size_t)lay.nch * lay.nsmpl * sizeof(int16_t);
+	rec->nchunks = parms->nchunks ? parms->nchunks : NCHUNKS_DFLT;
+	rec->chunksz = ROUNDUP( parms->chunksz ? parms->chunksz : CHUNK_DFLT, SIS8300_REC_ALIGN );
+	pthread_mutex_init( &rec->mtx, 0 );
+	pthread_cond_init( &rec->cond, 0 );
+
+	if ( posix_memalign( (void**)&rec->hdr, SIS8300_REC_ALIGN, SIS8300_REC_ALIGN ) ) {
+		rec->hdr = 0;
+		goto nomem;
+	}
+	memset( rec->hdr, 0, SIS8300_REC_ALIGN );
+	rec->hdr->magic   = SIS8300_REC_MAGIC;
+	rec->hdr->version = SIS8300_REC_VERSION;
+	rec->hdr->flags   = HOST_FLAGS;
+	rec->hdr->hdrsz   = SIS8300_REC_ALIGN;
+	rec->hdr->recsz   = ROUNDUP( sizeof(Sis8300RecFrameRec) + rec->smplsz, SIS8300_REC_RECALIGN );
+	rec->hdr->sel     = lay.sel;
+	rec->hdr->nsmpl   = lay.nsmpl;
+	rec->hdr->nch     = lay.nch;
+	clock_gettime( CLOCK_REALTIME, &now );
+	rec->hdr->t0_sec  = now.tv_sec;
+	rec->hdr->t0_nsec = now.tv_nsec;
+	rec->hdr->clk     = parms->clk;
+	if ( parms->desc )
+		strncpy( rec->hdr->desc, parms->desc, sizeof(rec->hdr->desc) - 1 );
+
+	/* at least one record per chunk */
+	if ( rec->chunksz < CHDR_SZ + rec->hdr->recsz )
+		rec->chunksz = ROUNDUP( CHDR_SZ + rec->hdr->recsz, SIS8300_REC_ALIGN );
+	rec->pos  = CHDR_SZ;
+	rec->foff = SIS8300_REC_ALIGN;
+
+	rec->maxfr = (rec->chunksz - CHDR_SZ) / rec->hdr->recsz;
+
+	if (    ! (rec->chk  = calloc( rec->nchunks, sizeof(*rec->chk) ))
+	     || ! (rec->ent  = calloc( rec->nchunks, sizeof(*rec->ent) ))
+	     || ! (rec->free = calloc( rec->nchunks, sizeof(*rec->free) ))
+	     || ! (rec->q    = calloc( rec->nchunks, sizeof(*rec->q) )) )
+		goto nomem;
+	for ( i = 0; i < rec->nchunks; i++ ) {
+		if ( posix_memalign( (void**)&rec->chk[i], SIS8300_REC_ALIGN, rec->chunksz ) ) {
+			rec->chk[i] = 0;
+			goto nomem;
+		}
+		/* fault in now rather than while recording */
+		memset( rec->chk[i], 0, rec->chunksz );
+		if ( ! (rec->ent[i] = calloc( rec->maxfr, sizeof(*rec->ent[i]) )) )
+			goto nomem;
+		rec->free[rec->nfree++] = i;
+	}
+
+#ifdef O_DIRECT
+	if ( (parms->flags & SIS8300_REC_DIRECT) ) {
+		if ( (rec->fd = open( parms->path, oflgs | O_DIRECT, 0644 )) < 0 && EINVAL == errno )
+			fprintf(stderr,"sis8300RecCreate: O_DIRECT not supported by file system; using buffered I/O\n");
+	}
+#endif
+	if ( rec->fd < 0 && (rec->fd = open( parms->path, oflgs, 0644 )) < 0 ) {
+		fprintf(stderr,"sis8300RecCreate: unable to create %s: %s\n", parms->path, strerror(errno));
+		goto bail;
+	}
+
+	/* a recording which is never closed remains readable */
+	if ( rec_pwrite( rec->fd, (const char*)rec->hdr, SIS8300_REC_ALIGN, 0 ) ) {
+		fprintf(stderr,"sis8300RecCreate: writing header failed: %s\n", strerror(errno));
+		goto bail;
+	}
+
+	if ( (st = pthread_create( &rec->tid, 0, rec_thread, rec )) ) {
+		fprintf(stderr,"sis8300RecCreate: unable to create writer thread: %s\n", strerror(st));
+		goto bail;
+	}
+	rec->running = 1;
+
+	return rec;
+
+nomem:
+	fprintf(stderr,"sis8300RecCreate: no memory\n");
+bail:
+	sis8300RecClose( rec );
+	return 0;
+}
+
+int
+sis8300RecAppend(Sis8300Rec rec, Sis8300Frame frame)
+{
+Sis8300ChannelSel  sel = rec->hdr->sel;
+Sis8300RecFrame    r;
+Sis8300RecIndex    e;
+char              *p;
+size_t             bsz = (size_t)rec->hdr->nsmpl * sizeof(int16_t);
+int                ch;
+
+	if ( (frame->sel & ~SIS8300_VALIDATE_SEL_QUIET) != sel || frame->nsmpl != rec->hdr->nsmpl ) {
+		fprintf(stderr,"sis8300RecAppend: frame does not match the recording\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ( rec->cur < 0 ) {
+		pthread_mutex_lock( &rec->mtx );
+		if ( rec->nfree )
+			rec->cur = rec->free[--rec->nfree];
+		pthread_mutex_unlock( &rec->mtx );
+		if ( rec->cur < 0 )
+			goto drop;
+		rec->pos  = CHDR_SZ;
+		rec->cnfr = 0;
+	}
+
+	p = rec->chk[rec->cur] + rec->pos;
+	r = (Sis8300RecFrame)p;
+	r->seq     = frame->seq;
+	r->ts_sec  = frame->ts.tv_sec;
+	r->ts_nsec = frame->ts.tv_nsec;
+	r->kind    = frame->kind;
+	r->trig    = frame->trig;
+	p += sizeof(*r);
+	/* blocks in selector order; the frame may have an aligned layout */
+	for ( ; (ch = (sel & 0xf)); sel >>= 4, p += bsz )
+		memcpy( p, frame->chnl[ch - 1], bsz );
+	memset( p, 0, rec->hdr->recsz - sizeof(*r) - rec->smplsz );
+
+	e = &rec->ent[rec->cur][rec->cnfr];
+	e->off     = rec->foff + rec->pos;
+	e->seq     = frame->seq;
+	e->ts_sec  = frame->ts.tv_sec;
+	e->ts_nsec = frame->ts.tv_nsec;
+	e->kind    = frame->kind;
+
+	rec->pos += rec->hdr->recsz;
+	rec->cnfr++;
+	__atomic_store_n( &rec->stats.frames, rec->stats.frames + 1, __ATOMIC_RELAXED );
+
+	if ( rec->cnfr == rec->maxfr )
+		rec_submit( rec );
+	return 0;
+
+drop:
+	__atomic_store_n( &rec->stats.dropped, rec->stats.dropped + 1, __ATOMIC_RELAXED );
+	errno = EAGAIN;
+	return -1;
+}
+
+/* Write the index and the final header */
+static int
+rec_finish(Sis8300Rec rec)
+{
+Sis8300RecChunk c;
+uint64_t        used = CHDR_SZ + rec->nidx * sizeof(*rec->idx);
+uint64_t        size = ROUNDUP( used, SIS8300_REC_ALIGN );
+int             rval = 0;
+
+	/* leave the recording as if it had not been closed */
+	if ( rec->idxerr ) {
+		fprintf(stderr,"sis8300RecClose: index incomplete; not written\n");
+		return -1;
+	}
+
+	if ( posix_memalign( (void**)&c, SIS8300_REC_ALIGN, size ) ) {
+		fprintf(stderr,"sis8300RecClose: no memory for the index\n");
+		return -1;
+	}
+	memset( c, 0, size );
+	c->magic   = SIS8300_REC_INDEX_MAGIC;
+	c->nframes = rec->nidx > UINT32_MAX ? UINT32_MAX : rec->nidx;
+	c->num     = rec->nchk;
+	c->size    = size;
+	c->used    = used;
+	c->nent    = rec->nidx;
+	if ( rec->nidx )
+		memcpy( c + 1, rec->idx, rec->nidx * sizeof(*rec->idx) );
+
+	if ( rec_pwrite( rec->fd, (const char*)c, size, rec->foff ) ) {
+		fprintf(stderr,"sis8300RecClose: writing index failed: %s\n", strerror(errno));
+		rval = -1;
+	} else {
+		rec->hdr->flags  |= SIS8300_REC_F_FINAL;
+		rec->hdr->nframes = rec->nidx;
+		rec->hdr->nchunks = rec->nchk;
+		rec->hdr->idx_off = rec->foff;
+		if ( rec_pwrite( rec->fd, (const char*)rec->hdr, SIS8300_REC_ALIGN, 0 ) ) {
+			fprintf(stderr,"sis8300RecClose: writing header failed: %s\n", strerror(errno));
+			rval = -1;
+		}
+	}
+	free( c );
+	return rval;
+}
+
+int
+sis8300RecClose(Sis8300Rec rec)
+{
+unsigned i;
+int      rval = 0;
+
+	if ( ! rec )
+		return 0;
+
+	if ( rec->running ) {
+		if ( rec->cur >= 0 ) {
+			if ( rec->cnfr ) {
+				rec_submit( rec );
+			} else {
+				pthread_mutex_lock( &rec->mtx );
+				rec->free[rec->nfree++] = rec->cur;
+				pthread_mutex_unlock( &rec->mtx );
+				rec->cur = -1;
+			}
+		}
+		pthread_mutex_lock( &rec->mtx );
+		rec->stop = 1;
+		pthread_cond_signal( &rec->cond );
+		pthread_mutex_unlock( &rec->mtx );
+		pthread_join( rec->tid, 0 );
+
+		if ( rec->stats.errors || rec_finish( rec ) || fdatasync( rec->fd ) )
+			rval = -1;
+	}
+
+	if ( rec->fd >= 0 && close( rec->fd ) )
+		rval = -1;
+	if ( rec->chk ) {
+		for ( i = 0; i < rec->nchunks; i++ )
+			free( rec->chk[i] );
+	}
+	if ( rec->ent ) {
+		for ( i = 0; i < rec->nchunks; i++ )
+			free( rec->ent[i] );
+	}
+	free( rec->chk );
+	free( rec->ent );
+	free( rec->free );
+	free( rec->q );
+	free( rec->idx );
+	free( rec->hdr );
+	pthread_cond_destroy( &rec->cond );
+	pthread_mutex_destroy( &rec->mtx );
+	free( rec );
+	return rval;
+}
+
+void
+sis8300RecGetStats(Sis8300Rec rec, Sis8300RecStats stats)
+{
+	pthread_mutex_lock( &rec->mtx );
+	*stats = rec->stats;
+	pthread_mutex_unlock( &rec->mtx );
+	stats->frames  = __atomic_load_n( &rec->stats.frames,  __ATOMIC_RELAXED );
+	stats->dropped = __atomic_load_n( &rec->stats.dropped, __ATOMIC_RELAXED );
+}
+
+/* Rebuild the index of a recording which was not closed by walking the
+ * chunks (up to the first one which is incomplete or not a chunk).
+ */
+static int
+rdr_recover(Sis8300RecReader rd)
+{
+const Sis8300RecChunkRec *c;
+Sis8300RecIndex           e;
+const Sis8300RecFrameRec *r;
+uint64_t                  off = rd->hdr->hdrsz, cap = 0, pos;
+uint32_t                  i;
+
+	/* frames would all be at the same offset */
+	if ( 0 == rd->hdr->recsz ) {
+		fprintf(stderr,"sis8300RecReaderOpen: invalid record size\n");
+		return -1;
+	}
+
+	while ( off + CHDR_SZ <= rd->mapsz ) {
+		c = (const Sis8300RecChunkRec*)(rd->map + off);
+		if (    SIS8300_REC_CHUNK_MAGIC != c->magic
+		     || 0 == c->size || (c->size % SIS8300_REC_ALIGN) || c->size > rd->mapsz - off
+		     || c->used > c->size || CHDR_SZ + (uint64_t)c->nframes * rd->hdr->recsz > c->used )
+			break;
+		for ( i = 0, pos = off + CHDR_SZ; i < c->nframes; i++, pos += rd->hdr->recsz ) {
+			if ( rd->n == cap ) {
+				if ( ! (e = realloc( rd->own, (cap ? 2 * cap : 4096) * sizeof(*e) )) ) {
+					fprintf(stderr,"sis8300RecReaderOpen: no memory\n");
+					return -1;
+				}
+				rd->own = e;
+				cap     = cap ? 2 * cap : 4096;
+			}
+			r = (const Sis8300RecFrameRec*)(rd->map + pos);
+			e = &rd->own[rd->n++];
+			e->off     = pos;
+			e->seq     = r->seq;
+			e->ts_sec  = r->ts_sec;
+			e->ts_nsec = r->ts_nsec;
+			e->kind    = r->kind;
+		}
+		off += c->size;
+	}
+	rd->idx = rd->own;
+	return 0;
+}
+
+Sis8300RecReader
+sis8300RecReaderOpen(const char *path)
+{
+Sis8300RecReader          rd;
+const Sis8300RecHdrRec   *h;
+const Sis8300RecChunkRec *c;
+struct stat               sb;
+int                       fd;
+
+	if ( (fd = open( path, O_RDONLY )) < 0 ) {
+		fprintf(stderr,"sis8300RecReaderOpen: unable to open %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	if ( fstat( fd, &sb ) ) {
+		fprintf(stderr,"sis8300RecReaderOpen: fstat failed: %s\n", strerror(errno));
+		close( fd );
+		return 0;
+	}
+	if ( sb.st_size < (off_t)sizeof(*h) ) {
+		fprintf(stderr,"sis8300RecReaderOpen: %s: not a recording\n", path);
+		close( fd );
+		return 0;
+	}
+
+	if ( ! (rd = calloc( 1, sizeof(*rd) )) ) {
+		fprintf(stderr,"sis8300RecReaderOpen: no memory\n");
+		close( fd );
+		return 0;
+	}
+	rd->mapsz = sb.st_size;
+	rd->map   = mmap( 0, rd->mapsz, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == rd->map ) {
+		fprintf(stderr,"sis8300RecReaderOpen: mmap failed: %s\n", strerror(errno));
+		rd->map = 0;
+		goto bail;
+	}
+	rd->hdr = h = (const Sis8300RecHdrRec*)rd->map;
+
+	if ( SIS8300_REC_MAGIC != h->magic ) {
+		fprintf(stderr,"sis8300RecReaderOpen: %s: not a recording (or of foreign byte order)\n", path);
+		goto bail;
+	}
+	if ( SIS8300_REC_VERSION != h->version ) {
+		fprintf(stderr,"sis8300RecReaderOpen: %s: unsupported version %u\n", path, h->version);
+		goto bail;
+	}
+	if (    (h->flags & SIS8300_REC_F_BE) != HOST_FLAGS
+	     || h->hdrsz < sizeof(*h) || h->hdrsz > rd->mapsz
+	     || sis8300DigiLayoutInit( &rd->lay, -1, h->sel | SIS8300_VALIDATE_SEL_QUIET, h->nsmpl )
+	     || rd->lay.nch != h->nch
+	     || h->recsz != ROUNDUP( sizeof(Sis8300RecFrameRec) + (uint64_t)h->nch * h->nsmpl * sizeof(int16_t), SIS8300_REC_RECALIGN ) ) {
+		fprintf(stderr,"sis8300RecReaderOpen: %s: invalid header\n", path);
+		goto bail;
+	}
+
+	c = 0;
+	if ( (h->flags & SIS8300_REC_F_FINAL) && h->idx_off >= h->hdrsz && h->idx_off <= rd->mapsz - CHDR_SZ ) {
+		c = (const Sis8300RecChunkRec*)(rd->map + h->idx_off);
+		if ( SIS8300_REC_INDEX_MAGIC != c->magic || c->nent > (rd->mapsz - h->idx_off - CHDR_SZ) / sizeof(*rd->idx) )
+			c = 0;
+	}
+	if ( c ) {
+		rd->idx = (const Sis8300RecIndexRec*)(c + 1);
+		rd->n   = c->nent;
+	} else {
+		if ( (h->flags & SIS8300_REC_F_FINAL) )
+			fprintf(stderr,"sis8300RecReaderOpen: %s: index corrupt; rebuilding\n", path);
+		if ( rdr_recover( rd ) )
+			goto bail;
+	}
+
+	return rd;
+
+bail:
+	sis8300RecReaderClose( rd );
+	return 0;
+}
+
+void
+sis8300RecReaderClose(Sis8300RecReader rd)
+{
+	if ( ! rd )
+		return;
+	if ( rd->map )
+		munmap( (void*)rd->map, rd->mapsz );
+	free( rd->own );
+	free( rd );
+}
+
+const Sis8300RecHdrRec *
+sis8300RecReaderHeader(Sis8300RecReader rd)
+{
+	return rd->hdr;
+}
+
+uint64_t
+sis8300RecReaderCount(Sis8300RecReader rd)
+{
+	return rd->n;
+}
+
+int
+sis8300RecReaderRecovered(Sis8300RecReader rd)
+{
+	return !! rd->own || ! (rd->hdr->flags & SIS8300_REC_F_FINAL);
+}
+
+int
+sis8300RecReaderFrame(Sis8300RecReader rd, uint64_t idx, Sis8300Frame frame)
+{
+const Sis8300RecFrameRec *r;
+uint64_t                  off;
+
+	if ( idx >= rd->n ) {
+		errno = EINVAL;
+		return -1;
+	}
+	off = rd->idx[idx].off;
+	if ( rd->hdr->recsz > rd->mapsz || off < rd->hdr->hdrsz || off > rd->mapsz - rd->hdr->recsz ) {
+		errno = EINVAL;
+		return -1;
+	}
+	r = (const Sis8300RecFrameRec*)(rd->map + off);
+	sis8300DigiFrameSetupLayout( frame, r->kind, &rd->lay, r + 1 );
+	frame->trig       = r->trig;
+	frame->seq        = r->seq;
+	frame->ts.tv_sec  = r->ts_sec;
+	frame->ts.tv_nsec = r->ts_nsec;
+	return 0;
+}
+
+uint64_t
+sis8300RecReaderFind(Sis8300RecReader rd, uint64_t seq)
+{
+uint64_t lo = 0, hi = rd->n, mid;
+
+	while ( lo < hi ) {
+		mid = lo + (hi - lo) / 2;
+		if ( rd->idx[mid].seq < seq )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+#ifdef TEST_SIS8300REC
+/* Record frames (aligned layout, known contents) at a given rate (no
+ * frame may be dropped) or as fast as possible (benchmark; drops are only
+ * reported), then map the recording and check every frame, random access
+ * and the recovery of an unfinished recording.
+ */
+#include <getopt.h>
+
+static int16_t
+test_smpl(uint64_t seq, int ch, unsigned i)
+{
+	return (int16_t)(seq * 13 + ch * 1000 + i);
+}
+
+static unsigned
+test_check(const char *path, uint64_t nframes, unsigned nsmpl, int recovered)
+{
+Sis8300RecReader        rd;
+const Sis8300RecHdrRec *h;
+Sis8300FrameRec         f;
+uint64_t                k, prev = 0;
+unsigned                i, bad = 0;
+int                     ch;
+
+	if ( ! (rd = sis8300RecReaderOpen( path )) )
+		return 1;
+	h = sis8300RecReaderHeader( rd );
+	if (    sis8300RecReaderCount( rd ) != nframes
+	     || !! sis8300RecReaderRecovered( rd ) != recovered
+	     || h->sel != 0x4a21 || h->nsmpl != nsmpl || h->clk.ratio != 2 || strcmp( h->desc, "test" ) ) {
+		fprintf(stderr,"Header/count mismatch (%llu frames)\n", (unsigned long long)sis8300RecReaderCount( rd ));
+		bad++;
+	}
+	for ( k = 0; k < sis8300RecReaderCount( rd ); k++ ) {
+		if ( sis8300RecReaderFrame( rd, k, &f ) || (k && f.seq <= prev) || f.trig != 5 || ((uintptr_t)f.data & 31) ) {
+			bad++;
+			continue;
+		}
+		prev = f.seq;
+		for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+			if ( ! f.chnl[ch] )
+				continue;
+			for ( i = 0; i < nsmpl; i++ ) {
+				if ( f.chnl[ch][i] != test_smpl( f.seq, ch, i ) ) {
+					bad++;
+					break;
+				}
+			}
+		}
+		/* random access by sequence number */
+		if ( 0 == (k % 97) && sis8300RecReaderFind( rd, f.seq ) != k )
+			bad++;
+	}
+	if ( sis8300RecReaderFind( rd, (uint64_t)-1 ) != sis8300RecReaderCount( rd ) )
+		bad++;
+	sis8300RecReaderClose( rd );
+	return bad;
+}
+
+static void
+usage(const char *nm)
+{
+	printf("Usage: %s [-h] [-d] [-f file] [-n n_frames] [-r rate] [-s n_samples] [-c chunk_MB] [-b n_chunks]\n", nm);
+	printf("    Record frames, then read the recording back and check it\n");
+	printf("  -d           : use O_DIRECT\n");
+	printf("  -f file      : recording (default /tmp/sis8300RecTest.dat; removed)\n");
+	printf("  -n n_frames  : number of frames (default 1000)\n");
+	printf("  -r rate      : frames per second (default 250); none may be dropped.\n");
+	printf("                 0: as fast as possible (benchmark; drops are tolerated)\n");
+	printf("  -s n_samples : samples per channel (default 16384)\n");
+	printf("  -c chunk_MB  : chunk size (default 8)\n");
+	printf("  -b n_chunks  : chunk buffers (default 8)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+Sis8300RecParmsRec rp;
+Sis8300RecStatsRec st;
+Sis8300LayoutRec   lay;
+Sis8300FrameRec    f;
+Sis8300Rec         rec;
+struct timespec    t0, t1, tnxt;
+const char        *path = "/tmp/sis8300RecTest.dat";
+unsigned           nframes = 1000, nsmpl = 16384, chunk_mb = 8, nchunks = 0, rate = 250;
+unsigned           k, i, bad;
+void              *buf;
+double             dt;
+int                opt, ch, fd, direct = 0;
+uint16_t           flags;
+
+	while ( (opt = getopt(argc, argv, "hdf:n:r:s:c:b:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'd':
+				direct = 1;
+				break;
+			case 'f':
+				path = optarg;
+				break;
+			case 'n':
+				if ( 1 != sscanf(optarg,"%u",&nframes) ) {
+					fprintf(stderr,"Invalid -n argument\n");
+					return 1;
+				}
+				break;
+			case 'r':
+				if ( 1 != sscanf(optarg,"%u",&rate) ) {
+					fprintf(stderr,"Invalid -r argument\n");
+					return 1;
+				}
+				break;
+			case 's':
+				if ( 1 != sscanf(optarg,"%u",&nsmpl) ) {
+					fprintf(stderr,"Invalid -s argument\n");
+					return 1;
+				}
+				break;
+			case 'c':
+				if ( 1 != sscanf(optarg,"%u",&chunk_mb) ) {
+					fprintf(stderr,"Invalid -c argument\n");
+					return 1;
+				}
+				break;
+			case 'b':
+				if ( 1 != sscanf(optarg,"%u",&nchunks) ) {
+					fprintf(stderr,"Invalid -b argument\n");
+					return 1;
+				}
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	if (    sis8300DigiLayoutInit( &lay, -1, 0x4a21, nsmpl )
+	     || sis8300DigiLayoutAlign( &lay, SIS8300_ALIGN_PAGE )
+	     || posix_memalign( &buf, SIS8300_ALIGN_PAGE, lay.sz ) )
+		return 1;
+	sis8300DigiFrameSetupLayout( &f, SIS8300_KIND_BEAM, &lay, buf );
+	f.trig = 5;
+
+	memset( &rp, 0, sizeof(rp) );
+	rp.path    = path;
+	rp.sel     = 0x4a21;
+	rp.nsmpl   = nsmpl;
+	rp.desc    = "test";
+	rp.chunksz = (size_t)chunk_mb * 1024 * 1024;
+	rp.nchunks = nchunks;
+	rp.flags   = direct ? SIS8300_REC_DIRECT : 0;
+	sis8300RecClockInit( &rp.clk, -1, 0, 0x00 );
+
+	if ( ! (rec = sis8300RecCreate( &rp )) )
+		return 1;
+
+	dt = 0.0;
+	clock_gettime( CLOCK_MONOTONIC, &tnxt );
+	for ( k = 0; k < nframes; k++ ) {
+		if ( rate ) {
+			/* absolute deadlines; a late frame doesn't delay the others */
+			while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &tnxt, 0 ) )
+				;
+			tnxt.tv_nsec += 1000000000L / rate;
+			while ( tnxt.tv_nsec >= 1000000000L ) {
+				tnxt.tv_nsec -= 1000000000L;
+				tnxt.tv_sec++;
+			}
+		}
+		f.seq = k;
+		clock_gettime( CLOCK_REALTIME, &f.ts );
+		for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+			if ( f.chnl[ch] ) {
+				for ( i = 0; i < nsmpl; i++ )
+					((int16_t*)f.chnl[ch])[i] = test_smpl( k, ch, i );
+			}
+		}
+		/* time the appends only (not generating the test data) */
+		clock_gettime( CLOCK_MONOTONIC, &t0 );
+		if ( sis8300RecAppend( rec, &f ) && EAGAIN != errno ) {
+			perror("sis8300RecAppend");
+			return 1;
+		}
+		clock_gettime( CLOCK_MONOTONIC, &t1 );
+		dt += (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+	}
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	sis8300RecGetStats( rec, &st );
+	if ( sis8300RecClose( rec ) ) {
+		fprintf(stderr,"sis8300RecClose failed\n");
+		return 1;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+
+	printf("Appended %llu frames (%.1f us each) at %s, dropped %llu; max. queued chunks %u; close took %.1f ms\n",
+		(unsigned long long)st.frames, 1.0e6 * dt / (nframes ? nframes : 1), rate ? "the target rate" : "full speed",
+		(unsigned long long)st.dropped, st.maxq,
+		1.0e3 * ((double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec)));
+
+	bad = 0;
+	if ( rate && st.dropped ) {
+		fprintf(stderr,"Frames dropped at %u frames/s (storage too slow or too few chunk buffers?)\n", rate);
+		bad++;
+	}
+
+	i    = test_check( path, st.frames, nsmpl, 0 );
+	bad += i;
+	printf("Reading recording: %u errors\n", i);
+
+	/* pretend the recording was never closed */
+	if ( (fd = open( path, O_RDWR )) < 0 || sizeof(flags) != pread( fd, &flags, sizeof(flags), 6 ) ) {
+		perror("open");
+		return 1;
+	}
+	flags &= ~SIS8300_REC_F_FINAL;
+	if ( sizeof(flags) != pwrite( fd, &flags, sizeof(flags), 6 ) ) {
+		perror("pwrite");
+		return 1;
+	}
+	close( fd );
+	i    = test_check( path, st.frames, nsmpl, 1 );
+	bad += i;
+	printf("Recovering recording: %u errors\n", i);
+
+	unlink( path );
+	free( buf );
+
+	printf("Recording test %s\n", bad ? "FAILED" : "PASSED");
+	return !! bad;
+}
+#endif
@@ -0,0 +1,211 @@
+#ifndef SIS8300REC_H
+#define SIS8300REC_H
+
+#include <sis8300Digi.h>
+
+/* Recording of acquired frames.
+ *
+ * A recorder appends frames to a file which describes itself: the header
+ * holds the acquisition configuration (selector, samples per channel),
+ * the clock plan (Si5326 parameters, AD9510 divider, digitizer clock) and
+ * the ADC resolution/format. Frames are collected in chunks; a chunk is
+ * written with a single large write by a background thread so that the
+ * thread appending frames (e.g., reading from an acquisition engine)
+ * never waits for the disk. If the writer falls behind and all chunk
+ * buffers are busy then frames are dropped (and counted) rather than
+ * blocking the caller.
+ *
+ * File layout (host byte order; all sizes/offsets multiples of
+ * SIS8300_REC_ALIGN so that the file may be written with O_DIRECT):
+ *
+ *   header     Sis8300RecHdrRec, padded to SIS8300_REC_ALIGN
+ *   chunk      Sis8300RecChunkRec (padded to SIS8300_REC_RECALIGN)
+ *              followed by 'nframes' frame records and padding
+ *   ...
+ *   index      Sis8300RecChunkRec (magic SIS8300_REC_INDEX_MAGIC)
+ *              followed by one Sis8300RecIndexRec per frame
+ *
+ * A frame record is a Sis8300RecFrameRec followed by the samples of all
+ * channels, packed in selector order (nch blocks of nsmpl samples) and
+ * padded to a multiple of SIS8300_REC_RECALIGN; sample blocks are thus
+ * 32-byte aligned in the file (and a mapping of it).
+ *
+ * The index and the final counts are written when the recorder is
+ * closed. A file which was not closed (crash) is still readable: the
+ * reader then rebuilds the index by walking the chunks.
+ *
+ * The reader maps the file and hands out frames pointing into the
+ * mapping (no copies); random access by frame number or sequence number
+ * uses the index.
+ */
+
+#define SIS8300_REC_MAGIC       0x53385243 /* 'S8RC' */
+#define SIS8300_REC_CHUNK_MAGIC 0x53384348 /* 'S8CH' */
+#define SIS8300_REC_INDEX_MAGIC 0x53384958 /* 'S8IX' */
+#define SIS8300_REC_VERSION     1
+
+#define SIS8300_REC_ALIGN       4096       /* chunk alignment in the file      */
+#define SIS8300_REC_RECALIGN    64         /* frame record alignment in chunks */
+
+/* header flags */
+#define SIS8300_REC_F_BE        (1<<0)     /* written on a big-endian host     */
+#define SIS8300_REC_F_FINAL     (1<<1)     /* closed properly; index valid     */
+
+/* Clock plan and ADC description */
+typedef struct Sis8300RecClockRec_ {
+	uint64_t           fclk;    /* digitizer clock (Hz; 0: unknown or disabled)   */
+	uint64_t           fin;     /* Si5326 parameters (Si5326ParmsRec); all        */
+	uint32_t           n3, n2h, n2l, n1h, nc, bw; /* zero: on-board clock      */
+	int32_t            bwsel;
+	int32_t            wb;
+	uint32_t           clkhl;   /* AD9510 divider (hi/lo pattern)                 */
+	uint32_t           ratio;   /* AD9510 divider ratio (1: bypassed; 0: disabled) */
+	int32_t            adc_bits; /* ADC resolution (bits; 0: unknown)             */
+	int32_t            adc_fmt; /* SIS8300_ADC_FMT_xxx (-1: unknown)              */
+} Sis8300RecClockRec, *Sis8300RecClock;
+
+typedef struct Sis8300RecHdrRec_ {
+	uint32_t           magic;
+	uint16_t           version;
+	uint16_t           flags;
+	uint32_t           hdrsz;   /* offset of the first chunk                      */
+	uint32_t           recsz;   /* size of a frame record                         */
+	uint64_t           sel;     /* channel selector (order of the sample blocks)  */
+	uint32_t           nsmpl;   /* samples per channel                            */
+	uint32_t           nch;
+	int64_t            t0_sec;  /* creation time (CLOCK_REALTIME)                 */
+	int64_t            t0_nsec;
+	Sis8300RecClockRec clk;
+	uint64_t           nframes; /* valid if SIS8300_REC_F_FINAL                   */
+	uint64_t           nchunks; /* valid if SIS8300_REC_F_FINAL                   */
+	uint64_t           idx_off; /* offset of the index chunk (SIS8300_REC_F_FINAL) */
+	char               desc[128]; /* user description (NUL-terminated)           */
+} Sis8300RecHdrRec, *Sis8300RecHdr;
+
+typedef struct Sis8300RecChunkRec_ {
+	uint32_t           magic;   /* SIS8300_REC_CHUNK_MAGIC or _INDEX_MAGIC        */
+	uint32_t           nframes; /* frame records (index: entries; see 'nent')     */
+	uint64_t           num;     /* chunk number                                   */
+	uint64_t           size;    /* bytes in the file (incl. header and padding)   */
+	uint64_t           used;    /* bytes used (incl. header)                      */
+	uint64_t           nent;    /* index: number of entries                       */
+	uint64_t           rsvd[3];
+} Sis8300RecChunkRec, *Sis8300RecChunk;
+
+typedef struct Sis8300RecFrameRec_ {
+	uint64_t           seq;
+	int64_t            ts_sec;
+	int64_t            ts_nsec;
+	int32_t            kind;
+	uint32_t           trig;
+} Sis8300RecFrameRec, *Sis8300RecFrame;
+
+typedef struct Sis8300RecIndexRec_ {
+	uint64_t           off;     /* file offset of the frame record                */
+	uint64_t           seq;
+	int64_t            ts_sec;
+	int32_t            ts_nsec;
+	int32_t            kind;
+} Sis8300RecIndexRec, *Sis8300RecIndex;
+
+#define SIS8300_REC_DIRECT (1<<0) /* write with O_DIRECT (if the file system supports it) */
+
+typedef struct Sis8300RecParmsRec_ {
+	const char        *path;
+	Sis8300ChannelSel  sel;     /* frames appended must have this selector...     */
+	unsigned           nsmpl;   /* ...and number of samples                       */
+	Sis8300RecClockRec clk;     /* see sis8300RecClockInit()                      */
+	const char        *desc;    /* stored in the header (NULL: none)              */
+	size_t             chunksz; /* chunk size (0: 8MB; at least one frame)        */
+	unsigned           nchunks; /* chunk buffers (2..; 0: 8)                      */
+	int                flags;   /* SIS8300_REC_DIRECT                             */
+} Sis8300RecParmsRec, *Sis8300RecParms;
+
+typedef struct Sis8300RecStatsRec_ {
+	uint64_t           frames;  /* frames appended                                */
+	uint64_t           dropped; /* frames dropped (no chunk buffer available)     */
+	uint64_t           chunks;  /* chunks written                                 */
+	uint64_t           bytes;   /* bytes written                                  */
+	uint64_t           errors;  /* failed writes                                  */
+	unsigned           maxq;    /* max. number of chunks waiting for the writer   */
+} Sis8300RecStatsRec, *Sis8300RecStats;
+
+typedef struct Sis8300RecRec_       *Sis8300Rec;
+typedef struct Sis8300RecReaderRec_ *Sis8300RecReader;
+
+/* Fill in the clock plan as passed to sis8300DigiSetup() ('si5326_parms'
+ * may be NULL) and what can be read from the device 'fd' (digitizer
+ * clock, ADC; skipped if 'fd' is negative).
+ */
+void
+sis8300RecClockInit(Sis8300RecClock clk, int fd, Si5326Parms si5326_parms, unsigned clkhl);
+
+/* Create (or truncate) a recording and start its writer thread.
+ *
+ * RETURNS: recorder or NULL on error.
+ */
+Sis8300Rec
+sis8300RecCreate(Sis8300RecParms parms);
+
+/* Append a frame (copied). Never waits for the writer and never
+ * allocates memory.
+ *
+ * RETURNS: 0 on success, -1 if the frame does not match the recording
+ *          (errno EINVAL) or was dropped (errno EAGAIN; all chunk
+ *          buffers busy).
+ */
+int
+sis8300RecAppend(Sis8300Rec rec, Sis8300Frame frame);
+
+/* Write outstanding frames, the index and the final header and close.
+ *
+ * RETURNS: 0 on success, -1 if any write failed.
+ */
+int
+sis8300RecClose(Sis8300Rec rec);
+
+void
+sis8300RecGetStats(Sis8300Rec rec, Sis8300RecStats stats);
+
+/* Map a recording for reading.
+ *
+ * RETURNS: reader or NULL on error.
+ */
+Sis8300RecReader
+sis8300RecReaderOpen(const char *path);
+
+void
+sis8300RecReaderClose(Sis8300RecReader rd);
+
+/* Header of the recording ('nframes' etc. are zero unless the recording
+ * was closed properly; use sis8300RecReaderCount()).
+ */
+const Sis8300RecHdrRec *
+sis8300RecReaderHeader(Sis8300RecReader rd);
+
+/* Number of frames in the recording */
+uint64_t
+sis8300RecReaderCount(Sis8300RecReader rd);
+
+/* Nonzero if the index had to be rebuilt (recording not closed) */
+int
+sis8300RecReaderRecovered(Sis8300RecReader rd);
+
+/* Obtain frame # 'idx'; the frame points into the mapping and is valid
+ * until the reader is closed.
+ *
+ * RETURNS: 0 on success, -1 if 'idx' is out of range or the record is
+ *          corrupt.
+ */
+int
+sis8300RecReaderFrame(Sis8300RecReader rd, uint64_t idx, Sis8300Frame frame);
+
+/* Locate the first frame with a sequence number >= 'seq' (sequence
+ * numbers are assumed to increase through the recording).
+ *
+ * RETURNS: frame number; sis8300RecReaderCount() if there is none.
+ */
+uint64_t
+sis8300RecReaderFind(Sis8300RecReader rd, uint64_t seq);
+
+#endif
@@ -0,0 +1,3 @@
+/* Test and benchmark program for sis8300Rec.c (run with -h for options) */
+#define TEST_SIS8300REC
+#include "sis8300Rec.c"
@@ -0,0 +1,844 @@
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include <sis8300Shm.h>
+
+/* Shared-memory frame fan-out (see sis8300Shm.h)
+ *
+ * Object layout (offsets are multiples of the page size):
+ *
+ *   0          header (geometry, 'head')
+ *   sync_off   futex and waiter count (the only page subscribers map
+ *              read-write)
+ *   slot_off   slot records (sequence counter + frame metadata)
+ *   data_off   slot buffers, 'stride' bytes apart
+ *
+ * Publisher and subscribers keep private copies of the geometry (the
+ * subscriber's are validated when it opens the object) so that a
+ * misbehaving process can't make them access memory outside the
+ * mapping.
+ *
+ * Frames are numbered n = 0, 1, ...; frame n goes to slot n % nslots
+ * whose counter is 2n+1 while the frame is written and 2n+2 when it is
+ * complete (0: never written). 'head' is the number of the frame written
+ * next.
+ *
+ * Metadata is copied word by word with (relaxed) atomic accesses like
+ * the calibration coefficients (sis8300Cal.c); the samples are read in
+ * place (or with memcpy()) and validated by re-reading the counter.
+ */
+
+#define SHM_MAGIC   0x53385348 /* 'S8SH' */
+#define SHM_VERSION 2
+
+typedef struct ShmHdrRec_ {
+	uint32_t           magic;    /* written last by the publisher            */
+	uint32_t           version;
+	uint32_t           nslots;
+	uint32_t           closed;   /* publisher has gone away                  */
+	uint64_t           hdrsz;
+	uint64_t           slotsz;
+	uint64_t           stride;
+	uint64_t           sync_off;
+	uint64_t           slot_off;
+	uint64_t           data_off;
+	uint64_t           mapsz;
+	uint64_t           head;
+} ShmHdrRec, *ShmHdr;
+
+typedef struct ShmSyncRec_ {
+	uint32_t           futex;    /* incremented with every frame completed   */
+	uint32_t           waiters;  /* subscribers sleeping on 'futex'          */
+} ShmSyncRec, *ShmSync;
+
+typedef struct ShmMetaRec_ {
+	uint64_t           sel;
+	uint64_t           fseq;     /* frame->seq                               */
+	int64_t            ts_sec;
+	int64_t            ts_nsec;
+	uint64_t           sz;       /* bytes of the buffer used                 */
+	int32_t            kind;
+	uint32_t           nsmpl;
+	uint32_t           nch;      /* 0: empty slot (failed commit)            */
+	uint32_t           trig;
+	uint32_t           mask;     /* bit ch-1: channel # ch present           */
+	uint32_t           off[SIS8300_MAX_CHANNELS]; /* first sample of each    */
+} ShmMetaRec;
+
+#define META_WORDS (sizeof(ShmMetaRec)/sizeof(uint32_t))
+
+typedef struct ShmSlotRec_ {
+	uint64_t           seq;
+	union {
+		ShmMetaRec     m;
+		uint32_t       w[META_WORDS];
+	}                  meta;
+} ShmSlotRec, *ShmSlot;
+
+typedef struct Sis8300ShmPubRec_ {
+	char              *name;
+	void              *mem;
+	ShmHdr             hdr;
+	ShmSync            sync;
+	ShmSlot            slots;
+	char              *data;
+	unsigned           nslots;   /* private copies of the geometry           */
+	size_t             slotsz;
+	size_t             stride;
+	size_t             mapsz;
+	uint64_t           n;        /* frame being written                      */
+} Sis8300ShmPubRec;
+
+typedef struct Sis8300ShmSubRec_ {
+	void              *mem;      /* read-only mapping of the object          */
+	const ShmHdrRec   *hdr;
+	ShmSync            sync;     /* read-write mapping of the sync page      */
+	const ShmSlotRec  *slots;
+	const char        *data;
+	unsigned           nslots;   /* validated copies of the geometry         */
+	size_t             slotsz;
+	size_t             stride;
+	size_t             mapsz;
+	uint64_t           next;     /* frame wanted next                        */
+	const ShmSlotRec  *cur;      /* slot of the frame obtained last          */
+	uint64_t           cur_seq;
+	size_t             cur_sz;
+	uint64_t           overruns;
+} Sis8300ShmSubRec;
+
+static long
+shm_futex(uint32_t *addr, int op, uint32_t val, const struct timespec *ts)
+{
+	return syscall( SYS_futex, addr, op, val, ts, 0, 0 );
+}
+
+Sis8300ShmPub
+sis8300ShmPubCreate(const char *name, unsigned nslots, size_t maxsz)
+{
+Sis8300ShmPub pub;
+size_t        pgsz = sysconf( _SC_PAGESIZE );
+size_t        stride, sync_off, slot_off, data_off, mapsz;
+int           fd;
+
+	if ( nslots < 2 || 0 == maxsz ) {
+		fprintf(stderr,"sis8300ShmPubCreate: need at least 2 slots of nonzero size\n");
+		return 0;
+	}
+
+	stride   = (maxsz + pgsz - 1) & ~(pgsz - 1);
+	sync_off = pgsz;
+	slot_off = sync_off + pgsz;
+	data_off = slot_off + ((nslots * sizeof(ShmSlotRec) + pgsz - 1) & ~(pgsz - 1));
+	mapsz    = data_off + nslots * stride;
+
+	if ( ! (pub = calloc( 1, sizeof(*pub) )) || ! (pub->name = strdup( name )) ) {
+		fprintf(stderr,"sis8300ShmPubCreate: no memory\n");
+		free( pub );
+		return 0;
+	}
+	pub->mem    = MAP_FAILED;
+	pub->nslots = nslots;
+	pub->slotsz = maxsz;
+	pub->stride = stride;
+	pub->mapsz  = mapsz;
+
+	/* subscribers of an earlier incarnation keep the old object */
+	shm_unlink( name );
+	if ( (fd = shm_open( name, O_CREAT | O_EXCL | O_RDWR, 0644 )) < 0 ) {
+		fprintf(stderr,"sis8300ShmPubCreate: shm_open(%s) failed: %s\n", name, strerror(errno));
+		goto bail;
+	}
+	if ( ftruncate( fd, mapsz ) ) {
+		fprintf(stderr,"sis8300ShmPubCreate: ftruncate failed: %s\n", strerror(errno));
+		close( fd );
+		goto bail;
+	}
+	pub->mem = mmap( 0, mapsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == pub->mem ) {
+		fprintf(stderr,"sis8300ShmPubCreate: mmap failed: %s\n", strerror(errno));
+		goto bail;
+	}
+
+	/* allocate the pages now rather than in the acquisition path */
+	memset( pub->mem, 0, mapsz );
+
+	pub->hdr   = pub->mem;
+	pub->sync  = (ShmSync)((char*)pub->mem + sync_off);
+	pub->slots = (ShmSlot)((char*)pub->mem + slot_off);
+	pub->data  = (char*)pub->mem + data_off;
+
+	pub->hdr->version  = SHM_VERSION;
+	pub->hdr->nslots   = nslots;
+	pub->hdr->hdrsz    = pgsz;
+	pub->hdr->slotsz   = maxsz;
+	pub->hdr->stride   = stride;
+	pub->hdr->sync_off = sync_off;
+	pub->hdr->slot_off = slot_off;
+	pub->hdr->data_off = data_off;
+	pub->hdr->mapsz    = mapsz;
+	__atomic_store_n( &pub->hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE );
+
+	return pub;
+
+bail:
+	shm_unlink( name );
+	free( pub->name );
+	free( pub );
+	return 0;
+}
+
+void
+sis8300ShmPubDestroy(Sis8300ShmPub pub)
+{
+	if ( ! pub )
+		return;
+	__atomic_store_n( &pub->hdr->closed, 1, __ATOMIC_SEQ_CST );
+	__atomic_add_fetch( &pub->sync->futex, 1, __ATOMIC_SEQ_CST );
+	shm_futex( &pub->sync->futex, FUTEX_WAKE, INT_MAX, 0 );
+	munmap( pub->mem, pub->mapsz );
+	shm_unlink( pub->name );
+	free( pub->name );
+	free( pub );
+}
+
+void *
+sis8300ShmPubBegin(Sis8300ShmPub pub)
+{
+uint64_t n = pub->n;
+ShmSlot  s = &pub->slots[n % pub->nslots];
+
+	__atomic_store_n( &s->seq, 2*n + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	__atomic_store_n( &pub->hdr->head, n + 1, __ATOMIC_RELEASE );
+	return pub->data + (n % pub->nslots) * pub->stride;
+}
+
+int
+sis8300ShmPubCommit(Sis8300ShmPub pub, Sis8300Frame frame)
+{
+uint64_t       n   = pub->n;
+ShmSlot        s   = &pub->slots[n % pub->nslots];
+const int16_t *buf = (const int16_t*)(pub->data + (n % pub->nslots) * pub->stride);
+size_t         max = pub->slotsz / sizeof(int16_t);
+ShmMetaRec     m;
+size_t         off;
+unsigned       i;
+int            ch;
+int            rval = 0;
+
+	memset( &m, 0, sizeof(m) );
+	m.sel     = frame->sel;
+	m.fseq    = frame->seq;
+	m.ts_sec  = frame->ts.tv_sec;
+	m.ts_nsec = frame->ts.tv_nsec;
+	m.kind    = frame->kind;
+	m.nsmpl   = frame->nsmpl;
+	m.nch     = frame->nch;
+	m.trig    = frame->trig;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( ! frame->chnl[ch] )
+			continue;
+		if (    frame->data != buf
+		     || frame->chnl[ch] < buf
+		     || (off = frame->chnl[ch] - buf) > max
+		     || frame->nsmpl > max - off ) {
+			fprintf(stderr,"sis8300ShmPubCommit: frame not inside the slot buffer\n");
+			memset( &m, 0, sizeof(m) );
+			rval = -1;
+			break;
+		}
+		m.off[ch]  = off;
+		m.mask    |= (1 << ch);
+		if ( (off + frame->nsmpl) * sizeof(int16_t) > m.sz )
+			m.sz = (off + frame->nsmpl) * sizeof(int16_t);
+	}
+
+	for ( i = 0; i < META_WORDS; i++ )
+		__atomic_store_n( &s->meta.w[i], ((uint32_t*)&m)[i], __ATOMIC_RELAXED );
+	__atomic_store_n( &s->seq, 2*n + 2, __ATOMIC_RELEASE );
+	pub->n = n + 1;
+
+	/* see sub_wait() for why this doesn't lose wakeups */
+	__atomic_add_fetch( &pub->sync->futex, 1, __ATOMIC_SEQ_CST );
+	if ( __atomic_load_n( &pub->sync->waiters, __ATOMIC_SEQ_CST ) )
+		shm_futex( &pub->sync->futex, FUTEX_WAKE, INT_MAX, 0 );
+
+	return rval;
+}
+
+int
+sis8300ShmPublish(Sis8300ShmPub pub, Sis8300Frame frame)
+{
+Sis8300FrameRec f = *frame;
+size_t          sz, end;
+int16_t        *buf;
+int             ch;
+
+	for ( ch = 0, sz = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( frame->chnl[ch] ) {
+			end = (frame->chnl[ch] - frame->data + frame->nsmpl) * sizeof(int16_t);
+			if ( end > sz )
+				sz = end;
+		}
+	}
+	if ( sz > pub->slotsz ) {
+		fprintf(stderr,"sis8300ShmPublish: frame exceeds slot size\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	buf = sis8300ShmPubBegin( pub );
+	memcpy( buf, frame->data, sz );
+	f.data = buf;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( frame->chnl[ch] )
+			f.chnl[ch] = buf + (frame->chnl[ch] - frame->data);
+	}
+	return sis8300ShmPubCommit( pub, &f );
+}
+
+Sis8300ShmSub
+sis8300ShmSubOpen(const char *name)
+{
+Sis8300ShmSub sub;
+size_t        pgsz = sysconf( _SC_PAGESIZE );
+struct stat   sb;
+ShmHdrRec     h;
+void         *p;
+uint64_t      data_off;
+uint32_t      magic;
+int           fd;
+
+	if ( ! (sub = calloc( 1, sizeof(*sub) )) ) {
+		fprintf(stderr,"sis8300ShmSubOpen: no memory\n");
+		return 0;
+	}
+	sub->mem  = MAP_FAILED;
+	sub->sync = MAP_FAILED;
+
+	if ( (fd = shm_open( name, O_RDWR, 0 )) < 0 ) {
+		fprintf(stderr,"sis8300ShmSubOpen: shm_open(%s) failed: %s\n", name, strerror(errno));
+		goto bail;
+	}
+	if ( fstat( fd, &sb ) || (uint64_t)sb.st_size < 3*pgsz ) {
+		fprintf(stderr,"sis8300ShmSubOpen: %s: not a frame ring\n", name);
+		goto bail_fd;
+	}
+	if ( MAP_FAILED == (p = mmap( 0, pgsz, PROT_READ, MAP_SHARED, fd, 0 )) ) {
+		fprintf(stderr,"sis8300ShmSubOpen: mmap failed: %s\n", strerror(errno));
+		goto bail_fd;
+	}
+	magic = __atomic_load_n( &((ShmHdr)p)->magic, __ATOMIC_ACQUIRE );
+	memcpy( &h, p, sizeof(h) );
+	h.magic = magic;
+	munmap( p, pgsz );
+
+	/* everything derived from the header is checked against the size of
+	 * the object so that a bad header can't lead us outside the mapping
+	 */
+	data_off = 2*pgsz + ((h.nslots * (uint64_t)sizeof(ShmSlotRec) + pgsz - 1) & ~(uint64_t)(pgsz - 1));
+	if (    SHM_MAGIC   != h.magic
+	     || SHM_VERSION != h.version
+	     || pgsz        != h.hdrsz
+	     || pgsz        != h.sync_off
+	     || 2*pgsz      != h.slot_off
+	     || h.nslots    <  2
+	     || data_off    != h.data_off
+	     || 0           == h.slotsz
+	     || h.stride    <  h.slotsz
+	     || 0           != (h.stride & (pgsz - 1))
+	     || data_off    >  (uint64_t)sb.st_size
+	     || h.stride    >  ((uint64_t)sb.st_size - data_off) / h.nslots
+	     || h.mapsz     != data_off + h.nslots * h.stride ) {
+		fprintf(stderr,"sis8300ShmSubOpen: %s: not a frame ring (or incompatible)\n", name);
+		goto bail_fd;
+	}
+	sub->nslots = h.nslots;
+	sub->slotsz = h.slotsz;
+	sub->stride = h.stride;
+	sub->mapsz  = h.mapsz;
+
+	/* subscribers can't disturb the publisher or each other... */
+	if ( MAP_FAILED == (sub->mem = mmap( 0, sub->mapsz, PROT_READ, MAP_SHARED, fd, 0 )) ) {
+		fprintf(stderr,"sis8300ShmSubOpen: mmap failed: %s\n", strerror(errno));
+		goto bail_fd;
+	}
+	/* ...except by waking them up */
+	if ( MAP_FAILED == (sub->sync = mmap( 0, pgsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, h.sync_off )) ) {
+		fprintf(stderr,"sis8300ShmSubOpen: mmap failed: %s\n", strerror(errno));
+		goto bail_fd;
+	}
+	close( fd );
+
+	sub->hdr   = sub->mem;
+	sub->slots = (const ShmSlotRec*)((const char*)sub->mem + h.slot_off);
+	sub->data  = (const char*)sub->mem + h.data_off;
+	sub->next  = __atomic_load_n( &sub->hdr->head, __ATOMIC_ACQUIRE );
+
+	return sub;
+
+bail_fd:
+	close( fd );
+bail:
+	sis8300ShmSubClose( sub );
+	return 0;
+}
+
+void
+sis8300ShmSubClose(Sis8300ShmSub sub)
+{
+	if ( ! sub )
+		return;
+	if ( MAP_FAILED != sub->mem )
+		munmap( sub->mem, sub->mapsz );
+	if ( MAP_FAILED != sub->sync )
+		munmap( sub->sync, sysconf( _SC_PAGESIZE ) );
+	free( sub );
+}
+
+/* Check that the frame described by 'm' lies inside a slot buffer */
+static int
+meta_ok(Sis8300ShmSub sub, const ShmMetaRec *m)
+{
+size_t max = sub->slotsz / sizeof(int16_t);
+int    ch;
+
+	if ( m->sz > sub->slotsz )
+		return 0;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( (m->mask & (1 << ch)) && (m->off[ch] > max || m->nsmpl > max - m->off[ch]) )
+			return 0;
+	}
+	return 1;
+}
+
+/* Try to obtain frame # sub->next.
+ *
+ * RETURNS: 0 on success, 1 if it is not complete yet.
+ */
+static int
+sub_try(Sis8300ShmSub sub, Sis8300Frame frame)
+{
+const ShmSlotRec *s;
+ShmMetaRec        m;
+uint64_t          n, s0, h, oldest;
+unsigned          i, nslots = sub->nslots;
+int               ch;
+
+	for ( ;; ) {
+		n  = sub->next;
+		s  = &sub->slots[n % nslots];
+		s0 = __atomic_load_n( &s->seq, __ATOMIC_ACQUIRE );
+		if ( s0 < 2*n + 2 )
+			return 1;
+		if ( s0 == 2*n + 2 ) {
+			for ( i = 0; i < META_WORDS; i++ )
+				((uint32_t*)&m)[i] = __atomic_load_n( &s->meta.w[i], __ATOMIC_RELAXED );
+			__atomic_thread_fence( __ATOMIC_ACQUIRE );
+			if ( s0 == __atomic_load_n( &s->seq, __ATOMIC_RELAXED ) ) {
+				sub->next = n + 1;
+				if ( 0 == m.nch )
+					continue;
+				if ( ! meta_ok( sub, &m ) ) {
+					fprintf(stderr,"sis8300ShmSubNext: frame %llu: bad metadata; skipped\n", (unsigned long long)n);
+					continue;
+				}
+				break;
+			}
+		}
+		/* overwritten; skip to the oldest frame which may still be there */
+		h      = __atomic_load_n( &sub->hdr->head, __ATOMIC_ACQUIRE );
+		oldest = h > nslots ? h - nslots : 0;
+		if ( oldest <= n )
+			oldest = n + 1;
+		sub->overruns += oldest - n;
+		sub->next      = oldest;
+	}
+
+	sub->cur     = s;
+	sub->cur_seq = s0;
+	sub->cur_sz  = m.sz;
+
+	frame->kind       = m.kind;
+	frame->sel        = m.sel;
+	frame->nsmpl      = m.nsmpl;
+	frame->nch        = m.nch;
+	frame->trig       = m.trig;
+	frame->data       = (const int16_t*)(sub->data + (n % nslots) * sub->stride);
+	frame->seq        = m.fseq;
+	frame->ts.tv_sec  = m.ts_sec;
+	frame->ts.tv_nsec = m.ts_nsec;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ )
+		frame->chnl[ch] = (m.mask & (1 << ch)) ? frame->data + m.off[ch] : 0;
+	return 0;
+}
+
+/* The publisher increments 'futex' and then looks at 'waiters'; we
+ * increment 'waiters' and then the kernel compares 'futex' with the
+ * value read before checking for a frame. Thus either the publisher
+ * sees us waiting or the kernel sees the new value (all accesses are
+ * sequentially consistent).
+ */
+static int
+sub_wait(Sis8300ShmSub sub, Sis8300Frame frame, int timeout_ms)
+{
+struct timespec now, end, rem, *tsp;
+uint32_t        f;
+
+	if ( timeout_ms > 0 ) {
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		end.tv_sec  += timeout_ms / 1000;
+		end.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if ( end.tv_nsec >= 1000000000L ) {
+			end.tv_nsec -= 1000000000L;
+			end.tv_sec++;
+		}
+	}
+
+	for ( ;; ) {
+		f = __atomic_load_n( &sub->sync->futex, __ATOMIC_SEQ_CST );
+		if ( 0 == sub_try( sub, frame ) )
+			return 0;
+		if ( __atomic_load_n( &sub->hdr->closed, __ATOMIC_ACQUIRE ) ) {
+			errno = EPIPE;
+			return -1;
+		}
+		if ( 0 == timeout_ms ) {
+			errno = EAGAIN;
+			return -1;
+		}
+		tsp = 0;
+		if ( timeout_ms > 0 ) {
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			rem.tv_sec  = end.tv_sec  - now.tv_sec;
+			rem.tv_nsec = end.tv_nsec - now.tv_nsec;
+			if ( rem.tv_nsec < 0 ) {
+				rem.tv_nsec += 1000000000L;
+				rem.tv_sec--;
+			}
+			if ( rem.tv_sec < 0 ) {
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			tsp = &rem;
+		}
+		__atomic_add_fetch( &sub->sync->waiters, 1, __ATOMIC_SEQ_CST );
+		shm_futex( &sub->sync->futex, FUTEX_WAIT, f, tsp );
+		__atomic_sub_fetch( &sub->sync->waiters, 1, __ATOMIC_SEQ_CST );
+	}
+}
+
+int
+sis8300ShmSubNext(Sis8300ShmSub sub, Sis8300Frame frame, int timeout_ms)
+{
+	return sub_wait( sub, frame, timeout_ms );
+}
+
+int
+sis8300ShmSubDone(Sis8300ShmSub sub, Sis8300Frame frame)
+{
+	if ( ! sub->cur || frame->data != (const int16_t*)(sub->data + (sub->cur - sub->slots) * sub->stride) ) {
+		errno = EINVAL;
+		return -1;
+	}
+	__atomic_thread_fence( __ATOMIC_ACQUIRE );
+	if ( sub->cur_seq != __atomic_load_n( &sub->cur->seq, __ATOMIC_RELAXED ) ) {
+		sub->overruns++;
+		return -1;
+	}
+	return 0;
+}
+
+int
+sis8300ShmSubCopy(Sis8300ShmSub sub, void *buf, size_t bufsz, Sis8300Frame frame, int timeout_ms)
+{
+const int16_t *src;
+size_t         sz = sub->slotsz;
+int            ch;
+
+	if ( bufsz < sz ) {
+		fprintf(stderr,"sis8300ShmSubCopy: buffer too small (need %lu bytes)\n", (unsigned long)sz);
+		errno = EINVAL;
+		return -1;
+	}
+	do {
+		if ( sub_wait( sub, frame, timeout_ms ) )
+			return -1;
+		memcpy( buf, frame->data, sub->cur_sz );
+	} while ( sis8300ShmSubDone( sub, frame ) );
+
+	src         = frame->data;
+	frame->data = buf;
+	for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+		if ( frame->chnl[ch] )
+			frame->chnl[ch] = (const int16_t*)buf + (frame->chnl[ch] - src);
+	}
+	return 0;
+}
+
+uint64_t
+sis8300ShmSubOverruns(Sis8300ShmSub sub)
+{
+	return sub->overruns;
+}
+
+size_t
+sis8300ShmSubSlotSize(Sis8300ShmSub sub)
+{
+	return sub->slotsz;
+}
+
+#ifdef TEST_SIS8300SHM
+/* Checks the subscriber's view of overwritten slots (deterministically,
+ * in one process), then forks subscribers -- one keeping up, a slow one
+ * and one copying -- which check every frame they get and that they see
+ * EPIPE once the publisher is destroyed.
+ */
+#include <getopt.h>
+#include <sys/wait.h>
+
+#define TEST_NSLOTS 8
+#define TEST_NSMPL  4096
+#define TEST_GAP    32          /* samples between the two channels */
+#define TEST_SZ     ((2 * TEST_NSMPL + TEST_GAP) * sizeof(int16_t))
+
+/* subscriber exit status */
+#define TEST_BAD    1           /* wrong contents or order         */
+#define TEST_NOPIPE 2           /* didn't end with EPIPE           */
+#define TEST_NOOVR  4           /* slow subscriber never overran   */
+#define TEST_NONE   8           /* got no frame                    */
+
+static int16_t
+test_smpl(uint64_t seq, int ch, unsigned i)
+{
+	return (int16_t)(seq * 11 + ch * 1000 + i);
+}
+
+static int
+test_pub(Sis8300ShmPub pub, uint64_t seq)
+{
+Sis8300FrameRec f;
+int16_t        *b;
+unsigned        i;
+
+	memset( &f, 0, sizeof(f) );
+	b          = sis8300ShmPubBegin( pub );
+	f.nsmpl    = TEST_NSMPL;
+	f.nch      = 2;
+	f.seq      = seq;
+	f.data     = b;
+	f.chnl[0]  = b;
+	f.chnl[2]  = b + TEST_NSMPL + TEST_GAP;
+	for ( i = 0; i < TEST_NSMPL; i++ ) {
+		b[i]                          = test_smpl( seq, 0, i );
+		b[TEST_NSMPL + TEST_GAP + i]  = test_smpl( seq, 2, i );
+	}
+	return sis8300ShmPubCommit( pub, &f );
+}
+
+static int
+test_frame_ok(Sis8300Frame f)
+{
+unsigned i;
+
+	if ( f->nsmpl != TEST_NSMPL || f->nch != 2 || ! f->chnl[0] || f->chnl[1] || ! f->chnl[2] )
+		return 0;
+	for ( i = 0; i < TEST_NSMPL; i++ ) {
+		if ( f->chnl[0][i] != test_smpl( f->seq, 0, i ) || f->chnl[2][i] != test_smpl( f->seq, 2, i ) )
+			return 0;
+	}
+	return 1;
+}
+
+/* Subscriber process; 'mode' 0: keep up, 1: slow, 2: copy.
+ * Tells the parent (writing to 'wfd') once it is subscribed.
+ */
+static int
+test_sub(const char *name, int wfd, int mode)
+{
+static const char *nms[] = { "Subscriber", "Slow subscriber", "Copying subscriber" };
+Sis8300ShmSub      sub;
+Sis8300FrameRec    f;
+void              *buf = 0;
+uint64_t           got = 0, torn = 0, last = 0;
+int                st = 0, r;
+
+	if ( ! (sub = sis8300ShmSubOpen( name )) || (2 == mode && ! (buf = malloc( sis8300ShmSubSlotSize( sub ) ))) )
+		return TEST_NONE;
+	if ( 1 != write( wfd, "x", 1 ) )
+		return TEST_NONE;
+	close( wfd );
+
+	for ( ;; ) {
+		if ( 2 == mode )
+			r = sis8300ShmSubCopy( sub, buf, sis8300ShmSubSlotSize( sub ), &f, 5000 );
+		else
+			r = sis8300ShmSubNext( sub, &f, 5000 );
+		if ( r ) {
+			if ( EPIPE != errno )
+				st |= TEST_NOPIPE;
+			break;
+		}
+		if ( got && f.seq <= last )
+			st |= TEST_BAD;
+		last = f.seq;
+		r    = test_frame_ok( &f );
+		if ( 1 == mode )
+			usleep( 200 );
+		/* the samples may have changed under us */
+		if ( 2 != mode && sis8300ShmSubDone( sub, &f ) ) {
+			torn++;
+			continue;
+		}
+		if ( ! r )
+			st |= TEST_BAD;
+		got++;
+	}
+	if ( 0 == got )
+		st |= TEST_NONE;
+	if ( 1 == mode && 0 == sis8300ShmSubOverruns( sub ) )
+		st |= TEST_NOOVR;
+	printf("%s: %llu frames, %llu overruns (%llu overwritten while in use); status %i\n", nms[mode],
+		(unsigned long long)got, (unsigned long long)sis8300ShmSubOverruns( sub ), (unsigned long long)torn, st);
+	sis8300ShmSubClose( sub );
+	free( buf );
+	return st;
+}
+
+/* Deterministic checks of overrun accounting and sis8300ShmSubDone() */
+static unsigned
+test_overwrite(Sis8300ShmPub pub, const char *name)
+{
+Sis8300ShmSub   sub;
+Sis8300FrameRec f;
+uint64_t        seq = 0, ovr, n;
+unsigned        i, bad = 0;
+
+	if ( ! (sub = sis8300ShmSubOpen( name )) )
+		return 1;
+
+	/* nothing published yet */
+	if ( 0 == sis8300ShmSubNext( sub, &f, 0 ) || EAGAIN != errno )
+		bad++;
+
+	test_pub( pub, seq++ );
+	if ( sis8300ShmSubNext( sub, &f, 0 ) || ! test_frame_ok( &f ) || sis8300ShmSubDone( sub, &f ) )
+		bad++;
+
+	/* wrap around to the slot of the frame held */
+	for ( i = 0; i < TEST_NSLOTS; i++ )
+		test_pub( pub, seq++ );
+	if ( 0 == sis8300ShmSubDone( sub, &f ) || 1 != sis8300ShmSubOverruns( sub ) )
+		bad++;
+
+	/* frames 1..seq-TEST_NSLOTS-1 are gone once these are published */
+	for ( i = 0; i < 3 * TEST_NSLOTS; i++ )
+		test_pub( pub, seq++ );
+	ovr = 1 + (seq - TEST_NSLOTS - 1);
+	for ( n = 0; 0 == sis8300ShmSubNext( sub, &f, 0 ); n++ ) {
+		if ( f.seq != seq - TEST_NSLOTS + n || ! test_frame_ok( &f ) || sis8300ShmSubDone( sub, &f ) )
+			bad++;
+	}
+	if ( EAGAIN != errno || TEST_NSLOTS != n || ovr != sis8300ShmSubOverruns( sub ) ) {
+		fprintf(stderr,"Overwrite test: got %llu frames, %llu overruns (expected %u, %llu)\n",
+			(unsigned long long)n, (unsigned long long)sis8300ShmSubOverruns( sub ), TEST_NSLOTS, (unsigned long long)ovr);
+		bad++;
+	}
+	sis8300ShmSubClose( sub );
+	return bad;
+}
+
+static void
+usage(const char *nm)
+{
+	printf("Usage: %s [-h] [-n n_frames]\n", nm);
+	printf("    Publish frames to forked subscribers which check them\n");
+	printf("  -n n_frames  : number of frames (default 20000)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+Sis8300ShmPub pub;
+char          name[64], c;
+unsigned      nframes = 20000, k, bad = 0;
+pid_t         pid[3];
+int           pfd[2], opt, st, i;
+
+	while ( (opt = getopt(argc, argv, "hn:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'n':
+				if ( 1 != sscanf(optarg,"%u",&nframes) ) {
+					fprintf(stderr,"Invalid -n argument\n");
+					return 1;
+				}
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	snprintf( name, sizeof(name), "/sis8300ShmTest-%u", (unsigned)getpid() );
+	if ( ! (pub = sis8300ShmPubCreate( name, TEST_NSLOTS, TEST_SZ )) )
+		return 1;
+
+	k    = test_overwrite( pub, name );
+	bad += k;
+	printf("Overwritten slots: %u errors\n", k);
+
+	if ( pipe( pfd ) ) {
+		perror("pipe");
+		return 1;
+	}
+	fflush( stdout );
+	for ( i = 0; i < 3; i++ ) {
+		if ( (pid[i] = fork()) < 0 ) {
+			perror("fork");
+			return 1;
+		}
+		if ( 0 == pid[i] ) {
+			close( pfd[0] );
+			exit( test_sub( name, pfd[1], i ) );
+		}
+	}
+	close( pfd[1] );
+	/* subscribers start with the next frame published */
+	for ( i = 0; i < 3; i++ ) {
+		if ( 1 != read( pfd[0], &c, 1 ) ) {
+			fprintf(stderr,"Subscriber failed to start\n");
+			bad++;
+		}
+	}
+	close( pfd[0] );
+
+	for ( k = 0; k < nframes; k++ ) {
+		if ( test_pub( pub, (uint64_t)1000000 + k ) )
+			bad++;
+	}
+	sis8300ShmPubDestroy( pub );
+
+	for ( i = 0; i < 3; i++ ) {
+		if ( pid[i] != waitpid( pid[i], &st, 0 ) || ! WIFEXITED( st ) || WEXITSTATUS( st ) )
+			bad++;
+	}
+
+	printf("Shared-memory test %s\n", bad ? "FAILED" : "PASSED");
+	return !! bad;
+}
+#endif
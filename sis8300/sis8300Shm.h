@@ -0,0 +1,124 @@
+#ifndef SIS8300SHM_H
+#define SIS8300SHM_H
+
+#include <sis8300Digi.h>
+
+/* Shared-memory frame fan-out.
+ *
+ * The process owning the device publishes frames into a ring of slots in
+ * a POSIX shared memory object; any number of subscriber processes map
+ * the object and consume the frames in place -- no copies per consumer,
+ * no locks, and a slow subscriber never holds up the publisher.
+ *
+ * Every slot carries a sequence counter (seqlock): odd while the
+ * publisher writes the slot, even when the frame is complete. A
+ * subscriber processes a frame directly in shared memory and afterwards
+ * checks (sis8300ShmSubDone()) that the slot was not overwritten in the
+ * meantime; if it was then the results must be discarded. Frames which
+ * were overwritten before a subscriber got to them are counted as
+ * overruns (the subscriber skips ahead to the oldest frame available).
+ *
+ * The publisher may fill the slot buffer directly (e.g., by reading the
+ * samples into it: sis8300ShmPubBegin()/sis8300ShmPubCommit()) or copy a
+ * frame obtained elsewhere (sis8300ShmPublish()). Slot buffers are page
+ * aligned; channel offsets are kept per frame so that aligned layouts
+ * (sis8300DigiLayoutAlign()) are preserved.
+ *
+ * Subscribers may sleep until a frame is published (futex on a page of
+ * its own, the only part of the object subscribers may write); the
+ * publisher only enters the kernel if somebody is waiting.
+ *
+ * The publisher is not thread-safe; each subscriber handle must be used
+ * by a single thread (open several handles for several threads).
+ */
+
+typedef struct Sis8300ShmPubRec_ *Sis8300ShmPub;
+typedef struct Sis8300ShmSubRec_ *Sis8300ShmSub;
+
+/* Create the object 'name' (see shm_open(3); e.g., "/sis8300-0") with
+ * 'nslots' slots of 'maxsz' bytes (e.g., a layout's 'sz'). An existing
+ * object of the same name is replaced.
+ *
+ * RETURNS: publisher or NULL on error.
+ */
+Sis8300ShmPub
+sis8300ShmPubCreate(const char *name, unsigned nslots, size_t maxsz);
+
+/* Unmaps and removes the object (mapped subscribers keep their view) */
+void
+sis8300ShmPubDestroy(Sis8300ShmPub pub);
+
+/* Start writing the next slot.
+ *
+ * RETURNS: the slot's buffer (maxsz bytes); the caller fills it and
+ *          must call sis8300ShmPubCommit() before the next Begin.
+ */
+void *
+sis8300ShmPubBegin(Sis8300ShmPub pub);
+
+/* Complete the slot; 'frame' describes the memory image in the buffer
+ * returned by sis8300ShmPubBegin() (frame->data must point to it).
+ *
+ * RETURNS: 0 on success, -1 if the frame is not inside the slot buffer
+ *          (the slot is then published as empty; subscribers skip it).
+ */
+int
+sis8300ShmPubCommit(Sis8300ShmPub pub, Sis8300Frame frame);
+
+/* Copy 'frame' into the next slot and publish it.
+ *
+ * RETURNS: 0 on success, -1 if the frame does not fit.
+ */
+int
+sis8300ShmPublish(Sis8300ShmPub pub, Sis8300Frame frame);
+
+/* Open the object 'name'; the subscriber starts with the next frame
+ * published.
+ *
+ * RETURNS: subscriber or NULL on error.
+ */
+Sis8300ShmSub
+sis8300ShmSubOpen(const char *name);
+
+void
+sis8300ShmSubClose(Sis8300ShmSub sub);
+
+/* Obtain the next frame (in sequence). 'frame' points into shared
+ * memory and remains valid until the publisher wraps around to its
+ * slot; sis8300ShmSubDone() tells whether that happened.
+ *
+ * If no new frame is available wait for up to 'timeout_ms' (forever if
+ * negative; 0: don't wait).
+ *
+ * RETURNS: 0 on success, -1 on timeout (errno ETIMEDOUT or EAGAIN) or
+ *          if the publisher has gone away (errno EPIPE).
+ */
+int
+sis8300ShmSubNext(Sis8300ShmSub sub, Sis8300Frame frame, int timeout_ms);
+
+/* Check whether the frame obtained last was intact while it was used.
+ *
+ * RETURNS: 0 if so, -1 if it has been (or is being) overwritten (counted
+ *          as an overrun; anything derived from it must be discarded).
+ */
+int
+sis8300ShmSubDone(Sis8300ShmSub sub, Sis8300Frame frame);
+
+/* Obtain the next frame and copy it to 'buf' (the views in 'frame'
+ * point into 'buf' which must hold the slot size). Frames overwritten
+ * during the copy are counted and skipped.
+ *
+ * RETURNS: as sis8300ShmSubNext().
+ */
+int
+sis8300ShmSubCopy(Sis8300ShmSub sub, void *buf, size_t bufsz, Sis8300Frame frame, int timeout_ms);
+
+/* Number of frames lost by this subscriber */
+uint64_t
+sis8300ShmSubOverruns(Sis8300ShmSub sub);
+
+/* Size of the slot buffers */
+size_t
+sis8300ShmSubSlotSize(Sis8300ShmSub sub);
+
+#endif
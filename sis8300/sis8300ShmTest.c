@@ -0,0 +1,3 @@
+/* Test program for sis8300Shm.c (run with -h for options) */
+#define TEST_SIS8300SHM
+#include "sis8300Shm.c"
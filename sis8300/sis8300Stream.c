@@ -0,0 +1,893 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <endian.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <sis8300Stream.h>
+
+/* Waveform streaming (see sis8300Stream.h)
+ *
+ * Sender: headers live in an array parallel to the queued messages; the
+ * iovecs of a message point to its header and to the pieces of the
+ * channel blocks the fragment covers (a fragment may span blocks). TCP
+ * uses sendmsg() (i.e., writev() without SIGPIPE).
+ *
+ * Receiver: datagrams are fetched in batches (recvmmsg()) and copied to
+ * their offset in the frame buffer; a TCP payload is received directly
+ * into the frame buffer. Both are resumable across timeouts.
+ */
+
+#define HDR_SZ       sizeof(Sis8300StreamHdrRec)
+#define UDP_IP_HDRS  28            /* IPv4 + UDP headers                        */
+#define IOV_PER_MSG  (1 + SIS8300_MAX_CHANNELS)
+
+#define RX_BATCH     32
+#define RX_PKT       65536
+
+#ifndef IOV_MAX
+#define IOV_MAX      1024
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_FLAGS SIS8300_STREAM_F_BE
+#else
+#define HOST_FLAGS 0
+#endif
+
+typedef struct Sis8300StreamRec_ {
+	Sis8300StreamParmsRec parms;
+	int                   sd;
+	unsigned              frag;   /* max. payload bytes per datagram       */
+	unsigned              nmax;   /* messages (UDP) or frames (TCP) queued */
+	unsigned              nmsg;   /* at most before flushing               */
+	unsigned              niov;   /* iovecs queued (TCP)                   */
+	uint64_t              cnt;    /* frame counter                         */
+	struct mmsghdr       *msg;
+	struct iovec         *iov;
+	Sis8300StreamHdrRec  *hdr;
+	Sis8300StreamStatsRec stats;
+} Sis8300StreamRec;
+
+typedef struct Sis8300StreamRxRec_ {
+	int                   proto;
+	int                   sd;     /* bound (UDP) or listening (TCP) socket */
+	int                   cd;     /* TCP connection; -1: none              */
+	unsigned short        port;
+	char                 *buf;    /* payload of the frame                  */
+	size_t                maxsz;
+	struct mmsghdr       *msg;    /* UDP batch                             */
+	struct iovec         *iov;
+	char                 *pkt;
+	unsigned              bat_i, bat_n;
+	Sis8300StreamHdrRec   raw;    /* TCP header as received                */
+	Sis8300StreamHdrRec   cur;    /* frame being received (host order)     */
+	int                   busy;   /* 'cur' is valid                        */
+	size_t                got;    /* bytes of the frame received           */
+	uint64_t              expect; /* frame counter expected next           */
+	int                   started;
+	uint64_t              lost;
+} Sis8300StreamRxRec;
+
+static void
+hdr_fill(Sis8300StreamHdr h, Sis8300Frame f, uint64_t cnt, unsigned nch, uint32_t off, uint32_t len)
+{
+	h->magic   = htole32( SIS8300_STREAM_MAGIC );
+	h->version = htole16( SIS8300_STREAM_VERSION );
+	h->flags   = htole16( HOST_FLAGS );
+	h->cnt     = htole64( cnt );
+	h->seq     = htole64( f->seq );
+	h->sel     = htole64( f->sel );
+	h->ts_sec  = htole64( f->ts.tv_sec );
+	h->ts_nsec = htole64( f->ts.tv_nsec );
+	h->kind    = htole32( f->kind );
+	h->nsmpl   = htole32( f->nsmpl );
+	h->nch     = htole32( nch );
+	h->trig    = htole32( f->trig );
+	h->off     = htole32( off );
+	h->len     = htole32( len );
+}
+
+/* RETURNS: 0 if the header is valid */
+static int
+hdr_parse(Sis8300StreamHdr h, const Sis8300StreamHdrRec *src)
+{
+	h->magic   = le32toh( src->magic );
+	h->version = le16toh( src->version );
+	h->flags   = le16toh( src->flags );
+	h->cnt     = le64toh( src->cnt );
+	h->seq     = le64toh( src->seq );
+	h->sel     = le64toh( src->sel );
+	h->ts_sec  = le64toh( src->ts_sec );
+	h->ts_nsec = le64toh( src->ts_nsec );
+	h->kind    = le32toh( src->kind );
+	h->nsmpl   = le32toh( src->nsmpl );
+	h->nch     = le32toh( src->nch );
+	h->trig    = le32toh( src->trig );
+	h->off     = le32toh( src->off );
+	h->len     = le32toh( src->len );
+	return SIS8300_STREAM_MAGIC != h->magic || SIS8300_STREAM_VERSION != h->version || h->nch > SIS8300_MAX_CHANNELS;
+}
+
+/* Channel blocks of a frame in selector order.
+ *
+ * RETURNS: number of blocks or -1 if the frame lacks a selected channel.
+ */
+static int
+frame_blocks(Sis8300Frame f, const int16_t *blk[SIS8300_MAX_CHANNELS])
+{
+Sis8300ChannelSel sel = f->sel & ~SIS8300_VALIDATE_SEL_QUIET;
+int               n, ch;
+
+	for ( n = 0; (ch = (sel & 0xf)); n++, sel >>= 4 ) {
+		if ( n >= SIS8300_MAX_CHANNELS || ch > SIS8300_MAX_CHANNELS || ! (blk[n] = f->chnl[ch - 1]) )
+			return -1;
+	}
+	return n;
+}
+
+/* Connect (TCP) or address (UDP) a socket to host:port */
+static int
+sock_connect(const char *host, unsigned short port, int type, int sndbuf)
+{
+struct addrinfo  hints, *res, *rp;
+char             svc[16];
+int              sd = -1, err;
+
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = type;
+	snprintf( svc, sizeof(svc), "%u", port );
+	if ( (err = getaddrinfo( host, svc, &hints, &res )) ) {
+		fprintf(stderr,"sis8300StreamCreate: %s: %s\n", host, gai_strerror( err ));
+		return -1;
+	}
+	for ( rp = res; rp; rp = rp->ai_next ) {
+		if ( (sd = socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol )) < 0 )
+			continue;
+		if ( sndbuf )
+			setsockopt( sd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf) );
+		if ( 0 == connect( sd, rp->ai_addr, rp->ai_addrlen ) )
+			break;
+		close( sd );
+		sd = -1;
+	}
+	freeaddrinfo( res );
+	if ( sd < 0 )
+		fprintf(stderr,"sis8300StreamCreate: unable to connect to %s:%u: %s\n", host, port, strerror(errno));
+	return sd;
+}
+
+Sis8300Stream
+sis8300StreamCreate(Sis8300StreamParms parms)
+{
+Sis8300Stream s;
+unsigned      mtu   = parms->mtu   ? parms->mtu   : 1500;
+unsigned      batch = parms->batch ? parms->batch : 64;
+unsigned      i;
+int           one = 1;
+
+	if ( SIS8300_STREAM_UDP != parms->proto && SIS8300_STREAM_TCP != parms->proto ) {
+		fprintf(stderr,"sis8300StreamCreate: invalid protocol\n");
+		return 0;
+	}
+	if ( SIS8300_STREAM_UDP == parms->proto && (mtu < UDP_IP_HDRS + HDR_SZ + 64 || mtu > 65535) ) {
+		fprintf(stderr,"sis8300StreamCreate: invalid MTU (%u..65535)\n", (unsigned)(UDP_IP_HDRS + HDR_SZ + 64));
+		return 0;
+	}
+
+	if ( ! (s = calloc( 1, sizeof(*s) )) ) {
+		fprintf(stderr,"sis8300StreamCreate: no memory\n");
+		return 0;
+	}
+	s->parms      = *parms;
+	s->parms.host = 0;
+	s->sd         = -1;
+	s->frag       = (mtu - UDP_IP_HDRS - HDR_SZ) & ~7;
+
+	if ( SIS8300_STREAM_TCP == parms->proto ) {
+		/* one header and up to SIS8300_MAX_CHANNELS blocks per frame */
+		if ( batch > IOV_MAX / IOV_PER_MSG )
+			batch = IOV_MAX / IOV_PER_MSG;
+	} else {
+		if ( batch > UIO_MAXIOV )
+			batch = UIO_MAXIOV;
+	}
+	s->nmax = batch;
+
+	if (    ! (s->msg = calloc( batch, sizeof(*s->msg) ))
+	     || ! (s->iov = calloc( batch * IOV_PER_MSG, sizeof(*s->iov) ))
+	     || ! (s->hdr = calloc( batch, sizeof(*s->hdr) )) ) {
+		fprintf(stderr,"sis8300StreamCreate: no memory\n");
+		goto bail;
+	}
+	for ( i = 0; i < batch; i++ )
+		s->msg[i].msg_hdr.msg_iov = &s->iov[i * IOV_PER_MSG];
+
+	if ( (s->sd = sock_connect( parms->host, parms->port, SIS8300_STREAM_TCP == parms->proto ? SOCK_STREAM : SOCK_DGRAM, parms->sndbuf )) < 0 )
+		goto bail;
+	if ( SIS8300_STREAM_TCP == parms->proto )
+		setsockopt( s->sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+
+	return s;
+
+bail:
+	sis8300StreamDestroy( s );
+	return 0;
+}
+
+void
+sis8300StreamDestroy(Sis8300Stream s)
+{
+	if ( ! s )
+		return;
+	if ( s->sd >= 0 )
+		close( s->sd );
+	free( s->msg );
+	free( s->iov );
+	free( s->hdr );
+	free( s );
+}
+
+static int
+udp_flush(Sis8300Stream s)
+{
+unsigned i = 0;
+int      n;
+
+	while ( i < s->nmsg ) {
+		n = sendmmsg( s->sd, s->msg + i, s->nmsg - i, 0 );
+		s->stats.calls++;
+		if ( n < 0 ) {
+			if ( EINTR == errno )
+				continue;
+			s->nmsg = 0;
+			return -1;
+		}
+		i += n;
+	}
+	s->stats.packets += s->nmsg;
+	s->nmsg = 0;
+	return 0;
+}
+
+static int
+tcp_flush(Sis8300Stream s)
+{
+struct msghdr m;
+struct iovec *v   = s->iov;
+size_t        cnt = s->niov;
+ssize_t       n;
+
+	memset( &m, 0, sizeof(m) );
+	while ( cnt ) {
+		m.msg_iov    = v;
+		m.msg_iovlen = cnt;
+		n = sendmsg( s->sd, &m, MSG_NOSIGNAL );
+		s->stats.calls++;
+		if ( n < 0 ) {
+			if ( EINTR == errno )
+				continue;
+			s->nmsg = s->niov = 0;
+			return -1;
+		}
+		s->stats.packets++;
+		/* consume what was written (incl. empty iovecs) */
+		while ( cnt && (size_t)n >= v->iov_len ) {
+			n -= v->iov_len;
+			v++;
+			cnt--;
+		}
+		if ( cnt ) {
+			v->iov_base  = (char*)v->iov_base + n;
+			v->iov_len  -= n;
+		}
+	}
+	s->nmsg = s->niov = 0;
+	return 0;
+}
+
+int
+sis8300StreamSend(Sis8300Stream s, Sis8300Frame *frames, unsigned n)
+{
+const int16_t *blk[SIS8300_MAX_CHANNELS];
+struct iovec  *iov;
+size_t         bsz, sz, off, len, p, rem, o, l;
+unsigned       k, ni, b;
+int            nch;
+uint64_t       cnt;
+
+	for ( k = 0; k < n; k++ ) {
+		if ( (nch = frame_blocks( frames[k], blk )) < 0 ) {
+			fprintf(stderr,"sis8300StreamSend: selected channel missing from frame\n");
+			errno = EINVAL;
+			goto bail;
+		}
+		bsz = (size_t)frames[k]->nsmpl * sizeof(int16_t);
+		sz  = nch * bsz;
+		if ( sz > UINT32_MAX ) {
+			fprintf(stderr,"sis8300StreamSend: frame too big\n");
+			errno = EINVAL;
+			goto bail;
+		}
+		cnt = s->cnt++;
+
+		if ( SIS8300_STREAM_TCP == s->parms.proto ) {
+			if ( s->nmsg == s->nmax && tcp_flush( s ) )
+				goto bail;
+			hdr_fill( &s->hdr[s->nmsg], frames[k], cnt, nch, 0, sz );
+			s->iov[s->niov].iov_base = &s->hdr[s->nmsg];
+			s->iov[s->niov].iov_len  = HDR_SZ;
+			s->niov++;
+			for ( b = 0; b < (unsigned)nch; b++ ) {
+				s->iov[s->niov].iov_base = (void*)blk[b];
+				s->iov[s->niov].iov_len  = bsz;
+				s->niov++;
+			}
+			s->nmsg++;
+			s->stats.bytes += sz;
+			continue;
+		}
+
+		/* UDP: at least one datagram (empty frames) */
+		off = 0;
+		do {
+			if ( s->nmsg == s->nmax && udp_flush( s ) )
+				goto bail;
+			len = sz - off > s->frag ? s->frag : sz - off;
+			hdr_fill( &s->hdr[s->nmsg], frames[k], cnt, nch, off, len );
+			iov = s->msg[s->nmsg].msg_hdr.msg_iov;
+			iov[0].iov_base = &s->hdr[s->nmsg];
+			iov[0].iov_len  = HDR_SZ;
+			for ( ni = 1, p = off, rem = len; rem; ni++ ) {
+				b = p / bsz;
+				o = p % bsz;
+				l = bsz - o < rem ? bsz - o : rem;
+				iov[ni].iov_base = (char*)blk[b] + o;
+				iov[ni].iov_len  = l;
+				p   += l;
+				rem -= l;
+			}
+			s->msg[s->nmsg].msg_hdr.msg_iovlen = ni;
+			s->nmsg++;
+			s->stats.bytes += len;
+			off += len;
+		} while ( off < sz );
+	}
+
+	if ( SIS8300_STREAM_TCP == s->parms.proto ? tcp_flush( s ) : udp_flush( s ) )
+		goto bail;
+
+	s->stats.frames += n;
+	return 0;
+
+bail:
+	s->stats.errors += n;
+	return -1;
+}
+
+void
+sis8300StreamGetStats(Sis8300Stream s, Sis8300StreamStats stats)
+{
+	*stats = s->stats;
+}
+
+Sis8300StreamRx
+sis8300StreamRxCreate(int proto, const char *addr, unsigned short port, size_t maxsz)
+{
+Sis8300StreamRx         rx;
+struct addrinfo         hints, *res, *rp;
+struct sockaddr_storage sa;
+socklen_t               salen = sizeof(sa);
+char                    svc[16];
+int                     err, one = 1, rcvbuf = 8*1024*1024;
+unsigned                i;
+
+	if ( SIS8300_STREAM_UDP != proto && SIS8300_STREAM_TCP != proto ) {
+		fprintf(stderr,"sis8300StreamRxCreate: invalid protocol\n");
+		return 0;
+	}
+
+	if ( ! (rx = calloc( 1, sizeof(*rx) )) ) {
+		fprintf(stderr,"sis8300StreamRxCreate: no memory\n");
+		return 0;
+	}
+	rx->proto = proto;
+	rx->sd    = -1;
+	rx->cd    = -1;
+	rx->maxsz = maxsz;
+
+	if ( ! (rx->buf = malloc( maxsz ? maxsz : 1 )) )
+		goto nomem;
+	if ( SIS8300_STREAM_UDP == proto ) {
+		if (    ! (rx->msg = calloc( RX_BATCH, sizeof(*rx->msg) ))
+		     || ! (rx->iov = calloc( RX_BATCH, sizeof(*rx->iov) ))
+		     || ! (rx->pkt = malloc( RX_BATCH * RX_PKT )) )
+			goto nomem;
+		for ( i = 0; i < RX_BATCH; i++ ) {
+			rx->iov[i].iov_base               = rx->pkt + i * RX_PKT;
+			rx->iov[i].iov_len                = RX_PKT;
+			rx->msg[i].msg_hdr.msg_iov        = &rx->iov[i];
+			rx->msg[i].msg_hdr.msg_iovlen     = 1;
+		}
+	}
+
+	memset( &hints, 0, sizeof(hints) );
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SIS8300_STREAM_TCP == proto ? SOCK_STREAM : SOCK_DGRAM;
+	hints.ai_flags    = AI_PASSIVE;
+	snprintf( svc, sizeof(svc), "%u", port );
+	if ( (err = getaddrinfo( addr, svc, &hints, &res )) ) {
+		fprintf(stderr,"sis8300StreamRxCreate: %s: %s\n", addr ? addr : "*", gai_strerror( err ));
+		goto bail;
+	}
+	for ( rp = res; rp; rp = rp->ai_next ) {
+		if ( (rx->sd = socket( rp->ai_family, rp->ai_socktype, rp->ai_protocol )) < 0 )
+			continue;
+		setsockopt( rx->sd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+		if ( SIS8300_STREAM_UDP == proto )
+			setsockopt( rx->sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf) );
+		if ( 0 == bind( rx->sd, rp->ai_addr, rp->ai_addrlen ) && (SIS8300_STREAM_UDP == proto || 0 == listen( rx->sd, 1 )) )
+			break;
+		close( rx->sd );
+		rx->sd = -1;
+	}
+	freeaddrinfo( res );
+	if ( rx->sd < 0 ) {
+		fprintf(stderr,"sis8300StreamRxCreate: unable to bind to port %u: %s\n", port, strerror(errno));
+		goto bail;
+	}
+
+	if ( 0 == getsockname( rx->sd, (struct sockaddr*)&sa, &salen ) )
+		rx->port = ntohs( AF_INET6 == sa.ss_family ? ((struct sockaddr_in6*)&sa)->sin6_port : ((struct sockaddr_in*)&sa)->sin_port );
+
+	return rx;
+
+nomem:
+	fprintf(stderr,"sis8300StreamRxCreate: no memory\n");
+bail:
+	sis8300StreamRxDestroy( rx );
+	return 0;
+}
+
+void
+sis8300StreamRxDestroy(Sis8300StreamRx rx)
+{
+	if ( ! rx )
+		return;
+	if ( rx->cd >= 0 )
+		close( rx->cd );
+	if ( rx->sd >= 0 )
+		close( rx->sd );
+	free( rx->buf );
+	free( rx->msg );
+	free( rx->iov );
+	free( rx->pkt );
+	free( rx );
+}
+
+unsigned short
+sis8300StreamRxPort(Sis8300StreamRx rx)
+{
+	return rx->port;
+}
+
+uint64_t
+sis8300StreamRxLost(Sis8300StreamRx rx)
+{
+	return rx->lost;
+}
+
+/* Wait until 'fd' is readable or the deadline ('end'; NULL: none) passes.
+ *
+ * RETURNS: 0 if readable, -1 on timeout (ETIMEDOUT) or error.
+ */
+static int
+rx_poll(int fd, const struct timespec *end)
+{
+struct pollfd   pfd;
+struct timespec now;
+long            ms;
+int             r;
+
+	pfd.fd     = fd;
+	pfd.events = POLLIN;
+	for ( ;; ) {
+		ms = -1;
+		if ( end ) {
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			ms = (end->tv_sec - now.tv_sec) * 1000L + (end->tv_nsec - now.tv_nsec) / 1000000L;
+			if ( ms < 0 )
+				ms = 0;
+		}
+		if ( (r = poll( &pfd, 1, (int)ms )) > 0 )
+			return 0;
+		if ( 0 == r ) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if ( EINTR != errno )
+			return -1;
+	}
+}
+
+/* Deliver the frame in rx->cur/rx->buf.
+ *
+ * RETURNS: 0 on success, -1 if the header describes no valid frame.
+ */
+static int
+rx_frame(Sis8300StreamRx rx, Sis8300Frame frame)
+{
+Sis8300StreamHdr h = &rx->cur;
+uint16_t        *p;
+size_t           i, n;
+
+	if (    sis8300DigiFrameSetup( frame, h->kind, h->sel | SIS8300_VALIDATE_SEL_QUIET, h->nsmpl, rx->buf )
+	     || frame->nch != h->nch ) {
+		errno = EPROTO;
+		return -1;
+	}
+	if ( (h->flags & SIS8300_STREAM_F_BE) != HOST_FLAGS ) {
+		p = (uint16_t*)rx->buf;
+		n = (size_t)h->nch * h->nsmpl;
+		for ( i = 0; i < n; i++ )
+			p[i] = (uint16_t)((p[i] << 8) | (p[i] >> 8));
+	}
+	frame->trig       = h->trig;
+	frame->seq        = h->seq;
+	frame->ts.tv_sec  = h->ts_sec;
+	frame->ts.tv_nsec = h->ts_nsec;
+
+	if ( rx->started && h->cnt > rx->expect )
+		rx->lost += h->cnt - rx->expect;
+	rx->expect  = h->cnt + 1;
+	rx->started = 1;
+	return 0;
+}
+
+static int
+rx_udp(Sis8300StreamRx rx, Sis8300Frame frame, const struct timespec *end)
+{
+Sis8300StreamHdrRec h;
+const char         *p;
+size_t              sz;
+unsigned            k;
+int                 n;
+
+	for ( ;; ) {
+		while ( rx->bat_i < rx->bat_n ) {
+			k = rx->bat_i++;
+			p = rx->pkt + k * RX_PKT;
+			/* ignore anything that doesn't fit */
+			if ( rx->msg[k].msg_len < HDR_SZ || hdr_parse( &h, (const Sis8300StreamHdrRec*)p ) || h.len != rx->msg[k].msg_len - HDR_SZ )
+				continue;
+			sz = (size_t)h.nch * h.nsmpl * sizeof(int16_t);
+			if ( sz > rx->maxsz || h.off > sz || h.len > sz - h.off )
+				continue;
+			/* stale (frame delivered or abandoned already) */
+			if ( (rx->started && h.cnt < rx->expect) || (rx->busy && h.cnt < rx->cur.cnt) )
+				continue;
+			/* an incomplete frame is abandoned (counted as a gap) */
+			if ( ! rx->busy || h.cnt != rx->cur.cnt ) {
+				rx->cur  = h;
+				rx->busy = 1;
+				rx->got  = 0;
+			}
+			memcpy( rx->buf + h.off, p + HDR_SZ, h.len );
+			rx->got += h.len;
+			if ( rx->got >= sz ) {
+				rx->busy = 0;
+				if ( 0 == rx_frame( rx, frame ) )
+					return 0;
+			}
+		}
+		if ( rx_poll( rx->sd, end ) )
+			return -1;
+		if ( (n = recvmmsg( rx->sd, rx->msg, RX_BATCH, MSG_DONTWAIT, 0 )) < 0 ) {
+			if ( EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno )
+				continue;
+			return -1;
+		}
+		rx->bat_i = 0;
+		rx->bat_n = n;
+	}
+}
+
+/* Receive some bytes from the TCP connection (dropped on EOF) */
+static ssize_t
+rx_recv(Sis8300StreamRx rx, void *p, size_t n, const struct timespec *end)
+{
+ssize_t r;
+
+	for ( ;; ) {
+		if ( rx_poll( rx->cd, end ) )
+			return -1;
+		if ( (r = recv( rx->cd, p, n, MSG_DONTWAIT )) > 0 )
+			return r;
+		if ( 0 == r ) {
+			close( rx->cd );
+			rx->cd   = -1;
+			rx->got  = 0;
+			rx->busy = 0;
+			errno    = EPIPE;
+			return -1;
+		}
+		if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+			return -1;
+	}
+}
+
+static int
+rx_tcp(Sis8300StreamRx rx, Sis8300Frame frame, const struct timespec *end)
+{
+size_t  sz;
+ssize_t r;
+
+	if ( rx->cd < 0 ) {
+		if ( rx_poll( rx->sd, end ) )
+			return -1;
+		if ( (rx->cd = accept( rx->sd, 0, 0 )) < 0 )
+			return -1;
+		rx->got  = 0;
+		rx->busy = 0;
+	}
+
+	while ( rx->got < HDR_SZ ) {
+		if ( (r = rx_recv( rx, (char*)&rx->raw + rx->got, HDR_SZ - rx->got, end )) < 0 )
+			return -1;
+		rx->got += r;
+	}
+
+	if ( ! rx->busy ) {
+		sz = (size_t)le32toh( rx->raw.nch ) * le32toh( rx->raw.nsmpl ) * sizeof(int16_t);
+		if (    hdr_parse( &rx->cur, &rx->raw )
+		     || 0 != rx->cur.off || rx->cur.len != sz || sz > rx->maxsz ) {
+			fprintf(stderr,"sis8300StreamRxNext: bad header (or frame too big); dropping connection\n");
+			close( rx->cd );
+			rx->cd = -1;
+			errno  = EPROTO;
+			return -1;
+		}
+		rx->busy = 1;
+	}
+
+	sz = rx->cur.len;
+	while ( rx->got < HDR_SZ + sz ) {
+		if ( (r = rx_recv( rx, rx->buf + (rx->got - HDR_SZ), HDR_SZ + sz - rx->got, end )) < 0 )
+			return -1;
+		rx->got += r;
+	}
+	rx->got  = 0;
+	rx->busy = 0;
+
+	if ( rx_frame( rx, frame ) ) {
+		fprintf(stderr,"sis8300StreamRxNext: invalid frame; dropping connection\n");
+		close( rx->cd );
+		rx->cd = -1;
+		errno  = EPROTO;
+		return -1;
+	}
+	return 0;
+}
+
+int
+sis8300StreamRxNext(Sis8300StreamRx rx, Sis8300Frame frame, int timeout_ms)
+{
+struct timespec end;
+
+	if ( timeout_ms >= 0 ) {
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		end.tv_sec  += timeout_ms / 1000;
+		end.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if ( end.tv_nsec >= 1000000000L ) {
+			end.tv_nsec -= 1000000000L;
+			end.tv_sec++;
+		}
+	}
+	if ( SIS8300_STREAM_TCP == rx->proto )
+		return rx_tcp( rx, frame, timeout_ms >= 0 ? &end : 0 );
+	return rx_udp( rx, frame, timeout_ms >= 0 ? &end : 0 );
+}
+
+#ifdef TEST_SIS8300STREAM
+/* Loopback test: frames with an aligned layout (the padding is not sent)
+ * are streamed to a receiver thread and checked sample by sample.
+ */
+#include <pthread.h>
+
+typedef struct TestRxRec_ {
+	Sis8300StreamRx rx;
+	unsigned        nframes;
+	unsigned        got;
+	unsigned        bad;
+} TestRxRec, *TestRx;
+
+static int16_t
+test_smpl(uint64_t seq, int ch, unsigned i)
+{
+	return (int16_t)(seq * 7 + ch * 1000 + i);
+}
+
+static void *
+test_rx(void *arg)
+{
+TestRx          t = arg;
+Sis8300FrameRec f;
+unsigned        i;
+int             ch;
+
+	while ( t->got < t->nframes ) {
+		if ( sis8300StreamRxNext( t->rx, &f, 2000 ) ) {
+			if ( ETIMEDOUT != errno )
+				perror("sis8300StreamRxNext");
+			break;
+		}
+		t->got++;
+		for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+			if ( ! f.chnl[ch] )
+				continue;
+			for ( i = 0; i < f.nsmpl; i++ ) {
+				if ( f.chnl[ch][i] != test_smpl( f.seq, ch, i ) ) {
+					t->bad++;
+					break;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+static int
+test_proto(int proto, unsigned nframes, unsigned nsmpl, unsigned mtu)
+{
+Sis8300StreamParmsRec sp;
+Sis8300StreamStatsRec st;
+Sis8300LayoutRec      lay;
+Sis8300FrameRec       frm[4];
+Sis8300Frame          fp[4];
+Sis8300Stream         s;
+TestRxRec             t;
+pthread_t             tid;
+struct timespec       t0, t1;
+void                 *buf[4];
+double                dt;
+unsigned              k, j, i;
+int                   ch, rval = 1;
+const char           *nm = SIS8300_STREAM_TCP == proto ? "TCP" : "UDP";
+
+	if (    sis8300DigiLayoutInit( &lay, -1, 0x4a21, nsmpl )
+	     || sis8300DigiLayoutAlign( &lay, SIS8300_ALIGN_PAGE ) )
+		return 1;
+
+	for ( j = 0; j < 4; j++ ) {
+		if ( posix_memalign( &buf[j], SIS8300_ALIGN_PAGE, lay.sz ) )
+			return 1;
+		sis8300DigiFrameSetupLayout( &frm[j], SIS8300_KIND_BEAM, &lay, buf[j] );
+		fp[j] = &frm[j];
+	}
+
+	memset( &t, 0, sizeof(t) );
+	t.nframes = nframes;
+	if ( ! (t.rx = sis8300StreamRxCreate( proto, "127.0.0.1", 0, lay.nch * nsmpl * sizeof(int16_t) )) )
+		return 1;
+
+	memset( &sp, 0, sizeof(sp) );
+	sp.proto = proto;
+	sp.host  = "127.0.0.1";
+	sp.port  = sis8300StreamRxPort( t.rx );
+	sp.mtu   = mtu;
+	if ( ! (s = sis8300StreamCreate( &sp )) )
+		goto bail;
+
+	pthread_create( &tid, 0, test_rx, &t );
+
+	clock_gettime( CLOCK_MONOTONIC, &t0 );
+	for ( k = 0; k < nframes; k += 4 ) {
+		for ( j = 0; j < 4; j++ ) {
+			frm[j].seq = k + j;
+			for ( ch = 0; ch < SIS8300_MAX_CHANNELS; ch++ ) {
+				if ( frm[j].chnl[ch] ) {
+					for ( i = 0; i < nsmpl; i++ )
+						((int16_t*)frm[j].chnl[ch])[i] = test_smpl( k + j, ch, i );
+				}
+			}
+		}
+		if ( sis8300StreamSend( s, fp, nframes - k < 4 ? nframes - k : 4 ) ) {
+			perror("sis8300StreamSend");
+			break;
+		}
+		/* don't overrun the UDP receiver */
+		if ( SIS8300_STREAM_UDP == proto )
+			usleep( 200 );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &t1 );
+
+	pthread_join( tid, 0 );
+	sis8300StreamGetStats( s, &st );
+	dt = (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+
+	printf("%s: sent %llu frames in %llu packets (%llu system calls; %.1f MB/s), received %u, lost %llu, bad %u\n",
+		nm,
+		(unsigned long long)st.frames, (unsigned long long)st.packets, (unsigned long long)st.calls,
+		(double)st.bytes / dt / 1.0e6,
+		t.got, (unsigned long long)sis8300StreamRxLost( t.rx ), t.bad);
+
+	/* UDP may lose frames (but must not deliver corrupted ones) */
+	if ( 0 == t.bad && t.got > 0 && (SIS8300_STREAM_UDP == proto || t.got == nframes) ) {
+		printf("%s loopback PASSED\n", nm);
+		rval = 0;
+	} else {
+		printf("%s loopback FAILED\n", nm);
+	}
+
+	sis8300StreamDestroy( s );
+bail:
+	sis8300StreamRxDestroy( t.rx );
+	for ( j = 0; j < 4; j++ )
+		free( buf[j] );
+	return rval;
+}
+
+static void
+usage(const char *nm)
+{
+	printf("Usage: %s [-h] [-n n_frames] [-s n_samples] [-m mtu]\n", nm);
+	printf("    Stream frames over UDP and TCP (loopback) and check them\n");
+	printf("  -n n_frames  : number of frames (default 2000)\n");
+	printf("  -s n_samples : samples per channel (default 4096)\n");
+	printf("  -m mtu       : UDP datagram size (default 9000)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+int      opt;
+unsigned nframes = 2000;
+unsigned nsmpl   = 4096;
+unsigned mtu     = 9000;
+
+	while ( (opt = getopt(argc, argv, "hn:s:m:")) > 0 ) {
+		switch ( opt ) {
+			case 'h':
+				usage( argv[0] );
+				return 0;
+			case 'n':
+				if ( 1 != sscanf(optarg,"%u",&nframes) ) {
+					fprintf(stderr,"Invalid -n argument\n");
+					return 1;
+				}
+				break;
+			case 's':
+				if ( 1 != sscanf(optarg,"%u",&nsmpl) ) {
+					fprintf(stderr,"Invalid -s argument\n");
+					return 1;
+				}
+				break;
+			case 'm':
+				if ( 1 != sscanf(optarg,"%u",&mtu) ) {
+					fprintf(stderr,"Invalid -m argument\n");
+					return 1;
+				}
+				break;
+			default:
+				usage( argv[0] );
+				return 1;
+		}
+	}
+
+	if ( test_proto( SIS8300_STREAM_UDP, nframes, nsmpl, mtu ) )
+		return 1;
+	return test_proto( SIS8300_STREAM_TCP, nframes, nsmpl, mtu );
+}
+#endif
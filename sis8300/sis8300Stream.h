@@ -0,0 +1,127 @@
+#ifndef SIS8300STREAM_H
+#define SIS8300STREAM_H
+
+#include <sis8300Digi.h>
+
+/* Waveform streaming.
+ *
+ * Frames are sent to a receiver over UDP or TCP. The payload of a frame
+ * is its channel blocks in selector order (nch * nsmpl samples; padding
+ * of aligned layouts is not sent). It is preceded by a header carrying
+ * everything needed to interpret it (selector, kind, sample count,
+ * pretrigger, sequence numbers and time stamp).
+ *
+ * UDP: a frame is split into datagrams of at most 'mtu' bytes (IP and
+ *      UDP headers included); each datagram carries the header and the
+ *      fragment's offset in the payload.
+ * TCP: the header is followed by the entire payload.
+ *
+ * Sending does not copy samples: datagrams/writes are gathered (iovec)
+ * directly from the frame's buffers (e.g., of a sis8300Pool or an
+ * acquisition engine) and batched -- all datagrams of a batch of frames
+ * are handed to the kernel by sendmmsg(), TCP uses writev().
+ *
+ * The receiver reassembles frames (UDP) and counts frames lost (gaps in
+ * the stream's frame counter, incomplete frames).
+ *
+ * A stream or receiver must be used by a single thread.
+ */
+
+#define SIS8300_STREAM_UDP 0
+#define SIS8300_STREAM_TCP 1
+
+#define SIS8300_STREAM_MAGIC   0x53385354 /* 'S8ST' */
+#define SIS8300_STREAM_VERSION 1
+
+#define SIS8300_STREAM_F_BE    (1<<0)     /* samples are big-endian          */
+
+/* Header (all fields little-endian) */
+typedef struct Sis8300StreamHdrRec_ {
+	uint32_t           magic;
+	uint16_t           version;
+	uint16_t           flags;
+	uint64_t           cnt;     /* frame counter of the stream                    */
+	uint64_t           seq;     /* frame->seq                                     */
+	uint64_t           sel;     /* selector (order of the blocks in the payload)  */
+	int64_t            ts_sec;
+	int64_t            ts_nsec;
+	int32_t            kind;
+	uint32_t           nsmpl;
+	uint32_t           nch;
+	uint32_t           trig;
+	uint32_t           off;     /* offset of this fragment in the payload (bytes) */
+	uint32_t           len;     /* bytes in this fragment                         */
+} Sis8300StreamHdrRec, *Sis8300StreamHdr;
+
+typedef struct Sis8300StreamParmsRec_ {
+	int                proto;   /* SIS8300_STREAM_UDP or _TCP                     */
+	const char        *host;    /* receiver (name or address)                     */
+	unsigned short     port;
+	unsigned           mtu;     /* UDP datagram size limit (0: 1500)              */
+	unsigned           batch;   /* max. datagrams per sendmmsg() (0: 64)          */
+	int                sndbuf;  /* SO_SNDBUF (0: system default)                  */
+} Sis8300StreamParmsRec, *Sis8300StreamParms;
+
+typedef struct Sis8300StreamStatsRec_ {
+	uint64_t           frames;
+	uint64_t           packets; /* datagrams (UDP) or writes (TCP)                */
+	uint64_t           bytes;   /* payload bytes                                  */
+	uint64_t           calls;   /* system calls                                   */
+	uint64_t           errors;  /* frames not (completely) sent                   */
+} Sis8300StreamStatsRec, *Sis8300StreamStats;
+
+typedef struct Sis8300StreamRec_   *Sis8300Stream;
+typedef struct Sis8300StreamRxRec_ *Sis8300StreamRx;
+
+/* Create a stream; with TCP the receiver must be listening.
+ *
+ * RETURNS: stream or NULL on error.
+ */
+Sis8300Stream
+sis8300StreamCreate(Sis8300StreamParms parms);
+
+void
+sis8300StreamDestroy(Sis8300Stream stream);
+
+/* Send 'n' frames (batched).
+ *
+ * RETURNS: 0 on success, -1 on error (errno set; with TCP the stream is
+ *          broken and must be recreated).
+ */
+int
+sis8300StreamSend(Sis8300Stream stream, Sis8300Frame *frames, unsigned n);
+
+void
+sis8300StreamGetStats(Sis8300Stream stream, Sis8300StreamStats stats);
+
+/* Create a receiver bound to 'addr' (NULL: any) and 'port' (0: any; see
+ * sis8300StreamRxPort()) for frames of up to 'maxsz' payload bytes. A
+ * TCP receiver listens and serves one sender at a time.
+ *
+ * RETURNS: receiver or NULL on error.
+ */
+Sis8300StreamRx
+sis8300StreamRxCreate(int proto, const char *addr, unsigned short port, size_t maxsz);
+
+void
+sis8300StreamRxDestroy(Sis8300StreamRx rx);
+
+unsigned short
+sis8300StreamRxPort(Sis8300StreamRx rx);
+
+/* Receive the next complete frame; waits up to 'timeout_ms' (forever if
+ * negative). The frame points into the receiver's buffer and is valid
+ * until the next call; frame->seq is the sender's frame->seq.
+ *
+ * RETURNS: 0 on success, -1 on error or timeout (errno ETIMEDOUT;
+ *          EPIPE if a TCP sender disconnected; EPROTO on a malformed
+ *          header which also drops a TCP connection).
+ */
+int
+sis8300StreamRxNext(Sis8300StreamRx rx, Sis8300Frame frame, int timeout_ms);
+
+/* Number of frames lost (not received completely) */
+uint64_t
+sis8300StreamRxLost(Sis8300StreamRx rx);
+
+#endif
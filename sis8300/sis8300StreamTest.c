@@ -0,0 +1,3 @@
+/* Loopback test and benchmark program for sis8300Stream.c (run with -h for options) */
+#define TEST_SIS8300STREAM
+#include "sis8300Stream.c"